@@ -0,0 +1,371 @@
+#include "DigitalPin.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @file DigitalPin.cpp
+ *
+ * @brief Implementation of the DigitalPin class.
+ */
+
+/**
+ * @brief Constructor for DigitalPin, an input without events or an output.
+ * @param pin GPIO pin number.
+ * @param direction Input or output.
+ * @param consumer Consumer name shown for the line.
+ * @param initial Level an output starts at.
+ */
+DigitalPin::DigitalPin(int pin, Direction direction, const std::string& consumer, bool initial)
+    : pinNum(pin), direction(direction), edge(Edge::None), group(nullptr), groupOutput(0), level(initial),
+      debounce(0), lastEdge(0), hasEdge(false), bouncePending(false), bounceLevel(false) {
+    line = GpioChipPool::instance().acquireLine(pinNum);
+
+    if (direction == Direction::Output) {
+        checkRequest(consumer, gpiod_line_request_output(line, consumer.c_str(), initial ? 1 : 0));
+    } else {
+        checkRequest(consumer, gpiod_line_request_input(line, consumer.c_str()));
+    }
+}
+
+/**
+ * @brief Constructor for DigitalPin, an input reporting edge events.
+ * @param pin GPIO pin number.
+ * @param edge Edges to report.
+ * @param consumer Consumer name shown for the line.
+ */
+DigitalPin::DigitalPin(int pin, Edge edge, const std::string& consumer)
+    : pinNum(pin), direction(Direction::Input), edge(edge), group(nullptr), groupOutput(0), level(false),
+      debounce(0), lastEdge(0), hasEdge(false), bouncePending(false), bounceLevel(false) {
+    line = GpioChipPool::instance().acquireLine(pinNum);
+
+    int result;
+    switch (edge) {
+    case Edge::Rising:
+        result = gpiod_line_request_rising_edge_events(line, consumer.c_str());
+        break;
+    case Edge::Falling:
+        result = gpiod_line_request_falling_edge_events(line, consumer.c_str());
+        break;
+    case Edge::Both:
+        result = gpiod_line_request_both_edges_events(line, consumer.c_str());
+        break;
+    default:
+        result = gpiod_line_request_input(line, consumer.c_str());
+        break;
+    }
+    checkRequest(consumer, result);
+
+    // Edges are reported relative to the level at the request
+    level = gpiod_line_get_value(line) == 1;
+}
+
+/**
+ * @brief Constructor for DigitalPin, an output written through an output group.
+ * @param group Output group requesting the line with its other outputs, must outlive the pin.
+ * @param pin GPIO pin number.
+ * @param initial Level the output starts at.
+ */
+DigitalPin::DigitalPin(OutputGroup& group, int pin, bool initial)
+    : pinNum(pin), direction(Direction::Output), edge(Edge::None), line(nullptr), group(&group), level(initial),
+      debounce(0), lastEdge(0), hasEdge(false), bouncePending(false), bounceLevel(false) {
+    groupOutput = group.add(pinNum, initial);
+}
+
+/**
+ * @brief Destructor for DigitalPin, releases the line and leaves it at its level.
+ */
+DigitalPin::~DigitalPin() {
+    if (group != nullptr) {
+        group->remove(groupOutput);
+    } else {
+        GpioChipPool::instance().releaseLine(line);
+    }
+}
+
+/**
+ * @brief Set the level of an output.
+ * @param value True for high, false for low.
+ */
+void DigitalPin::write(bool value) {
+    requireOutput("write");
+
+    std::lock_guard<std::mutex> lock(pinMutex);
+
+    if (group != nullptr) {
+        group->set(groupOutput, value);
+    } else if (gpiod_line_set_value(line, value ? 1 : 0) < 0) {
+        throw std::runtime_error("DigitalPin: couldn't write GPIO pin " + std::to_string(pinNum));
+    }
+    level = value;
+}
+
+/**
+ * @brief Drive an output low at once, even while its output group has a batch open.
+ */
+void DigitalPin::forceLow() {
+    requireOutput("forceLow");
+
+    // No pin lock, this is the safety path and the group or the line serialize the write
+    if (group != nullptr) {
+        group->forceOff({groupOutput});
+    } else {
+        gpiod_line_set_value(line, 0);
+    }
+}
+
+/**
+ * @brief Read the level of the pin.
+ * @return Level of the line for an input, the level last written for an output.
+ */
+bool DigitalPin::read() {
+    std::lock_guard<std::mutex> lock(pinMutex);
+
+    if (direction == Direction::Output) {
+        return group != nullptr ? group->get(groupOutput) : level;
+    }
+
+    int value = gpiod_line_get_value(line);
+    if (value < 0) {
+        throw std::runtime_error("DigitalPin: couldn't read GPIO pin " + std::to_string(pinNum));
+    }
+    return value == 1;
+}
+
+/**
+ * @brief Get the GPIO pin number.
+ * @return Pin number.
+ */
+int DigitalPin::getPin() const {
+    return pinNum;
+}
+
+/**
+ * @brief Get the direction of the pin.
+ * @return Input or output.
+ */
+DigitalPin::Direction DigitalPin::getDirection() const {
+    return direction;
+}
+
+/**
+ * @brief Get the file descriptor that becomes readable when an edge event is queued.
+ * @return File descriptor to poll, -1 without events.
+ */
+int DigitalPin::getEventFd() const {
+    if (edge == Edge::None) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(pinMutex);
+    return gpiod_line_event_get_fd(line);
+}
+
+/**
+ * @brief Get how long a poll on the event file descriptor may sleep before readEvent() must be called again.
+ * @return Timeout in milliseconds for poll or epoll_wait, -1 if there is nothing to wait for.
+ */
+int DigitalPin::getEventTimeout() const {
+    std::lock_guard<std::mutex> lock(pinMutex);
+
+    if (!bouncePending) {
+        return -1;
+    }
+
+    // Round up so the poll doesn't wake before the debounce time is over
+    std::chrono::nanoseconds remaining = settleAt - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::nanoseconds(0)) {
+        return 0;
+    }
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count());
+}
+
+/**
+ * @brief Set the debounce time of the edge events.
+ * @param time Debounce time, 0 to report every edge.
+ */
+void DigitalPin::setDebounce(std::chrono::microseconds time) {
+    std::lock_guard<std::mutex> lock(pinMutex);
+    debounce = time;
+}
+
+/**
+ * @brief Read the next queued edge event without blocking.
+ * @param event Set to the event if one is reported.
+ * @return True if an event is reported, false if none is queued or the queued ones were debounced.
+ */
+bool DigitalPin::readEvent(Event& event) {
+    if (edge == Edge::None) {
+        throw std::runtime_error("DigitalPin: GPIO pin " + std::to_string(pinNum) + " has no edge events");
+    }
+
+    std::lock_guard<std::mutex> lock(pinMutex);
+
+    // Drain the queue up to the first event that passes the debounce
+    timespec noWait = {0, 0};
+    while (gpiod_line_event_wait(line, &noWait) == 1) {
+        if (takeEvent(event)) {
+            return true;
+        }
+    }
+    return settle(event);
+}
+
+/**
+ * @brief Wait for the next edge event.
+ * @param timeout Longest time to wait.
+ * @param event Set to the event if one is reported.
+ * @return True if an event is reported, false on timeout.
+ */
+bool DigitalPin::waitForEvent(std::chrono::milliseconds timeout, Event& event) {
+    if (edge == Edge::None) {
+        throw std::runtime_error("DigitalPin: GPIO pin " + std::to_string(pinNum) + " has no edge events");
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::nanoseconds remaining = deadline - now;
+        if (remaining < std::chrono::nanoseconds(0)) {
+            return false;
+        }
+
+        // Wake up when the debounce time of a dropped edge is over to read the level again
+        {
+            std::lock_guard<std::mutex> lock(pinMutex);
+            if (bouncePending && settleAt - now < remaining) {
+                remaining = std::max(std::chrono::nanoseconds(settleAt - now), std::chrono::nanoseconds(0));
+            }
+        }
+
+        timespec wait;
+        wait.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(remaining).count();
+        wait.tv_nsec = (remaining % std::chrono::seconds(1)).count();
+
+        // Wait without the pin lock so the pin stays usable from other threads
+        int result = gpiod_line_event_wait(line, &wait);
+        if (result < 0) {
+            throw std::runtime_error("DigitalPin: couldn't wait for GPIO pin " + std::to_string(pinNum));
+        }
+
+        if (readEvent(event)) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Get the output group the pin is written through.
+ * @return The group, nullptr if the pin has its own line request.
+ */
+OutputGroup* DigitalPin::getGroup() const {
+    return group;
+}
+
+/**
+ * @brief Get the id of the pin's output in its output group.
+ * @return Id of the output, 0 without a group.
+ */
+OutputGroup::OutputId DigitalPin::getGroupOutput() const {
+    return groupOutput;
+}
+
+/**
+ * @brief Throw if the line request failed, giving the line back to the chip pool first.
+ * @param consumer Consumer name shown for the line.
+ * @param result Result of the request call.
+ */
+void DigitalPin::checkRequest(const std::string& consumer, int result) {
+    if (result < 0) {
+        GpioChipPool::instance().releaseLine(line);
+        throw std::runtime_error("DigitalPin: couldn't request GPIO pin " + std::to_string(pinNum) + " for " +
+                                 consumer);
+    }
+}
+
+/**
+ * @brief Throw if the pin is not an output.
+ * @param operation Name of the operation for the message.
+ */
+void DigitalPin::requireOutput(const char* operation) const {
+    if (direction != Direction::Output) {
+        throw std::runtime_error(std::string("DigitalPin: ") + operation + " on input GPIO pin " +
+                                 std::to_string(pinNum));
+    }
+}
+
+/**
+ * @brief Read one queued event and apply the debounce.
+ * @param event Set to the event if it is reported.
+ * @return True if the event is reported, false if it was debounced.
+ */
+bool DigitalPin::takeEvent(Event& event) {
+    gpiod_line_event raw;
+    if (gpiod_line_event_read(line, &raw) < 0) {
+        throw std::runtime_error("DigitalPin: couldn't read an event of GPIO pin " + std::to_string(pinNum));
+    }
+
+    bool rising = raw.event_type == GPIOD_LINE_EVENT_RISING_EDGE;
+    std::chrono::nanoseconds timestamp =
+        std::chrono::seconds(raw.ts.tv_sec) + std::chrono::nanoseconds(raw.ts.tv_nsec);
+
+    // Contact bounce shows up as edges right after the reported one, or as edges that don't change the level
+    if (hasEdge && timestamp - lastEdge < debounce) {
+        // The last of them may be a real change, the level is read again when the debounce time is over
+        bouncePending = true;
+        bounceLevel = rising;
+        settleAt = std::chrono::steady_clock::now() + (lastEdge + debounce - timestamp);
+        return false;
+    }
+
+    // The line ended the debounce time at the level of the last dropped edge
+    if (bouncePending) {
+        level = bounceLevel;
+        bouncePending = false;
+    }
+    if (edge == Edge::Both && rising == level) {
+        return false;
+    }
+
+    level = rising;
+    lastEdge = timestamp;
+    hasEdge = true;
+
+    event.rising = rising;
+    event.timestamp = timestamp;
+    return true;
+}
+
+/**
+ * @brief Read the level once the debounce time of a dropped edge is over.
+ * @param event Set to the event if the level differs from the last reported one.
+ * @return True if an event is reported, false otherwise.
+ */
+bool DigitalPin::settle(Event& event) {
+    if (!bouncePending || std::chrono::steady_clock::now() < settleAt) {
+        return false;
+    }
+    bouncePending = false;
+
+    int value = gpiod_line_get_value(line);
+    if (value < 0) {
+        throw std::runtime_error("DigitalPin: couldn't read GPIO pin " + std::to_string(pinNum));
+    }
+
+    bool rising = value != 0;
+    if (rising == level) {
+        return false;
+    }
+
+    // Report the change at the end of the debounce time, unless only the other edge is reported
+    level = rising;
+    if ((edge == Edge::Rising && !rising) || (edge == Edge::Falling && rising)) {
+        return false;
+    }
+    lastEdge += debounce;
+
+    event.rising = rising;
+    event.timestamp = lastEdge;
+    return true;
+}
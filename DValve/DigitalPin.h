@@ -0,0 +1,208 @@
+#ifndef DIGITALPIN_H
+#define DIGITALPIN_H
+
+#include "GpioChipPool.h"
+#include "OutputGroup.h"
+
+#include <gpiod.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief The DigitalPin class is a thread-safe digital GPIO input or output.
+ * @details The line is taken from the process-wide GpioChipPool. An input can request edge events, which the kernel
+ *          queues on a file descriptor that can be waited on with poll or epoll together with other descriptors,
+ *          so an input wakes its reader on a change instead of being polled. Edges closer together than the
+ *          debounce time are dropped. An output can also be a sibling in an OutputGroup, where its writes are
+ *          applied with the other outputs of the group in one bulk write. Errors throw std::runtime_error.
+ */
+class DigitalPin {
+public:
+    /**
+     * @brief Direction of the pin.
+     */
+    enum class Direction {
+        Input,                  // Read the level of the line
+        Output                  // Drive the line
+    };
+
+    /**
+     * @brief Edges an input reports as events.
+     */
+    enum class Edge {
+        None,                   // No events
+        Rising,                 // Low to high
+        Falling,                // High to low
+        Both                    // Every change
+    };
+
+    /**
+     * @struct Event
+     * @brief Edge seen on an input.
+     */
+    struct Event {
+        bool rising;                            // True for a rising edge, false for a falling one
+        std::chrono::nanoseconds timestamp;     // Kernel time of the edge
+    };
+
+    /**
+     * @brief Constructor for DigitalPin, an input without events or an output.
+     * @param pin GPIO pin number.
+     * @param direction Input or output.
+     * @param consumer Consumer name shown for the line.
+     * @param initial Level an output starts at.
+     */
+    DigitalPin(int pin, Direction direction, const std::string& consumer = "DigitalPin", bool initial = false);
+
+    /**
+     * @brief Constructor for DigitalPin, an input reporting edge events.
+     * @param pin GPIO pin number.
+     * @param edge Edges to report.
+     * @param consumer Consumer name shown for the line.
+     */
+    DigitalPin(int pin, Edge edge, const std::string& consumer = "DigitalPin");
+
+    /**
+     * @brief Constructor for DigitalPin, an output written through an output group.
+     * @param group Output group requesting the line with its other outputs, must outlive the pin.
+     * @param pin GPIO pin number.
+     * @param initial Level the output starts at.
+     */
+    DigitalPin(OutputGroup& group, int pin, bool initial = false);
+
+    /**
+     * @brief Destructor for DigitalPin, releases the line and leaves it at its level.
+     */
+    ~DigitalPin();
+
+    DigitalPin(const DigitalPin&) = delete;
+    DigitalPin& operator=(const DigitalPin&) = delete;
+
+    /**
+     * @brief Set the level of an output.
+     * @details In an output group the write is staged while the group has a batch open.
+     * @param value True for high, false for low.
+     */
+    void write(bool value);
+
+    /**
+     * @brief Drive an output low at once, even while its output group has a batch open.
+     */
+    void forceLow();
+
+    /**
+     * @brief Read the level of the pin.
+     * @return Level of the line for an input, the level last written for an output.
+     */
+    bool read();
+
+    /**
+     * @brief Get the GPIO pin number.
+     * @return Pin number.
+     */
+    int getPin() const;
+
+    /**
+     * @brief Get the direction of the pin.
+     * @return Input or output.
+     */
+    Direction getDirection() const;
+
+    /**
+     * @brief Get the file descriptor that becomes readable when an edge event is queued.
+     * @return File descriptor to poll, -1 without events.
+     */
+    int getEventFd() const;
+
+    /**
+     * @brief Get how long a poll on the event file descriptor may sleep before readEvent() must be called again.
+     * @details After a dropped edge readEvent() reads the level once the debounce time is over, even without a
+     *          further event.
+     * @return Timeout in milliseconds for poll or epoll_wait, -1 if there is nothing to wait for.
+     */
+    int getEventTimeout() const;
+
+    /**
+     * @brief Set the debounce time of the edge events.
+     * @details An edge is dropped if it follows the last reported edge sooner than this, or if it does not change
+     *          the last reported level. When an edge was dropped the level is read again once the debounce time
+     *          is over and reported as an event if it differs from the last reported one.
+     * @param time Debounce time, 0 to report every edge.
+     */
+    void setDebounce(std::chrono::microseconds time);
+
+    /**
+     * @brief Read the next queued edge event without blocking.
+     * @param event Set to the event if one is reported.
+     * @return True if an event is reported, false if none is queued or the queued ones were debounced.
+     */
+    bool readEvent(Event& event);
+
+    /**
+     * @brief Wait for the next edge event.
+     * @param timeout Longest time to wait.
+     * @param event Set to the event if one is reported.
+     * @return True if an event is reported, false on timeout.
+     */
+    bool waitForEvent(std::chrono::milliseconds timeout, Event& event);
+
+    /**
+     * @brief Get the output group the pin is written through.
+     * @return The group, nullptr if the pin has its own line request.
+     */
+    OutputGroup* getGroup() const;
+
+    /**
+     * @brief Get the id of the pin's output in its output group.
+     * @return Id of the output, 0 without a group.
+     */
+    OutputGroup::OutputId getGroupOutput() const;
+
+private:
+    mutable std::mutex pinMutex;                // Guards the line and the debounce state
+    int pinNum;                                 // GPIO pin number
+    Direction direction;                        // Input or output
+    Edge edge;                                  // Edges reported as events
+    gpiod_line* line;                           // Line from the chip pool, nullptr in an output group
+    OutputGroup* group;                         // Output group, nullptr with an own line request
+    OutputGroup::OutputId groupOutput;          // Output of the pin in the group
+    bool level;                                 // Level written, or last level reported by an event
+    std::chrono::nanoseconds debounce;          // Shortest time between two reported edges
+    std::chrono::nanoseconds lastEdge;          // Time of the last reported edge
+    bool hasEdge;                               // An edge has been reported
+    bool bouncePending;                         // An edge was dropped in the debounce time
+    bool bounceLevel;                           // Level of the last dropped edge
+    std::chrono::steady_clock::time_point settleAt;     // End of the debounce time of the dropped edge
+
+    /**
+     * @brief Throw if the line request failed, giving the line back to the chip pool first.
+     * @param consumer Consumer name shown for the line.
+     * @param result Result of the request call.
+     */
+    void checkRequest(const std::string& consumer, int result);
+
+    /**
+     * @brief Throw if the pin is not an output.
+     * @param operation Name of the operation for the message.
+     */
+    void requireOutput(const char* operation) const;
+
+    /**
+     * @brief Read one queued event and apply the debounce.
+     * @details Must be called with pinMutex held and an event queued.
+     * @param event Set to the event if it is reported.
+     * @return True if the event is reported, false if it was debounced.
+     */
+    bool takeEvent(Event& event);
+
+    /**
+     * @brief Read the level once the debounce time of a dropped edge is over.
+     * @details Must be called with pinMutex held.
+     * @param event Set to the event if the level differs from the last reported one.
+     * @return True if an event is reported, false otherwise.
+     */
+    bool settle(Event& event);
+};
+
+#endif // DIGITALPIN_H
@@ -0,0 +1,127 @@
+#include "GpioChipPool.h"
+
+#include <stdexcept>
+
+/**
+ * @file GpioChipPool.cpp
+ *
+ * @brief Implementation of the GpioChipPool class.
+ */
+
+/**
+ * @brief Get the process-wide chip pool.
+ * @return The chip pool.
+ */
+GpioChipPool& GpioChipPool::instance() {
+    static GpioChipPool pool;
+    return pool;
+}
+
+/**
+ * @brief Destructor for GpioChipPool, closes the chips still open.
+ */
+GpioChipPool::~GpioChipPool() {
+    for (Chip& entry : chips) {
+        gpiod_chip_close(entry.chip);
+    }
+}
+
+/**
+ * @brief Take a reference to a chip, opening it if no one uses it yet.
+ * @param path Device path of the chip.
+ * @return The chip.
+ */
+gpiod_chip* GpioChipPool::acquire(const std::string& path) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    for (Chip& entry : chips) {
+        if (entry.path == path) {
+            entry.references++;
+            return entry.chip;
+        }
+    }
+
+    gpiod_chip* chip = gpiod_chip_open(path.c_str());
+    if (chip == nullptr) {
+        throw std::runtime_error("GpioChipPool: couldn't open GPIO chip " + path);
+    }
+
+    chips.push_back({path, chip, 1});
+    return chip;
+}
+
+/**
+ * @brief Drop a reference to a chip, closing it when it was the last one.
+ * @param chip Chip returned by acquire().
+ */
+void GpioChipPool::release(gpiod_chip* chip) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    for (auto it = chips.begin(); it != chips.end(); ++it) {
+        if (it->chip != chip) {
+            continue;
+        }
+
+        if (--it->references == 0) {
+            gpiod_chip_close(it->chip);
+            chips.erase(it);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Get a line handle, holding a reference to its chip.
+ * @param pin Line offset on the chip.
+ * @param path Device path of the chip.
+ * @return The line.
+ */
+gpiod_line* GpioChipPool::acquireLine(int pin, const std::string& path) {
+    gpiod_chip* chip = acquire(path);
+
+    gpiod_line* line = gpiod_chip_get_line(chip, pin);
+    if (line == nullptr) {
+        release(chip);
+        throw std::runtime_error("GpioChipPool: couldn't get GPIO line " + std::to_string(pin) + " of " + path);
+    }
+
+    return line;
+}
+
+/**
+ * @brief Release a line handle, freeing its request if it is still held and dropping the chip reference.
+ * @param line Line returned by acquireLine(), nullptr is ignored.
+ */
+void GpioChipPool::releaseLine(gpiod_line* line) {
+    if (line == nullptr) {
+        return;
+    }
+
+    if (gpiod_line_is_requested(line)) {
+        gpiod_line_release(line);
+    }
+    release(gpiod_line_get_chip(line));
+}
+
+/**
+ * @brief Get the number of chips currently open.
+ * @return Open chips.
+ */
+size_t GpioChipPool::getOpenChips() const {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return chips.size();
+}
+
+/**
+ * @brief Get the number of references held on all chips.
+ * @return References to chips and lines.
+ */
+size_t GpioChipPool::getReferences() const {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    size_t references = 0;
+    for (const Chip& entry : chips) {
+        references += entry.references;
+    }
+    return references;
+}
@@ -0,0 +1,310 @@
+#include "OutputGroup.h"
+
+#include <stdexcept>
+
+/**
+ * @file OutputGroup.cpp
+ *
+ * @brief Implementation of the OutputGroup class.
+ */
+
+/**
+ * @brief Constructor for OutputGroup, without outputs.
+ * @param consumer Consumer name shown for the lines.
+ */
+OutputGroup::OutputGroup(const std::string& consumer)
+    : consumer(consumer), nextId(1), batchDepth(0), bulkWrites(0), changes(0) {
+    // Make sure the chip pool outlives the group
+    GpioChipPool::instance();
+    gpiod_line_bulk_init(&bulk);
+}
+
+/**
+ * @brief Destructor for OutputGroup, drives the remaining outputs low and releases their lines.
+ */
+OutputGroup::~OutputGroup() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    if (outputs.empty()) {
+        return;
+    }
+
+    for (Output& output : outputs) {
+        output.applied = 0;
+    }
+    writeValues();
+    gpiod_line_release_bulk(&bulk);
+
+    for (Output& output : outputs) {
+        GpioChipPool::instance().releaseLine(output.line);
+    }
+}
+
+/**
+ * @brief Add an output, re-requesting the lines of the group together with it.
+ * @param pin GPIO pin number.
+ * @param level Level the output starts at.
+ * @return Id of the output.
+ */
+OutputGroup::OutputId OutputGroup::add(int pin, bool level) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    if (outputs.size() >= GPIOD_LINE_BULK_MAX_LINES) {
+        throw std::runtime_error("OutputGroup: too many outputs in " + consumer);
+    }
+
+    Output output;
+    output.id = nextId++;
+    output.line = GpioChipPool::instance().acquireLine(pin);
+    output.desired = level ? 1 : 0;
+    output.applied = output.desired;
+    outputs.push_back(output);
+
+    try {
+        requestLines();
+    } catch (...) {
+        // Give the line back and keep the other outputs requested
+        outputs.pop_back();
+        GpioChipPool::instance().releaseLine(output.line);
+        requestLines();
+        throw;
+    }
+
+    return output.id;
+}
+
+/**
+ * @brief Remove an output and release its line, leaving the line at its level.
+ * @param id Id of the output.
+ */
+void OutputGroup::remove(OutputId id) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i].id == id) {
+            gpiod_line* line = outputs[i].line;
+
+            outputs.erase(outputs.begin() + i);
+            try {
+                requestLines();
+            } catch (...) {
+                GpioChipPool::instance().releaseLine(line);
+                throw;
+            }
+
+            // The line is no longer requested, only the chip reference is left
+            GpioChipPool::instance().releaseLine(line);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Set the level of an output, staged until the commit during a batch of the calling thread.
+ * @param id Id of the output.
+ * @param level True for high, false for low.
+ */
+void OutputGroup::set(OutputId id, bool level) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    Output* output = findOutput(id);
+    if (output == nullptr) {
+        return;
+    }
+
+    output->desired = level ? 1 : 0;
+    if (inBatch()) {
+        return;
+    }
+
+    // Write only this output, the levels staged by another thread's batch wait for its commit
+    if (output->applied != output->desired) {
+        output->applied = output->desired;
+        changes++;
+        writeValues();
+    }
+}
+
+/**
+ * @brief Get the level an output was last set to, staged or written.
+ * @param id Id of the output.
+ * @return True for high, false for low.
+ */
+bool OutputGroup::get(OutputId id) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    Output* output = findOutput(id);
+    return output != nullptr && output->desired != 0;
+}
+
+/**
+ * @brief Start a batch, writes of the calling thread are staged until the matching commit().
+ */
+void OutputGroup::begin() {
+    std::unique_lock<std::mutex> lock(groupMutex);
+
+    // One thread batches at a time
+    batchClosed.wait(lock, [this]() { return batchDepth == 0 || inBatch(); });
+    batchOwner = std::this_thread::get_id();
+    batchDepth++;
+}
+
+/**
+ * @brief End a batch of the calling thread and apply the staged levels with one bulk write if any changed.
+ * @return True if the lines were written, false otherwise.
+ */
+bool OutputGroup::commit() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    if (!inBatch()) {
+        return false;
+    }
+
+    batchDepth--;
+    if (batchDepth > 0) {
+        return false;
+    }
+
+    batchOwner = std::thread::id();
+    batchClosed.notify_all();
+
+    return apply();
+}
+
+/**
+ * @brief Drive outputs low at once with one bulk write, even during a batch.
+ * @param ids Ids of the outputs.
+ */
+void OutputGroup::forceOff(const std::vector<OutputId>& ids) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+
+    bool changed = false;
+    for (OutputId id : ids) {
+        Output* output = findOutput(id);
+        if (output == nullptr) {
+            continue;
+        }
+
+        output->desired = 0;
+        if (output->applied != 0) {
+            output->applied = 0;
+            changes++;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        writeValues();
+    }
+}
+
+/**
+ * @brief Get the number of outputs.
+ * @return Outputs in the group.
+ */
+size_t OutputGroup::size() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    return outputs.size();
+}
+
+/**
+ * @brief Get the number of bulk writes since the start.
+ * @return Bulk writes.
+ */
+uint64_t OutputGroup::getBulkWrites() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    return bulkWrites;
+}
+
+/**
+ * @brief Get the number of output changes written since the start.
+ * @return Output changes, more than the bulk writes when changes were batched.
+ */
+uint64_t OutputGroup::getChanges() {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    return changes;
+}
+
+/**
+ * @brief Find an output by id.
+ * @param id Id of the output.
+ * @return The output, or nullptr if it does not exist.
+ */
+OutputGroup::Output* OutputGroup::findOutput(OutputId id) {
+    for (Output& output : outputs) {
+        if (output.id == id) {
+            return &output;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Check whether the calling thread has a batch open.
+ * @return True if writes of the calling thread are staged, false otherwise.
+ */
+bool OutputGroup::inBatch() const {
+    return batchDepth > 0 && batchOwner == std::this_thread::get_id();
+}
+
+/**
+ * @brief Release and re-request the bulk with the lines of every output at their written levels.
+ */
+void OutputGroup::requestLines() {
+    if (gpiod_line_bulk_num_lines(&bulk) > 0) {
+        gpiod_line_release_bulk(&bulk);
+    }
+    gpiod_line_bulk_init(&bulk);
+
+    if (outputs.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        gpiod_line_bulk_add(&bulk, outputs[i].line);
+        values[i] = outputs[i].applied;
+    }
+
+    // set_value_bulk only works on lines that were requested together
+    if (gpiod_line_request_bulk_output(&bulk, consumer.c_str(), values) < 0) {
+        gpiod_line_bulk_init(&bulk);
+        throw std::runtime_error("OutputGroup: couldn't request the output lines of " + consumer);
+    }
+}
+
+/**
+ * @brief Write the desired levels with one bulk write if any differs from the written one.
+ * @return True if the lines were written, false otherwise.
+ */
+bool OutputGroup::apply() {
+    bool changed = false;
+    for (Output& output : outputs) {
+        if (output.desired != output.applied) {
+            output.applied = output.desired;
+            changes++;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        writeValues();
+    }
+    return changed;
+}
+
+/**
+ * @brief Write the applied level of every output with one bulk write.
+ */
+void OutputGroup::writeValues() {
+    // Nothing is requested after a failed request
+    if (gpiod_line_bulk_num_lines(&bulk) == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        values[i] = outputs[i].applied;
+    }
+
+    gpiod_line_set_value_bulk(&bulk, values);
+    bulkWrites++;
+}
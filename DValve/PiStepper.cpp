@@ -1,7 +1,10 @@
 #include "PiStepper.h"
+#include <algorithm>
 #include <cmath>
 #include <unistd.h>
 #include <thread>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 PiStepper::PiStepper(int stepPin, int dirPin, int enablePin, int stepsPerRevolution, int microstepping) :
     _stepPin(stepPin),
@@ -16,19 +19,28 @@ PiStepper::PiStepper(int stepPin, int dirPin, int enablePin, int stepsPerRevolut
     _isMoving(false), // Initialize moving flag to false
     _isCalibrated(false) // Initialize calibrated flag to false
 {
-    chip = gpiod_chip_open("/dev/gpiochip0");
-    step_signal = gpiod_chip_get_line(chip, _stepPin);
-    dir_signal = gpiod_chip_get_line(chip, _dirPin);
-    enable_signal = gpiod_chip_get_line(chip, _enablePin);
-    limit_switch_top = gpiod_chip_get_line(chip, LIMIT_SWITCH_TOP_PIN);
-    limit_switch_bottom = gpiod_chip_get_line(chip, LIMIT_SWITCH_BOTTOM_PIN);
+    // Take the lines from the chip shared by the whole process
+    GpioChipPool& pool = GpioChipPool::instance();
+    step_signal = pool.acquireLine(_stepPin);
+    dir_signal = pool.acquireLine(_dirPin);
+    enable_signal = pool.acquireLine(_enablePin);
 
     // Configure GPIO pins
     gpiod_line_request_output(step_signal, "PiStepper_step", 0);
     gpiod_line_request_output(dir_signal, "PiStepper_dir", 0);
     gpiod_line_request_output(enable_signal, "PiStepper_enable", 1);
-    gpiod_line_request_input(limit_switch_bottom, "PiStepper_limit_bottom");
-    gpiod_line_request_input(limit_switch_top, "PiStepper_limit_top");
+
+    // The limit switches report their edges, so the step loops never have to read them
+    limit_switch_bottom.reset(new DigitalPin(LIMIT_SWITCH_BOTTOM_PIN, DigitalPin::Edge::Both,
+                                             "PiStepper_limit_bottom"));
+    limit_switch_top.reset(new DigitalPin(LIMIT_SWITCH_TOP_PIN, DigitalPin::Edge::Both, "PiStepper_limit_top"));
+    limit_switch_bottom->setDebounce(std::chrono::microseconds(LIMIT_SWITCH_DEBOUNCE_US));
+    limit_switch_top->setDebounce(std::chrono::microseconds(LIMIT_SWITCH_DEBOUNCE_US));
+    _bottomLimitHit = !limit_switch_bottom->read();
+    _topLimitHit = !limit_switch_top->read();
+
+    _stopFd = eventfd(0, EFD_CLOEXEC);
+    _limitThread = std::thread(&PiStepper::watchLimitSwitches, this);
 
     disable(); // Start with the motor disabled
 }
@@ -37,12 +49,18 @@ PiStepper::PiStepper() :
     PiStepper(STEP_PIN, DIR_PIN, ENABLE_PIN, STEPS_PER_REVOLUTION, MICROSTEPPING) {};
 
 PiStepper::~PiStepper() {
-    gpiod_line_release(step_signal);
-    gpiod_line_release(dir_signal);
-    gpiod_line_release(enable_signal);
-    gpiod_line_release(limit_switch_top);
-    gpiod_line_release(limit_switch_bottom);
-    gpiod_chip_close(chip);
+    // Wake the limit thread and wait for it before the switches go away
+    uint64_t stop = 1;
+    write(_stopFd, &stop, sizeof(stop));
+    if (_limitThread.joinable()) {
+        _limitThread.join();
+    }
+    close(_stopFd);
+
+    GpioChipPool& pool = GpioChipPool::instance();
+    pool.releaseLine(step_signal);
+    pool.releaseLine(dir_signal);
+    pool.releaseLine(enable_signal);
 }
 
 void PiStepper::setSpeed(float speed) {
@@ -87,12 +105,12 @@ void PiStepper::moveSteps(int steps, int direction) {
             }
         }
 
-        if (gpiod_line_get_value(limit_switch_top) == 0 && direction == 1) {
+        if (_topLimitHit && direction == 1) {
             std::cout << "Top limit switch triggered" << std::endl;
             break;
         }
 
-        if (gpiod_line_get_value(limit_switch_bottom) == 0 && direction == 0) {
+        if (_bottomLimitHit && direction == 0) {
             std::cout << "Bottom limit switch triggered" << std::endl;
             break;
         }
@@ -147,12 +165,19 @@ void PiStepper::emergencyStop() {
 
 void PiStepper::calibrate() {
     enable();
+    _isCalibrated = false; // Not calibrated until both limit switches are reached
     _currentStepCount = 0; // Reset step count
     _fullRangeCount = 0; // Reset full range count
 
     // Move to bottom limit switch
     gpiod_line_set_value(dir_signal, 0);
-    while (gpiod_line_get_value(limit_switch_bottom) == 1) {
+    int steps = 0;
+    while (!_bottomLimitHit) {
+        if (steps++ >= MAX_CALIBRATION_STEPS) {
+            disable();
+            std::cerr << "Calibration failed: bottom limit switch not reached." << std::endl;
+            return;
+        }
         gpiod_line_set_value(step_signal, 1);
         usleep(4000); // Short delay for pulse high
         gpiod_line_set_value(step_signal, 0);
@@ -161,7 +186,13 @@ void PiStepper::calibrate() {
 
     // Move to top limit switch
     gpiod_line_set_value(dir_signal, 1);
-    while (gpiod_line_get_value(limit_switch_top) == 1) {
+    while (!_topLimitHit) {
+        if (_fullRangeCount >= MAX_CALIBRATION_STEPS) {
+            disable();
+            _fullRangeCount = 0; // The range is unknown
+            std::cerr << "Calibration failed: top limit switch not reached." << std::endl;
+            return;
+        }
         gpiod_line_set_value(step_signal, 1);
         usleep(2000); // Short delay for pulse high
         gpiod_line_set_value(step_signal, 0);
@@ -191,6 +222,9 @@ int PiStepper::getFullRangeCount() const {
 
 float PiStepper::getPercentOpen() const {
     std::lock_guard<std::mutex> lock(gpioMutex);
+    if (!_isCalibrated || _fullRangeCount == 0) {
+        return 0.0f; // No range to relate the position to
+    }
     return (_currentStepCount / static_cast<float>(_fullRangeCount)) * 100.0f;
 }
 
@@ -234,6 +268,46 @@ void PiStepper::moveToFullyClosed() {
     // moveSteps(_currentStepCount, 0);
 }
 
+void PiStepper::watchLimitSwitches() {
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = limit_switch_bottom->getEventFd();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, event.data.fd, &event);
+    event.data.fd = limit_switch_top->getEventFd();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, event.data.fd, &event);
+    event.data.fd = _stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, event.data.fd, &event);
+
+    bool running = true;
+    while (running) {
+        // Sleep until a switch changes, or until a debounced switch has to be read again
+        int bottomTimeout = limit_switch_bottom->getEventTimeout();
+        int topTimeout = limit_switch_top->getEventTimeout();
+        int timeout = bottomTimeout < 0 ? topTimeout
+                                        : (topTimeout < 0 ? bottomTimeout : std::min(bottomTimeout, topTimeout));
+
+        epoll_event ready[3];
+        int count = epoll_wait(epollFd, ready, 3, timeout);
+        for (int i = 0; i < count; i++) {
+            if (ready[i].data.fd == _stopFd) {
+                running = false;
+            }
+        }
+
+        DigitalPin::Event edge;
+        while (limit_switch_bottom->readEvent(edge)) {
+            _bottomLimitHit = !edge.rising; // Active low
+        }
+        while (limit_switch_top->readEvent(edge)) {
+            _topLimitHit = !edge.rising; // Active low
+        }
+    }
+
+    close(epollFd);
+}
+
 int PiStepper::getStepsPerRevolution() const {
     return _stepsPerRevolution;
 }
@@ -1,13 +1,19 @@
 #ifndef PiStepper_h
 #define PiStepper_h
 
+#include "DigitalPin.h"
+#include "GpioChipPool.h"
 #include <gpiod.h>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <functional>
 
 #define LIMIT_SWITCH_BOTTOM_PIN 21
 #define LIMIT_SWITCH_TOP_PIN 20
+#define LIMIT_SWITCH_DEBOUNCE_US 5000
 #define STEPS_PER_REVOLUTION 200
 #define MICROSTEPPING 1
 #define DEFAULT_SPEED 20
@@ -16,6 +22,7 @@
 #define DIR_PIN 27
 #define ENABLE_PIN 22
 #define MAX_SPEED 50
+#define MAX_CALIBRATION_STEPS 20000 // Steps after which calibration gives up on reaching a limit switch
 
 class PiStepper {
 public:
@@ -70,19 +77,25 @@ private:
     int _fullRangeCount; // The number of steps from fully closed to fully open
     bool _isMoving; // Flag to indicate if the motor is moving
     bool _isCalibrated; // Flag to indicate if the motor has been calibrated
+    std::atomic<bool> _topLimitHit; // Top limit switch is pressed, kept current by the limit thread
+    std::atomic<bool> _bottomLimitHit; // Bottom limit switch is pressed, kept current by the limit thread
 
 
 
-    // GPIO chip and line pointers
-    gpiod_chip *chip;
+    // GPIO line pointers, the chip is shared through GpioChipPool
     gpiod_line *step_signal;
     gpiod_line *dir_signal;
     gpiod_line *enable_signal;
-    gpiod_line *limit_switch_bottom;
-    gpiod_line *limit_switch_top;
+
+    // Limit switches, active low, reporting their edges to the limit thread
+    std::unique_ptr<DigitalPin> limit_switch_bottom;
+    std::unique_ptr<DigitalPin> limit_switch_top;
+    int _stopFd; // eventfd waking the limit thread to stop
+    std::thread _limitThread; // Thread sleeping until a limit switch changes
 
     // Private methods
     float stepsToAngle(int steps) const; // Convert steps to angle
+    void watchLimitSwitches(); // Limit thread: wait for limit switch edges and update the flags
     mutable std::mutex gpioMutex; // Mutex for thread-safe GPIO access
 };
 
@@ -3,7 +3,7 @@
  * @brief Driver code to test the PiStepper class
  * 
  * Compilation:
- * g++ -o PiStepperDriver PiStepperDriver.cpp PiStepper.cpp -lgpiod -pthread
+ * g++ -o PiStepperDriver PiStepperDriver.cpp PiStepper.cpp GpioChipPool.cpp DigitalPin.cpp OutputGroup.cpp -lgpiod -pthread
  */
 
 #include <iostream>
@@ -9,11 +9,17 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    DigitalPin.cpp \
+    GpioChipPool.cpp \
+    OutputGroup.cpp \
     PiStepper.cpp \
     main.cpp \
     mainwindow.cpp
 
 HEADERS += \
+    DigitalPin.h \
+    GpioChipPool.h \
+    OutputGroup.h \
     PiStepper.h \
     mainwindow.h
 
@@ -0,0 +1,164 @@
+#ifndef OUTPUTGROUP_H
+#define OUTPUTGROUP_H
+
+#include "GpioChipPool.h"
+
+#include <gpiod.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The OutputGroup class drives many on/off GPIO outputs through one bulk line request.
+ * @details The lines of all outputs are requested together, so the whole desired-state vector is applied with a
+ *          single set_value_bulk call and every output that changes switches at the same moment. Between begin()
+ *          and commit() writes are only staged and the batch is applied once at the commit, e.g. at the end of a
+ *          control tick. Outside a batch a write is applied at once, still as one bulk call. Nothing is written
+ *          when no level changed. A batch belongs to the thread that began it: writes from other threads are
+ *          applied at once and a begin() from another thread waits until the open batch is committed. Errors throw
+ *          std::runtime_error.
+ */
+class OutputGroup {
+public:
+    using OutputId = uint64_t;
+
+    /**
+     * @brief Constructor for OutputGroup, without outputs.
+     * @param consumer Consumer name shown for the lines.
+     */
+    OutputGroup(const std::string& consumer = "OutputGroup");
+
+    /**
+     * @brief Destructor for OutputGroup, drives the remaining outputs low and releases their lines.
+     */
+    ~OutputGroup();
+
+    OutputGroup(const OutputGroup&) = delete;
+    OutputGroup& operator=(const OutputGroup&) = delete;
+
+    /**
+     * @brief Add an output, re-requesting the lines of the group together with it.
+     * @details The line must not be requested by anyone else.
+     * @param pin GPIO pin number.
+     * @param level Level the output starts at.
+     * @return Id of the output.
+     */
+    OutputId add(int pin, bool level);
+
+    /**
+     * @brief Remove an output and release its line, leaving the line at its level.
+     * @param id Id of the output.
+     */
+    void remove(OutputId id);
+
+    /**
+     * @brief Set the level of an output, staged until the commit during a batch of the calling thread.
+     * @details Outside such a batch only this output is written, the levels staged by the batch stay staged.
+     * @param id Id of the output.
+     * @param level True for high, false for low.
+     */
+    void set(OutputId id, bool level);
+
+    /**
+     * @brief Get the level an output was last set to, staged or written.
+     * @param id Id of the output.
+     * @return True for high, false for low.
+     */
+    bool get(OutputId id);
+
+    /**
+     * @brief Start a batch, writes of the calling thread are staged until the matching commit().
+     * @details Batches of the same thread nest, another thread waits until the open batch is committed.
+     */
+    void begin();
+
+    /**
+     * @brief End a batch of the calling thread and apply the staged levels with one bulk write if any changed.
+     * @return True if the lines were written, false otherwise.
+     */
+    bool commit();
+
+    /**
+     * @brief Drive outputs low at once with one bulk write, even during a batch.
+     * @details For the safety paths: the levels staged for the other outputs are left for the commit.
+     * @param ids Ids of the outputs.
+     */
+    void forceOff(const std::vector<OutputId>& ids);
+
+    /**
+     * @brief Get the number of outputs.
+     * @return Outputs in the group.
+     */
+    size_t size();
+
+    /**
+     * @brief Get the number of bulk writes since the start.
+     * @return Bulk writes.
+     */
+    uint64_t getBulkWrites();
+
+    /**
+     * @brief Get the number of output changes written since the start.
+     * @return Output changes, more than the bulk writes when changes were batched.
+     */
+    uint64_t getChanges();
+
+private:
+    struct Output {
+        OutputId id;                            // Id of the output
+        gpiod_line* line;                       // Line from the chip pool
+        int desired;                            // Level set, staged during a batch
+        int applied;                            // Level written to the line
+    };
+
+    std::mutex groupMutex;                      // Guards the outputs and the lines
+    std::string consumer;                       // Consumer name of the lines
+    std::vector<Output> outputs;                // Outputs in bulk order
+    OutputId nextId;                            // Id of the next output
+    gpiod_line_bulk bulk;                       // Lines of every output, requested together
+    int values[GPIOD_LINE_BULK_MAX_LINES];      // Levels for the bulk write
+    unsigned batchDepth;                        // Open batches, writes are staged while not 0
+    std::thread::id batchOwner;                 // Thread that began the open batch
+    std::condition_variable batchClosed;        // Signalled when the open batch is committed
+    uint64_t bulkWrites;                        // Bulk writes since the start
+    uint64_t changes;                           // Output changes written since the start
+
+    /**
+     * @brief Find an output by id.
+     * @details Must be called with groupMutex held.
+     * @param id Id of the output.
+     * @return The output, or nullptr if it does not exist.
+     */
+    Output* findOutput(OutputId id);
+
+    /**
+     * @brief Check whether the calling thread has a batch open.
+     * @details Must be called with groupMutex held.
+     * @return True if writes of the calling thread are staged, false otherwise.
+     */
+    bool inBatch() const;
+
+    /**
+     * @brief Release and re-request the bulk with the lines of every output at their written levels.
+     * @details Must be called with groupMutex held.
+     */
+    void requestLines();
+
+    /**
+     * @brief Write the desired levels with one bulk write if any differs from the written one.
+     * @details Must be called with groupMutex held.
+     * @return True if the lines were written, false otherwise.
+     */
+    bool apply();
+
+    /**
+     * @brief Write the applied level of every output with one bulk write.
+     * @details Must be called with groupMutex held.
+     */
+    void writeValues();
+};
+
+#endif // OUTPUTGROUP_H
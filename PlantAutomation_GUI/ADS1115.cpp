@@ -6,19 +6,26 @@
 
 #include "ADS1115.h"
 
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <fcntl.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <linux/i2c-dev.h>
 #include <sys/ioctl.h>
 
+// Devices with a conversion in progress, by I2C address, shared by every ADS1115 object
+static std::mutex claimMutex;
+static std::condition_variable claimReleased;
+static bool claimed[128];
+
 /**
  * @brief Constructor for the ADS1115 object.
  * @param address The I2C address of the device.
  * @param muxSelect The analog input multiplexer configuration.
  */
-ADS1115::ADS1115(uint8_t address, Mux muxSelect) : m_address(address) {
+ADS1115::ADS1115(uint8_t address, Mux muxSelect) : m_address(address), m_claimed(false) {
     // Set default values
     m_buf[0] = 0;
     m_buf[1] = 0;
@@ -55,6 +62,8 @@ ADS1115::ADS1115(uint8_t address, Mux muxSelect) : m_address(address) {
  * @brief Destructor for the ADS1115 object.
  */
 ADS1115::~ADS1115() {
+    // Don't leave the device claimed by a conversion nobody will read
+    release();
     close(m_fd);
 }
 
@@ -67,6 +76,58 @@ ADS1115::~ADS1115() {
  * @return The 16-bit signed integer representing the analog value.
  */
 int16_t ADS1115::read(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
+    startConversion(mux, pga, mode, dataRate);
+    return readConversion();
+}
+
+/**
+ * @brief Start a conversion without waiting for the result.
+ * @param mux The analog input multiplexer configuration.
+ * @param pga The programmable gain amplifier configuration.
+ * @param mode The operation mode.
+ * @param dataRate The data rate.
+ */
+void ADS1115::startConversion(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
+    {
+        std::unique_lock<std::mutex> lock(claimMutex);
+        claimReleased.wait(lock, [this]() { return !claimed[m_address & 0x7F]; });
+        claimed[m_address & 0x7F] = true;
+        m_claimed = true;
+    }
+
+    writeConfig(mux, pga, mode, dataRate);
+}
+
+/**
+ * @brief Start a conversion unless another object has one in progress on the same device.
+ * @param mux The analog input multiplexer configuration.
+ * @param pga The programmable gain amplifier configuration.
+ * @param mode The operation mode.
+ * @param dataRate The data rate.
+ * @return True if the conversion was started, false if the device is busy.
+ */
+bool ADS1115::tryStartConversion(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
+    {
+        std::lock_guard<std::mutex> lock(claimMutex);
+        if (claimed[m_address & 0x7F]) {
+            return false;
+        }
+        claimed[m_address & 0x7F] = true;
+        m_claimed = true;
+    }
+
+    writeConfig(mux, pga, mode, dataRate);
+    return true;
+}
+
+/**
+ * @brief Write the configuration register to start a conversion.
+ * @param mux The analog input multiplexer configuration.
+ * @param pga The programmable gain amplifier configuration.
+ * @param mode The operation mode.
+ * @param dataRate The data rate.
+ */
+void ADS1115::writeConfig(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
     uint16_t config = 0x8000; // Bit 15 needs to be set to start a conversion
 
     // Build the configuration word
@@ -85,7 +146,13 @@ int16_t ADS1115::read(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
         std::cerr << "Write error" << std::endl;
         exit(-1);
     }
+}
 
+/**
+ * @brief Wait for the conversion started by startConversion() and read the result.
+ * @return The 16-bit signed integer representing the analog value.
+ */
+int16_t ADS1115::readConversion() {
     // Wait for the conversion to complete
     do {
         if (::read(m_fd, m_buf, 2) != 2) {
@@ -105,10 +172,33 @@ int16_t ADS1115::read(Mux mux, Pga pga, Mode mode, DataRate dataRate) {
         exit(-1);
     }
 
+    // Let the next conversion on the device start
+    release();
+
     // Convert the result
     return (m_buf[0] << 8) | m_buf[1];
 }
 
+/**
+ * @brief Hand the device to the next object waiting to start a conversion.
+ */
+void ADS1115::release() {
+    std::lock_guard<std::mutex> lock(claimMutex);
+    if (m_claimed) {
+        claimed[m_address & 0x7F] = false;
+        m_claimed = false;
+        claimReleased.notify_all();
+    }
+}
+
+/**
+ * @brief Get the I2C address of the device.
+ * @return The I2C address.
+ */
+uint8_t ADS1115::getAddress() const {
+    return m_address;
+}
+
 /**
  * @brief Read the analog value from AIN0 (single-ended, single-shot mode).
  * @return The 16-bit signed integer representing the analog value.
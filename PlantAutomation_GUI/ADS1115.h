@@ -93,6 +93,40 @@ public:
      */
     int16_t read(Mux mux, Pga pga, Mode mode, DataRate dataRate);
 
+    /**
+     * @brief Start a conversion without waiting for the result.
+     * @details Lets a caller start conversions on several devices before collecting the results. Every
+     *          ADS1115 object on the same address shares one device, so this waits until a conversion
+     *          another object started there has been read.
+     * @param mux The analog input multiplexer configuration.
+     * @param pga The programmable gain amplifier configuration.
+     * @param mode The operation mode.
+     * @param dataRate The data rate.
+     */
+    void startConversion(Mux mux, Pga pga, Mode mode, DataRate dataRate);
+
+    /**
+     * @brief Start a conversion unless another object has one in progress on the same device.
+     * @param mux The analog input multiplexer configuration.
+     * @param pga The programmable gain amplifier configuration.
+     * @param mode The operation mode.
+     * @param dataRate The data rate.
+     * @return True if the conversion was started, false if the device is busy.
+     */
+    bool tryStartConversion(Mux mux, Pga pga, Mode mode, DataRate dataRate);
+
+    /**
+     * @brief Wait for the conversion started by startConversion() and read the result.
+     * @return The 16-bit signed integer representing the analog value.
+     */
+    int16_t readConversion();
+
+    /**
+     * @brief Get the I2C address of the device.
+     * @return The I2C address.
+     */
+    uint8_t getAddress() const;
+
     /**
      * @brief Read the analog value from AIN0 (single-ended, single-shot mode).
      * @return The 16-bit signed integer representing the analog value.
@@ -125,6 +159,21 @@ private:
     Pga pga;                    /**< Programmable gain amplifier configuration. */
     Mode mode;                  /**< Operation mode. */
     DataRate dataRate;          /**< Data rate. */
+    bool m_claimed;             /**< This object has a conversion in progress on the device. */
+
+    /**
+     * @brief Write the configuration register to start a conversion.
+     * @param mux The analog input multiplexer configuration.
+     * @param pga The programmable gain amplifier configuration.
+     * @param mode The operation mode.
+     * @param dataRate The data rate.
+     */
+    void writeConfig(Mux mux, Pga pga, Mode mode, DataRate dataRate);
+
+    /**
+     * @brief Hand the device to the next object waiting to start a conversion.
+     */
+    void release();
 };
 
 #endif // ADS1115_H
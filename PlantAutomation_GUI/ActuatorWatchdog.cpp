@@ -0,0 +1,234 @@
+#include "ActuatorWatchdog.h"
+#include "Logging.h"
+
+#include <utility>
+
+/**
+ * @file ActuatorWatchdog.cpp
+ *
+ * @brief Implementation of the ActuatorWatchdog class.
+ */
+
+/**
+ * @brief Get the process-wide watchdog.
+ * @return The watchdog.
+ */
+ActuatorWatchdog& ActuatorWatchdog::instance() {
+    static ActuatorWatchdog watchdog;
+    return watchdog;
+}
+
+/**
+ * @brief Constructor for ActuatorWatchdog, not running.
+ */
+ActuatorWatchdog::ActuatorWatchdog()
+    : lightsForcedOff(false), timeout(0), tripped(false), tripCount(0), lastLatency(0), maxLatency(0),
+      running(false) {
+}
+
+/**
+ * @brief Destructor for ActuatorWatchdog, stops the watchdog thread.
+ */
+ActuatorWatchdog::~ActuatorWatchdog() {
+    stop();
+}
+
+/**
+ * @brief Add a pump to switch off on a trip.
+ * @param pump Pump, not owned.
+ */
+void ActuatorWatchdog::addPump(WaterPump& pump) {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    pumps.push_back(&pump);
+}
+
+/**
+ * @brief Add a light to switch off on a trip, if lights are included.
+ * @param light Light, not owned.
+ */
+void ActuatorWatchdog::addLight(LightController& light) {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    lights.push_back(&light);
+}
+
+/**
+ * @brief Choose whether a trip also switches the lights off.
+ * @param enabled True to switch the lights off, false to leave them as they are.
+ */
+void ActuatorWatchdog::setLightsForcedOff(bool enabled) {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    lightsForcedOff = enabled;
+}
+
+/**
+ * @brief Start watching the heartbeat.
+ * @param timeout Longest time between two feeds before the outputs are forced safe.
+ */
+void ActuatorWatchdog::start(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+
+    this->timeout = timeout;
+    lastFeed = Clock::now();
+
+    if (!running) {
+        running = true;
+        thread = std::thread(&ActuatorWatchdog::run, this);
+    } else {
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Stop watching the heartbeat.
+ */
+void ActuatorWatchdog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(watchdogMutex);
+        running = false;
+    }
+    wake.notify_one();
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Signal that the control loop is alive.
+ */
+void ActuatorWatchdog::feed() {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+
+    lastFeed = Clock::now();
+
+    if (tripped) {
+        tripped = false;
+        logger.logEvent("INFO", "ActuatorWatchdog", "Heartbeat resumed, outputs released");
+    }
+
+    wake.notify_one();
+}
+
+/**
+ * @brief Check whether the watchdog has tripped and not been fed since.
+ * @return True if the outputs are held safe, false otherwise.
+ */
+bool ActuatorWatchdog::isTripped() {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    return tripped;
+}
+
+/**
+ * @brief Get the number of trips since the start.
+ * @return Number of trips.
+ */
+uint64_t ActuatorWatchdog::getTripCount() {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    return tripCount;
+}
+
+/**
+ * @brief Get the latency of the last trip.
+ * @return Time from the missed deadline to the last output write.
+ */
+std::chrono::microseconds ActuatorWatchdog::getLastLatency() {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    return lastLatency;
+}
+
+/**
+ * @brief Get the largest trip latency.
+ * @return Time from the missed deadline to the last output write.
+ */
+std::chrono::microseconds ActuatorWatchdog::getMaxLatency() {
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    return maxLatency;
+}
+
+/**
+ * @brief Drive every registered output to its safe state.
+ * @param includeLights True to switch the lights off as well.
+ */
+void ActuatorWatchdog::forceSafe(bool includeLights) {
+    // Collect the grouped outputs so every group is switched with one bulk write
+    std::vector<std::pair<OutputGroup*, std::vector<OutputGroup::OutputId>>> batches;
+    auto addOutput = [&batches](OutputGroup* group, OutputGroup::OutputId id) {
+        if (group == nullptr) {
+            return;
+        }
+        for (auto& batch : batches) {
+            if (batch.first == group) {
+                batch.second.push_back(id);
+                return;
+            }
+        }
+        batches.push_back({group, {id}});
+    };
+
+    // Registration happens before the start, the lists don't change while running
+    for (WaterPump* pump : pumps) {
+        addOutput(pump->getOutputGroup(), pump->getOutputId());
+    }
+    if (includeLights) {
+        for (LightController* light : lights) {
+            addOutput(light->getOutputGroup(), light->getOutputId());
+        }
+    }
+
+    for (auto& batch : batches) {
+        batch.first->forceOff(batch.second);
+    }
+
+    // Lines on their own are written here, grouped ones are already low and only update their state
+    for (WaterPump* pump : pumps) {
+        pump->emergencyStop();
+    }
+
+    if (includeLights) {
+        for (LightController* light : lights) {
+            light->turnOff();
+        }
+    }
+}
+
+/**
+ * @brief Watchdog thread: wait for the heartbeat deadline and trip when it passes.
+ */
+void ActuatorWatchdog::run() {
+    std::unique_lock<std::mutex> lock(watchdogMutex);
+
+    while (running) {
+        if (tripped) {
+            // Hold the outputs safe until the loop feeds again
+            wake.wait(lock);
+            continue;
+        }
+
+        Clock::time_point deadline = lastFeed + timeout;
+        if (Clock::now() < deadline) {
+            wake.wait_until(lock, deadline);
+            continue;
+        }
+
+        bool includeLights = lightsForcedOff;
+        tripped = true;
+        tripCount++;
+
+        // Write the outputs without our lock, feed() must not wait on a stuck line
+        lock.unlock();
+        forceSafe(includeLights);
+        std::chrono::microseconds latency =
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - deadline);
+        lock.lock();
+
+        lastLatency = latency;
+        if (latency > maxLatency) {
+            maxLatency = latency;
+        }
+
+        lock.unlock();
+        logger.logEvent("WARN", "ActuatorWatchdog", "Heartbeat missed, outputs forced safe after " +
+                        std::to_string(latency.count()) + " us");
+        lock.lock();
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef ACTUATORWATCHDOG_H
+#define ACTUATORWATCHDOG_H
+
+#include "LightController.h"
+#include "WaterPump.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The ActuatorWatchdog class forces the outputs safe when the control loop stops feeding it.
+ * @details The control loop calls feed() on every tick. A separate thread waits for the heartbeat deadline
+ *          and, if it passes without a feed, drives every registered pump low and optionally every light off
+ *          without taking the locks a stalled thread may hold. Outputs written through an output group are driven
+ *          low with one bulk write per group, so they go safe together. The time from the missed deadline to the
+ *          last output write is measured as the trip latency. The outputs stay safe until the loop feeds again.
+ */
+class ActuatorWatchdog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Get the process-wide watchdog.
+     * @return The watchdog.
+     */
+    static ActuatorWatchdog& instance();
+
+    /**
+     * @brief Constructor for ActuatorWatchdog, not running.
+     */
+    ActuatorWatchdog();
+
+    /**
+     * @brief Destructor for ActuatorWatchdog, stops the watchdog thread.
+     */
+    ~ActuatorWatchdog();
+
+    ActuatorWatchdog(const ActuatorWatchdog&) = delete;
+    ActuatorWatchdog& operator=(const ActuatorWatchdog&) = delete;
+
+    /**
+     * @brief Add a pump to switch off on a trip.
+     * @param pump Pump, not owned.
+     */
+    void addPump(WaterPump& pump);
+
+    /**
+     * @brief Add a light to switch off on a trip, if lights are included.
+     * @param light Light, not owned.
+     */
+    void addLight(LightController& light);
+
+    /**
+     * @brief Choose whether a trip also switches the lights off.
+     * @param enabled True to switch the lights off, false to leave them as they are.
+     */
+    void setLightsForcedOff(bool enabled);
+
+    /**
+     * @brief Start watching the heartbeat.
+     * @param timeout Longest time between two feeds before the outputs are forced safe.
+     */
+    void start(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Stop watching the heartbeat.
+     */
+    void stop();
+
+    /**
+     * @brief Signal that the control loop is alive.
+     */
+    void feed();
+
+    /**
+     * @brief Check whether the watchdog has tripped and not been fed since.
+     * @return True if the outputs are held safe, false otherwise.
+     */
+    bool isTripped();
+
+    /**
+     * @brief Get the number of trips since the start.
+     * @return Number of trips.
+     */
+    uint64_t getTripCount();
+
+    /**
+     * @brief Get the latency of the last trip.
+     * @return Time from the missed deadline to the last output write.
+     */
+    std::chrono::microseconds getLastLatency();
+
+    /**
+     * @brief Get the largest trip latency.
+     * @return Time from the missed deadline to the last output write.
+     */
+    std::chrono::microseconds getMaxLatency();
+
+private:
+    std::mutex watchdogMutex;                   // Guards the heartbeat and the statistics
+    std::condition_variable wake;               // Wakes the thread on a feed or a stop
+    std::vector<WaterPump*> pumps;              // Pumps forced low on a trip
+    std::vector<LightController*> lights;       // Lights forced off on a trip
+    bool lightsForcedOff;                       // A trip includes the lights
+    std::chrono::milliseconds timeout;          // Heartbeat timeout
+    Clock::time_point lastFeed;                 // Time of the last heartbeat
+    bool tripped;                               // The outputs are held safe
+    uint64_t tripCount;                         // Trips since the start
+    std::chrono::microseconds lastLatency;      // Latency of the last trip
+    std::chrono::microseconds maxLatency;       // Largest trip latency
+    bool running;                               // The thread should keep running
+    std::thread thread;                         // Watchdog thread
+
+    /**
+     * @brief Drive every registered output to its safe state.
+     * @details Called without watchdogMutex held.
+     * @param includeLights True to switch the lights off as well.
+     */
+    void forceSafe(bool includeLights);
+
+    /**
+     * @brief Watchdog thread: wait for the heartbeat deadline and trip when it passes.
+     */
+    void run();
+};
+
+#endif // ACTUATORWATCHDOG_H
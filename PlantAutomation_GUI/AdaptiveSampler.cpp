@@ -0,0 +1,92 @@
+#include "AdaptiveSampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @file AdaptiveSampler.cpp
+ *
+ * @brief Implementation of the AdaptiveSampler class.
+ */
+
+/**
+ * @brief Constructor for AdaptiveSampler.
+ * @param fastInterval Sampling interval while the reading changes or the pump runs.
+ * @param slowInterval Longest sampling interval while the reading is flat.
+ * @param flatBand Change (in percent moisture) below which a reading is considered flat.
+ * @param irrigationHold Time after irrigation during which the fast interval is kept.
+ */
+AdaptiveSampler::AdaptiveSampler(std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval,
+                                 double flatBand, std::chrono::milliseconds irrigationHold) :
+        fastInterval(fastInterval),
+        slowInterval(slowInterval),
+        irrigationHold(irrigationHold),
+        interval(fastInterval),
+        flatBand(flatBand),
+        hasSample(false),
+        referenceValue(0.0) {
+}
+
+/**
+ * @brief Check whether a new sample should be taken.
+ * @param now Current time.
+ * @return True if the sensor should be sampled, false otherwise.
+ */
+bool AdaptiveSampler::isSampleDue(Clock::time_point now) const {
+    return !hasSample || now >= getNextSampleTime();
+}
+
+/**
+ * @brief Record a sample and adapt the interval.
+ * @param value Sampled moisture level.
+ * @param now Time of the sample.
+ */
+void AdaptiveSampler::recordSample(double value, Clock::time_point now) {
+    if (!hasSample || std::fabs(value - referenceValue) > flatBand) {
+        // The reading moved, sample fast and measure against the new value
+        referenceValue = value;
+        interval = fastInterval;
+    } else if (now >= holdUntil) {
+        // The reading is flat, back off towards the slow interval
+        interval = std::min(interval * 2, slowInterval);
+    }
+
+    hasSample = true;
+    lastSampleTime = now;
+}
+
+/**
+ * @brief Switch to the fast interval because the zone is being irrigated.
+ * @param now Time of the irrigation.
+ */
+void AdaptiveSampler::notifyIrrigation(Clock::time_point now) {
+    interval = fastInterval;
+    holdUntil = now + irrigationHold;
+}
+
+/**
+ * @brief Set the fast and slow sampling intervals.
+ * @param fastInterval Sampling interval while the reading changes or the pump runs.
+ * @param slowInterval Longest sampling interval while the reading is flat.
+ */
+void AdaptiveSampler::setIntervals(std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval) {
+    this->fastInterval = fastInterval;
+    this->slowInterval = std::max(slowInterval, fastInterval);
+    interval = fastInterval;
+}
+
+/**
+ * @brief Get the current sampling interval.
+ * @return Current sampling interval.
+ */
+std::chrono::milliseconds AdaptiveSampler::getInterval() const {
+    return interval;
+}
+
+/**
+ * @brief Get the time the next sample is due.
+ * @return Time of the next sample.
+ */
+AdaptiveSampler::Clock::time_point AdaptiveSampler::getNextSampleTime() const {
+    return lastSampleTime + interval;
+}
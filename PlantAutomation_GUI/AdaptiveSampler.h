@@ -0,0 +1,81 @@
+#ifndef ADAPTIVESAMPLER_H
+#define ADAPTIVESAMPLER_H
+
+#include <chrono>
+
+/**
+ * @brief The AdaptiveSampler class decides when a sensor should be sampled next.
+ * @details The interval starts at the fast rate and doubles with every flat reading until it reaches
+ *          the slow rate. A reading that moves outside the flat band, or an irrigation event, drops
+ *          the interval straight back to the fast rate. After irrigation the fast rate is held for a
+ *          configurable time so the moisture rise is captured.
+ */
+class AdaptiveSampler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructor for AdaptiveSampler.
+     * @param fastInterval Sampling interval while the reading changes or the pump runs.
+     * @param slowInterval Longest sampling interval while the reading is flat.
+     * @param flatBand Change (in percent moisture) below which a reading is considered flat.
+     * @param irrigationHold Time after irrigation during which the fast interval is kept.
+     */
+    AdaptiveSampler(std::chrono::milliseconds fastInterval = std::chrono::seconds(1),
+                    std::chrono::milliseconds slowInterval = std::chrono::minutes(5),
+                    double flatBand = 0.5,
+                    std::chrono::milliseconds irrigationHold = std::chrono::minutes(10));
+
+    /**
+     * @brief Check whether a new sample should be taken.
+     * @param now Current time.
+     * @return True if the sensor should be sampled, false otherwise.
+     */
+    bool isSampleDue(Clock::time_point now) const;
+
+    /**
+     * @brief Record a sample and adapt the interval.
+     * @param value Sampled moisture level.
+     * @param now Time of the sample.
+     */
+    void recordSample(double value, Clock::time_point now);
+
+    /**
+     * @brief Switch to the fast interval because the zone is being irrigated.
+     * @param now Time of the irrigation.
+     */
+    void notifyIrrigation(Clock::time_point now);
+
+    /**
+     * @brief Set the fast and slow sampling intervals.
+     * @param fastInterval Sampling interval while the reading changes or the pump runs.
+     * @param slowInterval Longest sampling interval while the reading is flat.
+     */
+    void setIntervals(std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval);
+
+    /**
+     * @brief Get the current sampling interval.
+     * @return Current sampling interval.
+     */
+    std::chrono::milliseconds getInterval() const;
+
+    /**
+     * @brief Get the time the next sample is due.
+     * @return Time of the next sample.
+     */
+    Clock::time_point getNextSampleTime() const;
+
+private:
+    std::chrono::milliseconds fastInterval;     // Sampling interval while active
+    std::chrono::milliseconds slowInterval;     // Sampling interval while flat
+    std::chrono::milliseconds irrigationHold;   // Fast sampling hold after irrigation
+    std::chrono::milliseconds interval;         // Current sampling interval
+    double flatBand;                            // Change considered flat
+
+    bool hasSample;                             // A reference sample exists
+    double referenceValue;                      // Value the flat band is measured against
+    Clock::time_point lastSampleTime;           // Time of the last sample
+    Clock::time_point holdUntil;                // End of the post-irrigation fast hold
+};
+
+#endif // ADAPTIVESAMPLER_H
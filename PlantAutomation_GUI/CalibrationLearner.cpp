@@ -0,0 +1,208 @@
+#include "CalibrationLearner.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @file CalibrationLearner.cpp
+ *
+ * @brief Implementation of the CalibrationLearner class.
+ */
+
+/**
+ * @brief Constructor for CalibrationLearner.
+ * @param learningRate Fraction of the observed error applied per adjustment (0-1).
+ * @param peakWindow Time after irrigation in which the saturation peak is searched.
+ * @param floorPeriod Time over which the dry floor is collected.
+ * @param plateauTime Time the readings must stay within the plateau band to count as saturated.
+ * @param plateauBand Width of the plateau band as a fraction of the calibrated span.
+ * @param maxWetDrift Furthest the wet calibration may move from its set value, as a fraction of the span.
+ */
+CalibrationLearner::CalibrationLearner(double learningRate, std::chrono::minutes peakWindow, std::chrono::hours floorPeriod,
+                                       std::chrono::minutes plateauTime, double plateauBand, double maxWetDrift) :
+        learningRate(learningRate),
+        peakWindow(peakWindow),
+        floorPeriod(floorPeriod),
+        plateauTime(plateauTime),
+        plateauBand(plateauBand),
+        maxWetDrift(maxWetDrift),
+        bounds{INT16_MIN, INT16_MAX, INT16_MIN, INT16_MAX},
+        enabled(false),
+        peakOpen(false),
+        hasPeak(false),
+        peakValue(0),
+        inRun(false),
+        runStartValue(0),
+        runPeak(0),
+        hasSetWet(false),
+        setWetValue(0),
+        learnedWetValue(0),
+        floorStarted(false),
+        hasFloor(false),
+        floorValue(0) {
+}
+
+/**
+ * @brief Enable learning within the given bounds.
+ * @param bounds Allowed range of the calibration values.
+ */
+void CalibrationLearner::enable(const Bounds& bounds) {
+    this->bounds = bounds;
+    enabled = true;
+}
+
+/**
+ * @brief Disable learning and drop the collected extremes.
+ */
+void CalibrationLearner::disable() {
+    enabled = false;
+    peakOpen = false;
+    hasPeak = false;
+    inRun = false;
+    hasSetWet = false;
+    floorStarted = false;
+    hasFloor = false;
+}
+
+/**
+ * @brief Check whether learning is enabled.
+ * @return True if enabled, false otherwise.
+ */
+bool CalibrationLearner::isEnabled() const {
+    return enabled;
+}
+
+/**
+ * @brief Open the saturation peak window because the zone was irrigated.
+ * @param now Time of the irrigation.
+ */
+void CalibrationLearner::notifyIrrigation(Clock::time_point now) {
+    if (!enabled) {
+        return;
+    }
+
+    // A new irrigation extends the window, keeping the peak seen so far but starting a new plateau
+    peakOpen = true;
+    peakWindowEnd = now + peakWindow;
+    inRun = false;
+}
+
+/**
+ * @brief Add a raw sample and adjust the calibration values when a window or period closes.
+ * @param rawValue Raw ADC value.
+ * @param now Time of the sample.
+ * @param calWetValue Wet calibration value, updated in place.
+ * @param calDryValue Dry calibration value, updated in place.
+ * @return True if a calibration value was changed, false otherwise.
+ */
+bool CalibrationLearner::addSample(int16_t rawValue, Clock::time_point now, int16_t& calWetValue, int16_t& calDryValue) {
+    if (!enabled || calWetValue == calDryValue) {
+        return false;
+    }
+
+    // A wet value the learner did not produce was set by the user and is the new reference for the drift limit
+    if (!hasSetWet || calWetValue != learnedWetValue) {
+        setWetValue = calWetValue;
+        learnedWetValue = calWetValue;
+        hasSetWet = true;
+    }
+
+    // The sensor may read lower or higher when wet, compare in the wet direction
+    bool wetIsLower = calWetValue < calDryValue;
+    double span = std::fabs(static_cast<double>(calWetValue) - calDryValue);
+    bool changed = false;
+
+    if (peakOpen) {
+        if (now < peakWindowEnd) {
+            // Follow the run of readings within the band, a new run starts when the reading leaves it
+            if (!inRun || std::fabs(static_cast<double>(rawValue) - runStartValue) > plateauBand * span) {
+                inRun = true;
+                runStartValue = rawValue;
+                runPeak = rawValue;
+                runStart = now;
+            } else if (isWetter(rawValue, runPeak, wetIsLower)) {
+                runPeak = rawValue;
+            }
+
+            // Only a run with a near-zero slope for the plateau time shows saturation
+            if (now - runStart >= plateauTime && (!hasPeak || isWetter(runPeak, peakValue, wetIsLower))) {
+                peakValue = runPeak;
+                hasPeak = true;
+            }
+            return false;
+        }
+
+        // The window closed, the plateau is the new 100% point within the drift limit of the set value
+        if (hasPeak) {
+            double setSpan = std::fabs(static_cast<double>(setWetValue) - calDryValue);
+            int16_t limit = static_cast<int16_t>(std::round(maxWetDrift * setSpan));
+            int16_t low = std::max<int>(bounds.wetMin, setWetValue - limit);
+            int16_t high = std::min<int>(bounds.wetMax, setWetValue + limit);
+            int16_t adjusted = nudge(calWetValue, peakValue, low, high);
+            changed = adjusted != calWetValue;
+            calWetValue = adjusted;
+            learnedWetValue = adjusted;
+        }
+        peakOpen = false;
+        hasPeak = false;
+        inRun = false;
+    }
+
+    // Start the first dry floor period
+    if (!floorStarted) {
+        floorStarted = true;
+        floorPeriodEnd = now + floorPeriod;
+    }
+
+    // Track the driest reading outside of irrigation
+    if (!hasFloor || (wetIsLower ? rawValue > floorValue : rawValue < floorValue)) {
+        floorValue = rawValue;
+        hasFloor = true;
+    }
+
+    if (now >= floorPeriodEnd) {
+        // Only widen the dry calibration, moist soil never reaching 0% is not drift
+        bool drierThanCal = wetIsLower ? floorValue > calDryValue : floorValue < calDryValue;
+        if (hasFloor && drierThanCal) {
+            int16_t adjusted = nudge(calDryValue, floorValue, bounds.dryMin, bounds.dryMax);
+            changed = changed || adjusted != calDryValue;
+            calDryValue = adjusted;
+        }
+        hasFloor = false;
+        floorPeriodEnd = now + floorPeriod;
+    }
+
+    return changed;
+}
+
+/**
+ * @brief Move a calibration value towards a target within bounds.
+ * @param value Current calibration value.
+ * @param target Observed value.
+ * @param min Lowest allowed value.
+ * @param max Highest allowed value.
+ * @return Adjusted calibration value.
+ */
+int16_t CalibrationLearner::nudge(int16_t value, int16_t target, int16_t min, int16_t max) const {
+    double adjusted = value + learningRate * (static_cast<double>(target) - value);
+    adjusted = std::round(adjusted);
+
+    if (adjusted < min) {
+        adjusted = min;
+    } else if (adjusted > max) {
+        adjusted = max;
+    }
+
+    return static_cast<int16_t>(adjusted);
+}
+
+/**
+ * @brief Check whether a reading is more saturated than another.
+ * @param value Reading to check.
+ * @param other Reading to compare with.
+ * @param wetIsLower The sensor reads lower when wet.
+ * @return True if value is wetter than other, false otherwise.
+ */
+bool CalibrationLearner::isWetter(int16_t value, int16_t other, bool wetIsLower) {
+    return wetIsLower ? value < other : value > other;
+}
@@ -0,0 +1,130 @@
+#ifndef CALIBRATIONLEARNER_H
+#define CALIBRATIONLEARNER_H
+
+#include <stdint.h>
+#include <chrono>
+
+/**
+ * @brief The CalibrationLearner class slowly corrects soil sensor calibration drift.
+ * @details After every irrigation the most saturated plateau within a window is taken as the new
+ *          100% point and the wet calibration is moved a fraction of the way towards it. A plateau is a
+ *          run of readings that stays within a narrow band for the plateau time, so the transient peak of
+ *          a small dose that never saturates the soil is not learned. The wet calibration also never
+ *          moves further than a fraction of the calibrated span from the value it was set to. Over a long
+ *          period the driest reading is tracked and, if the soil reads drier than the dry calibration,
+ *          the dry calibration is moved a fraction of the way towards it. Both values stay inside the
+ *          configured bounds. Only a handful of values are kept, so each sample is O(1).
+ */
+class CalibrationLearner {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Allowed range of the learned calibration values.
+     */
+    struct Bounds {
+        int16_t wetMin;     /**< Lowest allowed wet calibration value */
+        int16_t wetMax;     /**< Highest allowed wet calibration value */
+        int16_t dryMin;     /**< Lowest allowed dry calibration value */
+        int16_t dryMax;     /**< Highest allowed dry calibration value */
+    };
+
+    /**
+     * @brief Constructor for CalibrationLearner.
+     * @param learningRate Fraction of the observed error applied per adjustment (0-1).
+     * @param peakWindow Time after irrigation in which the saturation peak is searched.
+     * @param floorPeriod Time over which the dry floor is collected.
+     * @param plateauTime Time the readings must stay within the plateau band to count as saturated.
+     * @param plateauBand Width of the plateau band as a fraction of the calibrated span.
+     * @param maxWetDrift Furthest the wet calibration may move from its set value, as a fraction of the span.
+     */
+    CalibrationLearner(double learningRate = 0.1,
+                       std::chrono::minutes peakWindow = std::chrono::minutes(30),
+                       std::chrono::hours floorPeriod = std::chrono::hours(24),
+                       std::chrono::minutes plateauTime = std::chrono::minutes(5),
+                       double plateauBand = 0.01,
+                       double maxWetDrift = 0.1);
+
+    /**
+     * @brief Enable learning within the given bounds.
+     * @param bounds Allowed range of the calibration values.
+     */
+    void enable(const Bounds& bounds);
+
+    /**
+     * @brief Disable learning and drop the collected extremes.
+     */
+    void disable();
+
+    /**
+     * @brief Check whether learning is enabled.
+     * @return True if enabled, false otherwise.
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Open the saturation peak window because the zone was irrigated.
+     * @param now Time of the irrigation.
+     */
+    void notifyIrrigation(Clock::time_point now);
+
+    /**
+     * @brief Add a raw sample and adjust the calibration values when a window or period closes.
+     * @param rawValue Raw ADC value.
+     * @param now Time of the sample.
+     * @param calWetValue Wet calibration value, updated in place.
+     * @param calDryValue Dry calibration value, updated in place.
+     * @return True if a calibration value was changed, false otherwise.
+     */
+    bool addSample(int16_t rawValue, Clock::time_point now, int16_t& calWetValue, int16_t& calDryValue);
+
+private:
+    double learningRate;                // Fraction of the error applied per adjustment
+    std::chrono::minutes peakWindow;    // Saturation peak search window
+    std::chrono::hours floorPeriod;     // Dry floor collection period
+    std::chrono::minutes plateauTime;   // Time a plateau must last
+    double plateauBand;                 // Plateau band as a fraction of the span
+    double maxWetDrift;                 // Wet drift limit as a fraction of the span
+    Bounds bounds;                      // Allowed calibration range
+    bool enabled;                       // Learning enabled
+
+    bool peakOpen;                      // Saturation peak window is open
+    bool hasPeak;                       // A plateau was seen in the window
+    int16_t peakValue;                  // Most saturated plateau reading in the window
+    Clock::time_point peakWindowEnd;    // End of the saturation peak window
+
+    bool inRun;                         // A run of readings within the plateau band is being followed
+    int16_t runStartValue;              // First reading of the run, the band is centred on it
+    int16_t runPeak;                    // Most saturated reading of the run
+    Clock::time_point runStart;         // Time of the first reading of the run
+
+    bool hasSetWet;                     // The set wet calibration value is known
+    int16_t setWetValue;                // Wet calibration value as set by the user
+    int16_t learnedWetValue;            // Wet calibration value after the last adjustment
+
+    bool floorStarted;                  // The dry floor period has started
+    bool hasFloor;                      // A floor sample was seen in the period
+    int16_t floorValue;                 // Driest reading in the period
+    Clock::time_point floorPeriodEnd;   // End of the dry floor period
+
+    /**
+     * @brief Move a calibration value towards a target within bounds.
+     * @param value Current calibration value.
+     * @param target Observed value.
+     * @param min Lowest allowed value.
+     * @param max Highest allowed value.
+     * @return Adjusted calibration value.
+     */
+    int16_t nudge(int16_t value, int16_t target, int16_t min, int16_t max) const;
+
+    /**
+     * @brief Check whether a reading is more saturated than another.
+     * @param value Reading to check.
+     * @param other Reading to compare with.
+     * @param wetIsLower The sensor reads lower when wet.
+     * @return True if value is wetter than other, false otherwise.
+     */
+    static bool isWetter(int16_t value, int16_t other, bool wetIsLower);
+};
+
+#endif // CALIBRATIONLEARNER_H
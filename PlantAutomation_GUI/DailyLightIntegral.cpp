@@ -0,0 +1,177 @@
+#include "DailyLightIntegral.h"
+
+/**
+ * @file DailyLightIntegral.cpp
+ *
+ * @brief Implementation of the DailyLightIntegral class.
+ */
+
+/**
+ * @brief Constructor for DailyLightIntegral, with the fixture off.
+ * @param ppfd Photosynthetic photon flux density at full output in µmol/m²/s.
+ */
+DailyLightIntegral::DailyLightIntegral(double ppfd) : ppfd(ppfd), level(0.0), historyHead(0), historyLength(0) {
+    lastUpdate = time(nullptr);
+    dayEnd = nextMidnight(lastUpdate);
+
+    today = DayTotal();
+    struct tm local;
+    localtime_r(&lastUpdate, &local);
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    today.dayStart = mktime(&local);
+
+    history.fill(DayTotal());
+}
+
+/**
+ * @brief Set the PPFD of the fixture at full output, used for the DLI from now on.
+ * @param ppfd Photosynthetic photon flux density in µmol/m²/s.
+ */
+void DailyLightIntegral::setPpfd(double ppfd) {
+    // Keep the dose received so far at the old PPFD
+    advance(time(nullptr));
+    this->ppfd = ppfd > 0.0 ? ppfd : 0.0;
+}
+
+/**
+ * @brief Get the PPFD of the fixture at full output.
+ * @return Photosynthetic photon flux density in µmol/m²/s.
+ */
+double DailyLightIntegral::getPpfd() const {
+    return ppfd;
+}
+
+/**
+ * @brief Record a change of the output level.
+ * @param level New level between 0 (off) and 1 (full output).
+ * @param now Time of the change.
+ */
+void DailyLightIntegral::setLevel(double level, time_t now) {
+    advance(now);
+    this->level = level < 0.0 ? 0.0 : (level > 1.0 ? 1.0 : level);
+}
+
+/**
+ * @brief Account the time up to now without a level change, closing the days that ended.
+ * @param now Current time.
+ */
+void DailyLightIntegral::advance(time_t now) {
+    // Close the days that ended since the last update, usually none
+    while (now >= dayEnd) {
+        accumulate(dayEnd);
+        closeDay();
+    }
+
+    accumulate(now);
+}
+
+/**
+ * @brief Get the totals of the running day up to the last change or advance.
+ * @return Totals of the running day.
+ */
+DailyLightIntegral::DayTotal DailyLightIntegral::getToday() const {
+    return today;
+}
+
+/**
+ * @brief Get the number of closed days in memory.
+ * @return Closed days, at most HISTORY_DAYS.
+ */
+size_t DailyLightIntegral::getHistoryLength() const {
+    return historyLength;
+}
+
+/**
+ * @brief Get the totals of a closed day.
+ * @param daysAgo 1 for yesterday, up to getHistoryLength().
+ * @return Totals of the day, all zero if it is not in memory.
+ */
+DailyLightIntegral::DayTotal DailyLightIntegral::getDay(size_t daysAgo) const {
+    if (daysAgo == 0 || daysAgo > historyLength) {
+        return DayTotal();
+    }
+
+    return history[(historyHead + HISTORY_DAYS - (daysAgo - 1)) % HISTORY_DAYS];
+}
+
+/**
+ * @brief Get the time the running day ends.
+ * @return Next local midnight.
+ */
+time_t DailyLightIntegral::getDayEnd() const {
+    return dayEnd;
+}
+
+/**
+ * @brief Compute how long the fixture has to stay on to reach a DLI today.
+ * @param targetDli Daily light integral to reach in mol/m².
+ * @param level Output level the fixture runs at.
+ * @return Seconds still needed, 0 if the target is reached, -1 if it can't be reached at this level.
+ */
+double DailyLightIntegral::secondsToReach(double targetDli, double level) const {
+    if (today.dli >= targetDli) {
+        return 0.0;
+    }
+
+    double rate = ppfd * level / 1e6;
+    if (rate <= 0.0) {
+        return -1.0;
+    }
+
+    return (targetDli - today.dli) / rate;
+}
+
+/**
+ * @brief Add the time up to a point to the running day at the current level.
+ * @param until End of the interval, not after dayEnd.
+ */
+void DailyLightIntegral::accumulate(time_t until) {
+    if (until <= lastUpdate) {
+        return;
+    }
+
+    double seconds = difftime(until, lastUpdate);
+    if (level > 0.0) {
+        today.onSeconds += seconds;
+        today.lightSeconds += seconds * level;
+        today.dli += seconds * level * ppfd / 1e6;
+    }
+
+    lastUpdate = until;
+}
+
+/**
+ * @brief Move the running day into the history and start the next one.
+ */
+void DailyLightIntegral::closeDay() {
+    if (historyLength > 0) {
+        historyHead = (historyHead + 1) % HISTORY_DAYS;
+    }
+    history[historyHead] = today;
+    if (historyLength < HISTORY_DAYS) {
+        historyLength++;
+    }
+
+    today = DayTotal();
+    today.dayStart = dayEnd;
+    dayEnd = nextMidnight(dayEnd);
+}
+
+/**
+ * @brief Find the local midnight after a time.
+ * @param time Time in the day.
+ * @return Next local midnight.
+ */
+time_t DailyLightIntegral::nextMidnight(time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    local.tm_mday += 1;
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
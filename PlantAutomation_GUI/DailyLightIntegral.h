@@ -0,0 +1,123 @@
+#ifndef DAILYLIGHTINTEGRAL_H
+#define DAILYLIGHTINTEGRAL_H
+
+#include <array>
+#include <cstddef>
+#include <ctime>
+
+/**
+ * @brief The DailyLightIntegral class accumulates the light dose of a fixture per local day.
+ * @details The fixture reports every change of its output level. The time since the previous change is added to
+ *          the running day, weighted by the level, so a transition costs O(1) and the totals are always available
+ *          in memory. Multiplied with the fixture's PPFD at full output the weighted time gives the daily light
+ *          integral (DLI) in mol/m²/day. Days end at local midnight and the last closed days are kept in a ring.
+ */
+class DailyLightIntegral {
+public:
+    static const size_t HISTORY_DAYS = 7;   // Closed days kept in memory
+
+    /**
+     * @struct DayTotal
+     * @brief Light received during one local day.
+     */
+    struct DayTotal {
+        time_t dayStart;        // Local midnight the day started at
+        double onSeconds;       // Time the fixture was on at any level
+        double lightSeconds;    // On-time weighted by the level, equal to full-output seconds
+        double dli;             // Daily light integral in mol/m²
+    };
+
+    /**
+     * @brief Constructor for DailyLightIntegral, with the fixture off.
+     * @param ppfd Photosynthetic photon flux density at full output in µmol/m²/s.
+     */
+    DailyLightIntegral(double ppfd = 0.0);
+
+    /**
+     * @brief Set the PPFD of the fixture at full output, used for the DLI from now on.
+     * @param ppfd Photosynthetic photon flux density in µmol/m²/s.
+     */
+    void setPpfd(double ppfd);
+
+    /**
+     * @brief Get the PPFD of the fixture at full output.
+     * @return Photosynthetic photon flux density in µmol/m²/s.
+     */
+    double getPpfd() const;
+
+    /**
+     * @brief Record a change of the output level.
+     * @param level New level between 0 (off) and 1 (full output).
+     * @param now Time of the change.
+     */
+    void setLevel(double level, time_t now);
+
+    /**
+     * @brief Account the time up to now without a level change, closing the days that ended.
+     * @param now Current time.
+     */
+    void advance(time_t now);
+
+    /**
+     * @brief Get the totals of the running day up to the last change or advance.
+     * @return Totals of the running day.
+     */
+    DayTotal getToday() const;
+
+    /**
+     * @brief Get the number of closed days in memory.
+     * @return Closed days, at most HISTORY_DAYS.
+     */
+    size_t getHistoryLength() const;
+
+    /**
+     * @brief Get the totals of a closed day.
+     * @param daysAgo 1 for yesterday, up to getHistoryLength().
+     * @return Totals of the day, all zero if it is not in memory.
+     */
+    DayTotal getDay(size_t daysAgo) const;
+
+    /**
+     * @brief Get the time the running day ends.
+     * @return Next local midnight.
+     */
+    time_t getDayEnd() const;
+
+    /**
+     * @brief Compute how long the fixture has to stay on to reach a DLI today.
+     * @param targetDli Daily light integral to reach in mol/m².
+     * @param level Output level the fixture runs at.
+     * @return Seconds still needed, 0 if the target is reached, -1 if it can't be reached at this level.
+     */
+    double secondsToReach(double targetDli, double level) const;
+
+private:
+    double ppfd;                                    // PPFD at full output in µmol/m²/s
+    double level;                                   // Current output level
+    time_t lastUpdate;                              // Time the running day was accounted up to
+    time_t dayEnd;                                  // Local midnight ending the running day
+    DayTotal today;                                 // Running day
+    std::array<DayTotal, HISTORY_DAYS> history;     // Closed days, ring buffer
+    size_t historyHead;                             // Index of the latest closed day
+    size_t historyLength;                           // Closed days in the ring
+
+    /**
+     * @brief Add the time up to a point to the running day at the current level.
+     * @param until End of the interval, not after dayEnd.
+     */
+    void accumulate(time_t until);
+
+    /**
+     * @brief Move the running day into the history and start the next one.
+     */
+    void closeDay();
+
+    /**
+     * @brief Find the local midnight after a time.
+     * @param time Time in the day.
+     * @return Next local midnight.
+     */
+    static time_t nextMidnight(time_t time);
+};
+
+#endif // DAILYLIGHTINTEGRAL_H
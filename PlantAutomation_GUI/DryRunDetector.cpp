@@ -0,0 +1,113 @@
+#include "DryRunDetector.h"
+
+/**
+ * @file DryRunDetector.cpp
+ *
+ * @brief Implementation of the DryRunDetector class.
+ */
+
+/**
+ * @brief Constructor for DryRunDetector.
+ * @param responseWindow Time after an activation in which the moisture has to rise.
+ * @param minRise Moisture rise in percent that counts as a response.
+ * @param maxMissed Consecutive activations without a response before the pump is considered faulty.
+ */
+DryRunDetector::DryRunDetector(std::chrono::seconds responseWindow, double minRise, int maxMissed) {
+    setParameters(responseWindow, minRise, maxMissed);
+    reset();
+}
+
+/**
+ * @brief Set the detection parameters.
+ * @param responseWindow Time after an activation in which the moisture has to rise.
+ * @param minRise Moisture rise in percent that counts as a response.
+ * @param maxMissed Consecutive activations without a response before the pump is considered faulty.
+ */
+void DryRunDetector::setParameters(std::chrono::seconds responseWindow, double minRise, int maxMissed) {
+    this->responseWindow = responseWindow;
+    this->minRise = minRise;
+    this->maxMissed = maxMissed > 0 ? maxMissed : 1;
+}
+
+/**
+ * @brief Open a response window for a pump activation.
+ * @param moisture Zone moisture at the activation.
+ * @param now Time of the activation.
+ */
+void DryRunDetector::notifyActivation(double moisture, Clock::time_point now) {
+    if (!windowOpen) {
+        windowOpen = true;
+        baseline = moisture;
+    }
+
+    // Give the water of the latest pulse the full window to arrive
+    deadline = now + responseWindow;
+}
+
+/**
+ * @brief Add a moisture sample of the zone.
+ * @param moisture Zone moisture level.
+ * @param now Time of the sample.
+ * @return True if this sample put the detector into the fault state, false otherwise.
+ */
+bool DryRunDetector::addSample(double moisture, Clock::time_point now) {
+    if (!windowOpen) {
+        return false;
+    }
+
+    // The water arrived, the pump works
+    if (moisture - baseline >= minRise) {
+        windowOpen = false;
+        missed = 0;
+        return false;
+    }
+
+    if (now < deadline) {
+        return false;
+    }
+
+    // The window closed without a rise
+    windowOpen = false;
+    missed++;
+
+    if (!faulted && missed >= maxMissed) {
+        faulted = true;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Drop the open response window without counting it, e.g. while the sensor is faulty.
+ */
+void DryRunDetector::discardWindow() {
+    windowOpen = false;
+}
+
+/**
+ * @brief Clear the missed activations and the fault state.
+ */
+void DryRunDetector::reset() {
+    windowOpen = false;
+    baseline = 0.0;
+    deadline = Clock::time_point();
+    missed = 0;
+    faulted = false;
+}
+
+/**
+ * @brief Check whether the pump has been found running dry.
+ * @return True if the number of consecutive misses reached the limit, false otherwise.
+ */
+bool DryRunDetector::isFaulted() const {
+    return faulted;
+}
+
+/**
+ * @brief Get the number of consecutive activations without a response.
+ * @return Missed activations.
+ */
+int DryRunDetector::getMissedActivations() const {
+    return missed;
+}
@@ -0,0 +1,84 @@
+#ifndef DRYRUNDETECTOR_H
+#define DRYRUNDETECTOR_H
+
+#include <chrono>
+
+/**
+ * @brief The DryRunDetector class detects a pump that runs without delivering water.
+ * @details Every activation opens a response window with the zone's moisture at the start as baseline. The
+ *          activation counts as answered once the moisture rises by the minimum rise inside the window and as
+ *          missed when the window closes without it. An empty reservoir or a clogged line misses every time,
+ *          so the detector reports a fault after a number of consecutive misses. Every sample is O(1).
+ */
+class DryRunDetector {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructor for DryRunDetector.
+     * @param responseWindow Time after an activation in which the moisture has to rise.
+     * @param minRise Moisture rise in percent that counts as a response.
+     * @param maxMissed Consecutive activations without a response before the pump is considered faulty.
+     */
+    DryRunDetector(std::chrono::seconds responseWindow = std::chrono::minutes(15), double minRise = 1.0,
+                   int maxMissed = 3);
+
+    /**
+     * @brief Set the detection parameters.
+     * @param responseWindow Time after an activation in which the moisture has to rise.
+     * @param minRise Moisture rise in percent that counts as a response.
+     * @param maxMissed Consecutive activations without a response before the pump is considered faulty.
+     */
+    void setParameters(std::chrono::seconds responseWindow, double minRise, int maxMissed);
+
+    /**
+     * @brief Open a response window for a pump activation.
+     * @details A window that is still open keeps its baseline, so back-to-back pulses count as one activation.
+     * @param moisture Zone moisture at the activation.
+     * @param now Time of the activation.
+     */
+    void notifyActivation(double moisture, Clock::time_point now);
+
+    /**
+     * @brief Add a moisture sample of the zone.
+     * @param moisture Zone moisture level.
+     * @param now Time of the sample.
+     * @return True if this sample put the detector into the fault state, false otherwise.
+     */
+    bool addSample(double moisture, Clock::time_point now);
+
+    /**
+     * @brief Drop the open response window without counting it, e.g. while the sensor is faulty.
+     */
+    void discardWindow();
+
+    /**
+     * @brief Clear the missed activations and the fault state.
+     */
+    void reset();
+
+    /**
+     * @brief Check whether the pump has been found running dry.
+     * @return True if the number of consecutive misses reached the limit, false otherwise.
+     */
+    bool isFaulted() const;
+
+    /**
+     * @brief Get the number of consecutive activations without a response.
+     * @return Missed activations.
+     */
+    int getMissedActivations() const;
+
+private:
+    std::chrono::seconds responseWindow;    // Time in which the moisture has to rise
+    double minRise;                         // Rise in percent that counts as a response
+    int maxMissed;                          // Consecutive misses before the fault
+
+    bool windowOpen;                        // An activation waits for its response
+    double baseline;                        // Moisture at the activation
+    Clock::time_point deadline;             // End of the response window
+    int missed;                             // Consecutive activations without a response
+    bool faulted;                           // The miss limit was reached
+};
+
+#endif // DRYRUNDETECTOR_H
@@ -0,0 +1,92 @@
+#ifndef GPIOCHIPPOOL_H
+#define GPIOCHIPPOOL_H
+
+#include <gpiod.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The GpioChipPool class shares one open GPIO chip per device path across the whole process.
+ * @details Every component takes its lines from the pool instead of opening the chip itself, so the number of
+ *          chip file descriptors and the cost of opening the chip stay constant however many actuators there are.
+ *          Chips are reference counted, opened on the first acquire and closed when the last user releases them.
+ *          Line handles belong to their chip, so a line handed out keeps its chip open until it is released.
+ *          Errors throw std::runtime_error.
+ */
+class GpioChipPool {
+public:
+    static constexpr const char* DEFAULT_CHIP = "/dev/gpiochip0";  // GPIO header of the Raspberry Pi
+
+    /**
+     * @brief Get the process-wide chip pool.
+     * @return The chip pool.
+     */
+    static GpioChipPool& instance();
+
+    /**
+     * @brief Destructor for GpioChipPool, closes the chips still open.
+     */
+    ~GpioChipPool();
+
+    GpioChipPool(const GpioChipPool&) = delete;
+    GpioChipPool& operator=(const GpioChipPool&) = delete;
+
+    /**
+     * @brief Take a reference to a chip, opening it if no one uses it yet.
+     * @param path Device path of the chip.
+     * @return The chip.
+     */
+    gpiod_chip* acquire(const std::string& path = DEFAULT_CHIP);
+
+    /**
+     * @brief Drop a reference to a chip, closing it when it was the last one.
+     * @param chip Chip returned by acquire().
+     */
+    void release(gpiod_chip* chip);
+
+    /**
+     * @brief Get a line handle, holding a reference to its chip.
+     * @details The line is not requested, the caller requests it with the direction it needs.
+     * @param pin Line offset on the chip.
+     * @param path Device path of the chip.
+     * @return The line.
+     */
+    gpiod_line* acquireLine(int pin, const std::string& path = DEFAULT_CHIP);
+
+    /**
+     * @brief Release a line handle, freeing its request if it is still held and dropping the chip reference.
+     * @param line Line returned by acquireLine(), nullptr is ignored.
+     */
+    void releaseLine(gpiod_line* line);
+
+    /**
+     * @brief Get the number of chips currently open.
+     * @return Open chips.
+     */
+    size_t getOpenChips() const;
+
+    /**
+     * @brief Get the number of references held on all chips.
+     * @return References to chips and lines.
+     */
+    size_t getReferences() const;
+
+private:
+    struct Chip {
+        std::string path;       // Device path
+        gpiod_chip* chip;       // Open chip
+        size_t references;      // Users of the chip and its lines
+    };
+
+    mutable std::mutex poolMutex;   // Protects the chip list
+    std::vector<Chip> chips;        // Open chips, a handful at most
+
+    /**
+     * @brief Constructor for GpioChipPool, without open chips.
+     */
+    GpioChipPool() = default;
+};
+
+#endif // GPIOCHIPPOOL_H
@@ -1,4 +1,19 @@
 #include "LightController.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <fstream>
+
+/**
+ * @brief Get the time of day of a time in seconds after local midnight.
+ * @param time Time to convert.
+ * @return Seconds after midnight.
+ */
+static long secondsOfDay(time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    return LightSchedule::timeOfDay(local.tm_hour, local.tm_min, local.tm_sec);
+}
 
 /**
  * @brief Constructor for LightController.
@@ -13,21 +28,9 @@ LightController::LightController(int pin, const time_t& dailyOn, const time_t& d
     // Set daily on and off times
     dailyOnTime = dailyOn;
     dailyOffTime = dailyOff;
+    setDailySegment();
 
-    // Set light status
-    on = false;
-
-    // Open GPIO chip
-    chip = gpiod_chip_open("/dev/gpiochip0");
-
-    // Request GPIO line
-    line = gpiod_chip_get_line(chip, pinNum);
-
-    // Set GPIO line direction to output
-    gpiod_line_request_output(line, "LightController", 0);
-
-    // Turn off light
-    gpiod_line_set_value(line, 0);
+    init();
 }
 
 /**
@@ -38,68 +41,75 @@ LightController::LightController(int pin) {
     // Set GPIO pin number
     pinNum = pin;
 
-    // Set light status
-    on = false;
+    // No schedule until the daily times are set
+    dailyOnTime = 0;
+    dailyOffTime = 0;
+
+    init();
+}
 
-    // Open GPIO chip
-    chip = gpiod_chip_open("/dev/gpiochip0");
+/**
+ * @brief Destructor for LightController.
+ */
+LightController::~LightController() {
+    stopSchedule();
+    setDliHistoryFile("");
 
-    // Request GPIO line
-    line = gpiod_chip_get_line(chip, pinNum);
+    // A timer that already fired may still be waiting for the lock
+    TimerService::instance().cancelAll(this);
 
-    // Set GPIO line direction to output
-    gpiod_line_request_output(line, "LightController", 0);
+    if (pwmChannel != 0) {
+        PwmEngine::instance().removeChannel(pwmChannel);
+    }
 
-    // Turn off light
-    gpiod_line_set_value(line, 0);
+    // Free GPIO pin
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
 }
 
 /**
- * @brief Destructor for LightController.
+ * @brief Open the GPIO line with the light off.
  */
-LightController::~LightController() {
-    // Close GPIO chip
-    gpiod_chip_close(chip);
+void LightController::init() {
+    // Make sure the chip pool, the timer service and the PWM engine outlive the light
+    GpioChipPool::instance();
+    TimerService::instance();
+    PwmEngine::instance();
+
+    // Set light status
+    on = false;
+
+    // Set GPIO pin direction to output, light off
+    output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "LightController", false);
 
-    // Free GPIO line
-    gpiod_line_release(line);
+    // Transitions and midnight are wall-clock times, the timers have to follow a clock step
+    TimerService::instance().addClockListener([this]() {
+        onClockChange();
+    }, this);
 }
 
 /**
  * @brief Turn on light.
  */
 void LightController::turnOn() {
-    // Turn on light
-    gpiod_line_set_value(line, 1);
-
-    // Set light status
-    on = true;
+    std::lock_guard<std::mutex> lock(lightMutex);
+    setLine(true);
 }
 
 /**
  * @brief Turn off light.
  */
 void LightController::turnOff() {
-    // Turn off light
-    gpiod_line_set_value(line, 0);
-
-    // Set light status
-    on = false;
+    std::lock_guard<std::mutex> lock(lightMutex);
+    setLine(false);
 }
 
 /**
  * @brief Toggle light status.
  */
 void LightController::toggle() {
-    // Toggle light status
-    if (on) {
-        turnOff();
-    } else {
-        turnOn();
-    }
-
-    // Set light status
-    on = !on;
+    std::lock_guard<std::mutex> lock(lightMutex);
+    setLine(!on);
 }
 
 /**
@@ -107,6 +117,7 @@ void LightController::toggle() {
  * @return True if the light is on, false otherwise.
  */
 bool LightController::isOn() {
+    std::lock_guard<std::mutex> lock(lightMutex);
     return on;
 }
 
@@ -115,7 +126,30 @@ bool LightController::isOn() {
  * @param time Time to turn on light after activation.
  */
 void LightController::setDailyOn(const time_t time) {
-    dailyOnTime = time;
+    bool switched = false;
+    bool state = false;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        dailyOnTime = time;
+
+        // A custom schedule stays until it is cleared
+        if (customSchedule) {
+            return;
+        }
+        setDailySegment();
+
+        // The next transition moved
+        if (scheduleEnabled) {
+            switched = applySchedule();
+            state = on;
+            listener = transitionListener;
+        }
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
 }
 
 /**
@@ -123,7 +157,30 @@ void LightController::setDailyOn(const time_t time) {
  * @param time Time to turn off light after activation.
  */
 void LightController::setDailyOff(const time_t time) {
-    dailyOffTime = time;
+    bool switched = false;
+    bool state = false;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        dailyOffTime = time;
+
+        // A custom schedule stays until it is cleared
+        if (customSchedule) {
+            return;
+        }
+        setDailySegment();
+
+        // The next transition moved
+        if (scheduleEnabled) {
+            switched = applySchedule();
+            state = on;
+            listener = transitionListener;
+        }
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
 }
 
 /**
@@ -131,6 +188,7 @@ void LightController::setDailyOff(const time_t time) {
  * @return Time to turn on light.
  */
 time_t LightController::getDailyOnTime() {
+    std::lock_guard<std::mutex> lock(lightMutex);
     return dailyOnTime;
 }
 
@@ -139,5 +197,553 @@ time_t LightController::getDailyOnTime() {
  * @return Time to turn off light.
  */
 time_t LightController::getDailyOffTime() {
+    std::lock_guard<std::mutex> lock(lightMutex);
     return dailyOffTime;
 }
+
+/**
+ * @brief Replace the schedule, e.g. with several segments or weekday overrides.
+ * @param schedule New schedule, empty for the daily on and off times.
+ */
+void LightController::setSchedule(const LightSchedule& schedule) {
+    bool switched = false;
+    bool state = false;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        customSchedule = !schedule.empty();
+        if (customSchedule) {
+            this->schedule = schedule;
+        } else {
+            setDailySegment();
+        }
+
+        // The next transition moved
+        if (scheduleEnabled) {
+            switched = applySchedule();
+            state = on;
+            listener = transitionListener;
+        }
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
+}
+
+/**
+ * @brief Get a copy of the schedule.
+ * @return The schedule.
+ */
+LightSchedule LightController::getSchedule() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    return schedule;
+}
+
+/**
+ * @brief Follow the daily schedule: switch the light to its scheduled state and wait for the next transition.
+ */
+void LightController::startSchedule() {
+    bool switched;
+    bool state;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        scheduleEnabled = true;
+        switched = applySchedule();
+        state = on;
+        listener = transitionListener;
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
+}
+
+/**
+ * @brief Stop following the daily schedule, the light keeps its state.
+ */
+void LightController::stopSchedule() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    scheduleEnabled = false;
+    nextTransition = 0;
+    scheduleGeneration++;
+
+    if (scheduleTimer != 0) {
+        TimerService::instance().cancel(scheduleTimer);
+        scheduleTimer = 0;
+    }
+}
+
+/**
+ * @brief Check whether the light follows the daily schedule.
+ * @return True if the schedule runs, false otherwise.
+ */
+bool LightController::isScheduleEnabled() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    return scheduleEnabled;
+}
+
+/**
+ * @brief Get the time of the next scheduled transition.
+ * @return Time of the next transition, 0 if the schedule is stopped or never changes the light.
+ */
+time_t LightController::getNextTransitionTime() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    return nextTransition;
+}
+
+/**
+ * @brief Set a function called after the schedule switched the light.
+ * @param listener Called with the new light state, nullptr to remove it.
+ */
+void LightController::setTransitionListener(TransitionListener listener) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    transitionListener = std::move(listener);
+}
+
+/**
+ * @brief Drive the light with PWM from the shared PWM engine.
+ * @param frequencyHz PWM frequency.
+ */
+void LightController::enableDimming(double frequencyHz) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    if (pwmChannel != 0) {
+        PwmEngine::instance().setFrequency(pwmChannel, frequencyHz);
+        return;
+    }
+
+    // The engine requests the line together with the other PWM lines, this also leaves an output group
+    {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        output.reset();
+        try {
+            pwmChannel = PwmEngine::instance().addChannel(pinNum, frequencyHz);
+        } catch (...) {
+            // Stay in on/off mode with the line as it was
+            output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "LightController", on);
+            throw;
+        }
+    }
+
+    // Keep the light as it was
+    if (on) {
+        PwmEngine::instance().setDuty(pwmChannel, dimLevel);
+        lightIntegral.setLevel(dimLevel, time(nullptr));
+    }
+}
+
+/**
+ * @brief Switch the light back to plain on/off control.
+ */
+void LightController::disableDimming() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    if (pwmChannel == 0) {
+        return;
+    }
+
+    PwmEngine::instance().removeChannel(pwmChannel);
+    pwmChannel = 0;
+
+    // Take the line back as a plain output
+    {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "LightController", on);
+    }
+    if (on) {
+        lightIntegral.setLevel(1.0, time(nullptr));
+    }
+}
+
+/**
+ * @brief Check whether the light is dimmed with PWM.
+ * @return True if dimming mode is enabled, false otherwise.
+ */
+bool LightController::isDimmingEnabled() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    return pwmChannel != 0;
+}
+
+/**
+ * @brief Set the brightness of the light when on in dimming mode, applied with the ramp if the light is on.
+ * @param level Duty cycle between 0 and 1.
+ */
+void LightController::setDimLevel(double level) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    dimLevel = level < 0.0 ? 0.0 : (level > 1.0 ? 1.0 : level);
+    if (pwmChannel != 0 && on) {
+        PwmEngine::instance().setDuty(pwmChannel, dimLevel, ramp, rampCurve);
+        lightIntegral.setLevel(dimLevel, time(nullptr));
+    }
+}
+
+/**
+ * @brief Get the brightness of the light when on in dimming mode.
+ * @return Duty cycle between 0 and 1.
+ */
+double LightController::getDimLevel() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    return dimLevel;
+}
+
+/**
+ * @brief Set the sunrise/sunset ramp used when the light switches in dimming mode.
+ * @param ramp Time to reach the new brightness, 0 to switch at once.
+ * @param curve Shape of the ramp.
+ */
+void LightController::setRamp(std::chrono::milliseconds ramp, PwmEngine::RampCurve curve) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    this->ramp = ramp;
+    rampCurve = curve;
+}
+
+/**
+ * @brief Drive the line, or ramp the PWM channel in dimming mode, and remember the state.
+ * @param state True for on, false for off.
+ */
+void LightController::setLine(bool state) {
+    if (pwmChannel != 0) {
+        PwmEngine::instance().setDuty(pwmChannel, state ? dimLevel : 0.0, ramp, rampCurve);
+    } else {
+        output->write(state);
+    }
+    on = state;
+
+    // Ramps are accounted as a step at the switch
+    lightIntegral.setLevel(state ? onLevel() : 0.0, time(nullptr));
+}
+
+/**
+ * @brief Get the output level the light runs at when on.
+ * @return Dim level in dimming mode, 1 otherwise.
+ */
+double LightController::onLevel() {
+    return pwmChannel != 0 ? dimLevel : 1.0;
+}
+
+/**
+ * @brief Rebuild the schedule as one daily segment from the daily on and off times.
+ */
+void LightController::setDailySegment() {
+    schedule.clear();
+    schedule.addSegment(secondsOfDay(dailyOnTime), secondsOfDay(dailyOffTime));
+}
+
+/**
+ * @brief Switch the light to its scheduled state and arm the timer for the next transition.
+ * @return True if the light was switched, false if it already was in the scheduled state.
+ */
+bool LightController::applySchedule() {
+    scheduleGeneration++;
+    if (scheduleTimer != 0) {
+        TimerService::instance().cancel(scheduleTimer);
+        scheduleTimer = 0;
+    }
+
+    time_t now = time(nullptr);
+    bool desired = schedule.isOn(now);
+    nextTransition = schedule.nextTransition(now);
+
+    // Move the end of the photoperiod to hit the target light integral
+    if (targetDli > 0.0) {
+        lightIntegral.advance(now);
+        double needed = lightIntegral.secondsToReach(targetDli, onLevel());
+        time_t maxAdjust = static_cast<time_t>(maxDliAdjust.count());
+
+        if (desired && nextTransition != 0) {
+            extensionEnd = nextTransition + maxAdjust;
+
+            // Cut the photoperiod once the target is reached
+            if (needed >= 0.0 && now + needed < nextTransition) {
+                time_t off = std::max(now + static_cast<time_t>(needed), nextTransition - maxAdjust);
+                if (off <= now) {
+                    desired = false;
+                } else {
+                    nextTransition = off;
+                }
+            }
+        } else if (!desired && now < extensionEnd && needed > 0.0) {
+            // Stretch the photoperiod past its scheduled end until the target is reached
+            desired = true;
+            time_t until = std::min(now + static_cast<time_t>(needed) + 1, extensionEnd);
+            nextTransition = nextTransition != 0 ? std::min(nextTransition, until) : until;
+        }
+    }
+
+    bool switched = desired != on;
+    if (switched) {
+        setLine(desired);
+    }
+
+    if (nextTransition == 0) {
+        return switched;
+    }
+
+    // Sleep until the transition, onClockChange() re-arms the timer when the clock is stepped
+    std::chrono::system_clock::duration delay =
+        std::chrono::system_clock::from_time_t(nextTransition) - std::chrono::system_clock::now();
+    if (delay < std::chrono::system_clock::duration::zero()) {
+        delay = std::chrono::system_clock::duration::zero();
+    }
+
+    uint64_t generation = scheduleGeneration;
+    scheduleTimer = TimerService::instance().scheduleAfter(delay, [this, generation]() {
+        onTransition(generation);
+    }, this);
+
+    return switched;
+}
+
+/**
+ * @brief Clock listener: re-arm the wall-clock timers after the clock was set.
+ */
+void LightController::onClockChange() {
+    bool switched = false;
+    bool state;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+
+        if (dayTimer != 0) {
+            TimerService::instance().cancel(dayTimer);
+            scheduleDayEnd();
+        }
+
+        // Switch to the state of the new time and wait for the next transition from there
+        if (scheduleEnabled) {
+            switched = applySchedule();
+        }
+        state = on;
+        listener = transitionListener;
+    }
+
+    logger.logEvent("INFO", "LightController", "Wall clock changed, light schedule re-applied");
+
+    if (switched && listener) {
+        listener(state);
+    }
+}
+
+/**
+ * @brief Timer callback: apply the schedule unless the timer went stale.
+ * @param generation Generation the timer was scheduled in.
+ */
+void LightController::onTransition(uint64_t generation) {
+    bool switched;
+    bool state;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        if (generation != scheduleGeneration) {
+            return;
+        }
+
+        scheduleTimer = 0;
+        switched = applySchedule();
+        state = on;
+        listener = transitionListener;
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
+}
+
+/**
+ * @brief Write the light line through an output group instead of on its own.
+ * @param group Output group, must outlive the light or the membership.
+ * @return True if the light joined, false if it is dimmed or already is in a group.
+ */
+bool LightController::joinOutputGroup(OutputGroup& group) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    if (pwmChannel != 0 || output->getGroup() != nullptr) {
+        return false;
+    }
+
+    // The group requests the line together with its other outputs, keeping the light as it is
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
+    output = std::make_unique<DigitalPin>(group, pinNum, on);
+
+    return true;
+}
+
+/**
+ * @brief Take the light line back from its output group as a plain output.
+ */
+void LightController::leaveOutputGroup() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    if (pwmChannel != 0 || output->getGroup() == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
+    output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "LightController", on);
+}
+
+/**
+ * @brief Get the output group the light line is written through.
+ * @return The group, nullptr if the line is written on its own.
+ */
+OutputGroup* LightController::getOutputGroup() const {
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    return output ? output->getGroup() : nullptr;
+}
+
+/**
+ * @brief Get the id of the light's output in its output group.
+ * @return Id of the output, 0 without a group.
+ */
+OutputGroup::OutputId LightController::getOutputId() const {
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    return output ? output->getGroupOutput() : 0;
+}
+
+/**
+ * @brief Set the PPFD of the fixture at full output for the daily light integral.
+ * @param ppfd Photosynthetic photon flux density at the canopy in µmol/m²/s.
+ */
+void LightController::setPpfd(double ppfd) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+    lightIntegral.setPpfd(ppfd);
+}
+
+/**
+ * @brief Stretch or cut the scheduled photoperiod to reach a daily light integral.
+ * @param targetDli Daily light integral in mol/m², 0 to follow the schedule as is.
+ * @param maxAdjust Largest change of the scheduled off time.
+ */
+void LightController::setTargetDli(double targetDli, std::chrono::seconds maxAdjust) {
+    bool switched = false;
+    bool state = false;
+    TransitionListener listener;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        this->targetDli = targetDli > 0.0 ? targetDli : 0.0;
+        maxDliAdjust = maxAdjust;
+        extensionEnd = 0;
+
+        // The end of the photoperiod moved
+        if (scheduleEnabled) {
+            switched = applySchedule();
+            state = on;
+            listener = transitionListener;
+        }
+    }
+
+    if (switched && listener) {
+        listener(state);
+    }
+}
+
+/**
+ * @brief Append the totals of every finished day to a CSV file.
+ * @param path Path of the file, empty to stop writing.
+ */
+void LightController::setDliHistoryFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    dliHistoryPath = path;
+
+    if (dayTimer != 0) {
+        TimerService::instance().cancel(dayTimer);
+        dayTimer = 0;
+    }
+
+    if (!path.empty()) {
+        // Days closed before the file was set are not written
+        lastPersistedDay = lightIntegral.getToday().dayStart - 1;
+        scheduleDayEnd();
+    }
+}
+
+/**
+ * @brief Get the light received so far today.
+ * @return Totals of the running day.
+ */
+DailyLightIntegral::DayTotal LightController::getDliToday() {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    lightIntegral.advance(time(nullptr));
+    return lightIntegral.getToday();
+}
+
+/**
+ * @brief Get the light received on a previous day.
+ * @param daysAgo 1 for yesterday, up to DailyLightIntegral::HISTORY_DAYS.
+ * @return Totals of the day, all zero if it is not in memory.
+ */
+DailyLightIntegral::DayTotal LightController::getDliDay(size_t daysAgo) {
+    std::lock_guard<std::mutex> lock(lightMutex);
+
+    lightIntegral.advance(time(nullptr));
+    return lightIntegral.getDay(daysAgo);
+}
+
+/**
+ * @brief Arm the timer that closes the day at the next local midnight.
+ */
+void LightController::scheduleDayEnd() {
+    std::chrono::system_clock::duration delay =
+        std::chrono::system_clock::from_time_t(lightIntegral.getDayEnd()) - std::chrono::system_clock::now();
+    if (delay < std::chrono::system_clock::duration::zero()) {
+        delay = std::chrono::system_clock::duration::zero();
+    }
+
+    dayTimer = TimerService::instance().scheduleAfter(delay, [this]() {
+        onDayEnd();
+    }, this);
+}
+
+/**
+ * @brief Timer callback: close the day and append the finished days to the history file.
+ */
+void LightController::onDayEnd() {
+    std::string path;
+    std::vector<DailyLightIntegral::DayTotal> days;
+    {
+        std::lock_guard<std::mutex> lock(lightMutex);
+        if (dayTimer == 0) {
+            return;
+        }
+
+        lightIntegral.advance(time(nullptr));
+
+        // Oldest first, a day may have been closed by a switch before the timer fired
+        for (size_t daysAgo = lightIntegral.getHistoryLength(); daysAgo > 0; daysAgo--) {
+            DailyLightIntegral::DayTotal day = lightIntegral.getDay(daysAgo);
+            if (day.dayStart > lastPersistedDay) {
+                days.push_back(day);
+                lastPersistedDay = day.dayStart;
+            }
+        }
+
+        path = dliHistoryPath;
+        scheduleDayEnd();
+    }
+
+    // Write without the lock, the SD card may be slow
+    std::ofstream file(path, std::ios::app);
+    for (const DailyLightIntegral::DayTotal& day : days) {
+        struct tm local;
+        localtime_r(&day.dayStart, &local);
+        char date[16];
+        std::strftime(date, sizeof(date), "%Y-%m-%d", &local);
+
+        file << date << "," << day.onSeconds / 3600.0 << "," << day.lightSeconds / 3600.0 << "," << day.dli << "\n";
+    }
+    file.flush();
+
+    if (!file) {
+        logger.logEvent("WARN", "LightController", "Couldn't write the light integral of light " +
+                                                   std::to_string(pinNum) + " to " + path);
+    }
+}
@@ -2,12 +2,34 @@
 #ifndef LIGHTCONTROLLER_H
 #define LIGHTCONTROLLER_H
 
+#include "DailyLightIntegral.h"
+#include "DigitalPin.h"
+#include "LightSchedule.h"
+#include "PwmEngine.h"
+#include "TimerService.h"
+
 #include <gpiod.h>
 #include <ctime>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
 
+/**
+ * @brief The LightController class switches a light on a recurring schedule.
+ * @details The schedule is a LightSchedule, by default one daily segment between the times of day of the daily on
+ *          and off times. While the schedule runs, the controller computes the next transition and registers a
+ *          single TimerService deadline for it, so the light costs no work between transitions. Each wakeup
+ *          switches the light and rolls the schedule forward to the following transition, across midnight and
+ *          daylight saving changes. In dimming mode the line is driven by the shared PwmEngine instead, the light
+ *          runs at its dim level when on and every switch ramps along a sunrise/sunset curve. Every switch also
+ *          updates the fixture's daily light integral, which can stretch or cut the photoperiod to hit a target.
+ */
 class LightController {
 public:
+    using TransitionListener = std::function<void(bool)>;
+
     /**
      * @brief Constructor for LightController.
      * @param pin GPIO pin number.
@@ -50,12 +72,14 @@ public:
 
     /**
      * @brief Set the time to turn on the light after activation.
+     * @details While a custom schedule is set the time is only stored and used once the schedule is cleared.
      * @param time Time to turn on the light.
      */
     void setDailyOn(const time_t time);
 
     /**
      * @brief Set the time to turn off the light after activation.
+     * @details While a custom schedule is set the time is only stored and used once the schedule is cleared.
      * @param time Time to turn off the light.
      */
     void setDailyOff(const time_t time);
@@ -72,6 +96,148 @@ public:
      */
     time_t getDailyOffTime();
 
+    /**
+     * @brief Replace the schedule, e.g. with several segments or weekday overrides.
+     * @details The daily on and off times are kept but not used while the schedule is set, an empty schedule
+     *          goes back to the daily on and off times.
+     * @param schedule New schedule, empty for the daily on and off times.
+     */
+    void setSchedule(const LightSchedule& schedule);
+
+    /**
+     * @brief Get a copy of the schedule.
+     * @return The schedule.
+     */
+    LightSchedule getSchedule();
+
+    /**
+     * @brief Follow the daily schedule: switch the light to its scheduled state and wait for the next transition.
+     */
+    void startSchedule();
+
+    /**
+     * @brief Stop following the daily schedule, the light keeps its state.
+     */
+    void stopSchedule();
+
+    /**
+     * @brief Check whether the light follows the daily schedule.
+     * @return True if the schedule runs, false otherwise.
+     */
+    bool isScheduleEnabled();
+
+    /**
+     * @brief Get the time of the next scheduled transition.
+     * @return Time of the next transition, 0 if the schedule is stopped or never changes the light.
+     */
+    time_t getNextTransitionTime();
+
+    /**
+     * @brief Set a function called after the schedule switched the light.
+     * @details Called on the timer thread without the light locked.
+     * @param listener Called with the new light state, nullptr to remove it.
+     */
+    void setTransitionListener(TransitionListener listener);
+
+    /**
+     * @brief Drive the light with PWM from the shared PWM engine.
+     * @details Only for dimmable drivers, a relay must stay in on/off mode. If the PWM line can't be set up the
+     *          light stays in on/off mode and std::runtime_error is thrown.
+     * @param frequencyHz PWM frequency.
+     */
+    void enableDimming(double frequencyHz);
+
+    /**
+     * @brief Switch the light back to plain on/off control.
+     */
+    void disableDimming();
+
+    /**
+     * @brief Check whether the light is dimmed with PWM.
+     * @return True if dimming mode is enabled, false otherwise.
+     */
+    bool isDimmingEnabled();
+
+    /**
+     * @brief Set the brightness of the light when on in dimming mode, applied with the ramp if the light is on.
+     * @param level Duty cycle between 0 and 1.
+     */
+    void setDimLevel(double level);
+
+    /**
+     * @brief Get the brightness of the light when on in dimming mode.
+     * @return Duty cycle between 0 and 1.
+     */
+    double getDimLevel();
+
+    /**
+     * @brief Set the sunrise/sunset ramp used when the light switches in dimming mode.
+     * @param ramp Time to reach the new brightness, 0 to switch at once.
+     * @param curve Shape of the ramp.
+     */
+    void setRamp(std::chrono::milliseconds ramp, PwmEngine::RampCurve curve = PwmEngine::RampCurve::PERCEPTUAL);
+
+    /**
+     * @brief Write the light line through an output group instead of on its own.
+     * @details The group requests the line together with its other outputs. Enabling dimming leaves the group.
+     * @param group Output group, must outlive the light or the membership.
+     * @return True if the light joined, false if it is dimmed or already is in a group.
+     */
+    bool joinOutputGroup(OutputGroup& group);
+
+    /**
+     * @brief Take the light line back from its output group as a plain output.
+     */
+    void leaveOutputGroup();
+
+    /**
+     * @brief Get the output group the light line is written through.
+     * @details Read without the light lock, for the watchdog.
+     * @return The group, nullptr if the line is written on its own.
+     */
+    OutputGroup* getOutputGroup() const;
+
+    /**
+     * @brief Get the id of the light's output in its output group.
+     * @return Id of the output, 0 without a group.
+     */
+    OutputGroup::OutputId getOutputId() const;
+
+    /**
+     * @brief Set the PPFD of the fixture at full output for the daily light integral.
+     * @param ppfd Photosynthetic photon flux density at the canopy in µmol/m²/s.
+     */
+    void setPpfd(double ppfd);
+
+    /**
+     * @brief Stretch or cut the scheduled photoperiod to reach a daily light integral.
+     * @details The light switches off early once the target is reached and stays on past the scheduled off time
+     *          until it is reached, by at most the maximum adjustment either way. Needs the PPFD.
+     * @param targetDli Daily light integral in mol/m², 0 to follow the schedule as is.
+     * @param maxAdjust Largest change of the scheduled off time.
+     */
+    void setTargetDli(double targetDli, std::chrono::seconds maxAdjust);
+
+    /**
+     * @brief Append the totals of every finished day to a CSV file.
+     * @details A timer closes the day at local midnight, even while the light is off.
+     * @param path Path of the file, empty to stop writing.
+     */
+    void setDliHistoryFile(const std::string& path);
+
+    /**
+     * @brief Get the light received so far today.
+     * @return Totals of the running day.
+     */
+    DailyLightIntegral::DayTotal getDliToday();
+
+    /**
+     * @brief Get the light received on a previous day.
+     * @param daysAgo 1 for yesterday, up to DailyLightIntegral::HISTORY_DAYS.
+     * @return Totals of the day, all zero if it is not in memory.
+     */
+    DailyLightIntegral::DayTotal getDliDay(size_t daysAgo);
+
     /**
      * @brief Overloaded operator for debugging.
      * @param os Output stream.
@@ -81,12 +247,87 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const LightController& lc);
 
 private:
-    gpiod_chip *chip;       // GPIO chip
-    gpiod_line *line;       // GPIO line
+    std::unique_ptr<DigitalPin> output;     // Light line, nullptr while the PWM engine drives it
     int pinNum;             // GPIO pin number
     bool on;                // Light status
     time_t dailyOnTime;     // Time to turn on light after activation
     time_t dailyOffTime;    // Time to turn off light after activation
+
+    std::mutex lightMutex;                      // Guards the light state against the timer thread
+    mutable std::mutex outputMutex;             // Guards replacing output against the watchdog
+    LightSchedule schedule;                     // When the light is on
+    bool scheduleEnabled = false;               // The light follows the daily schedule
+    bool customSchedule = false;                // setSchedule() replaced the daily on/off segment
+    time_t nextTransition = 0;                  // Time of the next scheduled transition, 0 for none
+    TimerService::TimerId scheduleTimer = 0;    // Timer of the next transition
+    uint64_t scheduleGeneration = 0;            // Incremented on every reschedule to ignore stale timers
+    TransitionListener transitionListener;      // Told about scheduled switches
+    PwmEngine::ChannelId pwmChannel = 0;        // PWM engine channel in dimming mode, 0 for on/off control
+    double dimLevel = 1.0;                      // Duty cycle when on in dimming mode
+    std::chrono::milliseconds ramp{0};          // Ramp of a switch in dimming mode
+    PwmEngine::RampCurve rampCurve = PwmEngine::RampCurve::PERCEPTUAL;  // Shape of the ramp
+    DailyLightIntegral lightIntegral;           // Light received per day
+    double targetDli = 0.0;                     // Daily light integral to reach, 0 for none
+    std::chrono::seconds maxDliAdjust{0};       // Largest change of the scheduled off time
+    time_t extensionEnd = 0;                    // Latest end of a photoperiod stretched past its scheduled off
+    std::string dliHistoryPath;                 // CSV file of the finished days, empty for none
+    TimerService::TimerId dayTimer = 0;         // Timer closing the day at midnight
+    time_t lastPersistedDay = 0;                // Start of the last day written to the history file
+
+    /**
+     * @brief Open the GPIO line with the light off.
+     */
+    void init();
+
+    /**
+     * @brief Drive the line, or ramp the PWM channel in dimming mode, and remember the state.
+     * @details Must be called with lightMutex held.
+     * @param state True for on, false for off.
+     */
+    void setLine(bool state);
+
+    /**
+     * @brief Rebuild the schedule as one daily segment from the daily on and off times.
+     * @details Must be called with lightMutex held.
+     */
+    void setDailySegment();
+
+    /**
+     * @brief Switch the light to its scheduled state and arm the timer for the next transition.
+     * @details Must be called with lightMutex held.
+     * @return True if the light was switched, false if it already was in the scheduled state.
+     */
+    bool applySchedule();
+
+    /**
+     * @brief Get the output level the light runs at when on.
+     * @details Must be called with lightMutex held.
+     * @return Dim level in dimming mode, 1 otherwise.
+     */
+    double onLevel();
+
+    /**
+     * @brief Arm the timer that closes the day at the next local midnight.
+     * @details Must be called with lightMutex held.
+     */
+    void scheduleDayEnd();
+
+    /**
+     * @brief Timer callback: close the day and append the finished days to the history file.
+     */
+    void onDayEnd();
+
+    /**
+     * @brief Timer callback: apply the schedule unless the timer went stale.
+     * @param generation Generation the timer was scheduled in.
+     */
+    void onTransition(uint64_t generation);
+
+    /**
+     * @brief Clock listener: re-arm the wall-clock timers after the clock was set.
+     * @details The timers sleep on the monotonic clock, so a clock step would leave them early or late.
+     */
+    void onClockChange();
 };
 
 #endif // LIGHTCONTROLLER_H
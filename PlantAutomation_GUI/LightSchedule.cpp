@@ -0,0 +1,439 @@
+#include "LightSchedule.h"
+
+#include <algorithm>
+
+/**
+ * @file LightSchedule.cpp
+ *
+ * @brief Implementation of the LightSchedule class.
+ */
+
+/**
+ * @brief Get the local UTC offset of a time from the C library.
+ * @param time Time to look up.
+ * @return Local time minus UTC in seconds.
+ */
+static long localOffset(time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    return local.tm_gmtoff;
+}
+
+/**
+ * @brief Divide rounding towards negative infinity.
+ * @param value Dividend.
+ * @param divisor Positive divisor.
+ * @return Quotient.
+ */
+static long long floorDiv(long long value, long long divisor) {
+    long long quotient = value / divisor;
+    return (value % divisor < 0) ? quotient - 1 : quotient;
+}
+
+/**
+ * @brief Get the day of the week of a local day number.
+ * @param day Local days since the epoch.
+ * @return Day of the week, 0 for Sunday.
+ */
+static int weekdayOf(long long day) {
+    // The epoch was a Thursday
+    return static_cast<int>(day + 4 - floorDiv(day + 4, 7) * 7);
+}
+
+/**
+ * @brief Constructor for LightSchedule, without segments.
+ */
+LightSchedule::LightSchedule() : resolvedDay(-1), offsetsBegin(0), offsetsEnd(0) {
+    overridden.fill(false);
+}
+
+/**
+ * @brief Get a time of day in seconds after midnight.
+ * @param hour Hour, 0 to 24.
+ * @param minute Minute.
+ * @param second Second.
+ * @return Seconds after midnight.
+ */
+long LightSchedule::timeOfDay(int hour, int minute, int second) {
+    return hour * 3600L + minute * 60L + second;
+}
+
+/**
+ * @brief Add a segment to every day without a weekday override.
+ * @param start Time of day the light turns on, in seconds after midnight.
+ * @param end Time of day the light turns off, in seconds after midnight.
+ */
+void LightSchedule::addSegment(long start, long end) {
+    resolvedDay = -1;
+
+    start = std::min(std::max(start, 0L), DAY);
+    end = std::min(std::max(end, 0L), DAY);
+
+    if (start < end) {
+        insert(daily, start, end);
+    } else if (start > end) {
+        insert(daily, start, DAY);
+        insert(daily, 0, end);
+    }
+}
+
+/**
+ * @brief Add a segment to a weekday, overriding the daily segments on that weekday.
+ * @param weekday Day of the week, 0 for Sunday.
+ * @param start Time of day the light turns on, in seconds after midnight.
+ * @param end Time of day the light turns off, in seconds after midnight.
+ */
+void LightSchedule::addSegment(int weekday, long start, long end) {
+    resolvedDay = -1;
+
+    if (weekday < 0 || weekday > 6) {
+        return;
+    }
+
+    overridden[weekday] = true;
+
+    start = std::min(std::max(start, 0L), DAY);
+    end = std::min(std::max(end, 0L), DAY);
+
+    if (start < end) {
+        insert(weekdays[weekday], start, end);
+    } else if (start > end) {
+        insert(weekdays[weekday], start, DAY);
+        insert(weekdays[weekday], 0, end);
+    }
+}
+
+/**
+ * @brief Set the location used for the solar segments.
+ * @param latitude Latitude in degrees, north positive.
+ * @param longitude Longitude in degrees, east positive.
+ */
+void LightSchedule::setLocation(double latitude, double longitude) {
+    sun.setLocation(latitude, longitude);
+    resolvedDay = -1;
+}
+
+/**
+ * @brief Add a segment relative to the sunrise or sunset to every day without a weekday override.
+ * @param anchor Sunrise or sunset.
+ * @param offset Start relative to the anchor in seconds, negative for before it.
+ * @param duration Length of the segment in seconds.
+ */
+void LightSchedule::addSolarSegment(Anchor anchor, long offset, long duration) {
+    if (duration <= 0) {
+        return;
+    }
+
+    solar.push_back({anchor, offset, std::min(duration, DAY)});
+    resolvedDay = -1;
+}
+
+/**
+ * @brief Keep a weekday dark, overriding the daily segments on that weekday.
+ * @param weekday Day of the week, 0 for Sunday.
+ */
+void LightSchedule::setDayOff(int weekday) {
+    if (weekday < 0 || weekday > 6) {
+        return;
+    }
+
+    overridden[weekday] = true;
+    weekdays[weekday].clear();
+    resolvedDay = -1;
+}
+
+/**
+ * @brief Remove the override of a weekday, it follows the daily segments again.
+ * @param weekday Day of the week, 0 for Sunday.
+ */
+void LightSchedule::clearWeekday(int weekday) {
+    if (weekday < 0 || weekday > 6) {
+        return;
+    }
+
+    overridden[weekday] = false;
+    weekdays[weekday].clear();
+    resolvedDay = -1;
+}
+
+/**
+ * @brief Remove all segments and overrides.
+ */
+void LightSchedule::clear() {
+    daily.clear();
+    solar.clear();
+    resolvedDay = -1;
+    for (int weekday = 0; weekday < 7; weekday++) {
+        clearWeekday(weekday);
+    }
+}
+
+/**
+ * @brief Check whether the schedule has no segment on any day.
+ * @return True if the light is never on, false otherwise.
+ */
+bool LightSchedule::empty() const {
+    if (!solar.empty() && std::find(overridden.begin(), overridden.end(), false) != overridden.end()) {
+        return false;
+    }
+
+    for (int weekday = 0; weekday < 7; weekday++) {
+        if (!segmentsOf(weekday).empty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check whether the light is scheduled on at a time.
+ * @param time Time to check.
+ * @return True if the light is on, false otherwise.
+ */
+bool LightSchedule::isOn(time_t time) {
+    long long local = static_cast<long long>(time) + utcOffset(time);
+    long long day = floorDiv(local, DAY);
+
+    return covers(segmentsOn(day), static_cast<long>(local - day * DAY));
+}
+
+/**
+ * @brief Find the next time the scheduled state changes.
+ * @param time Time to search from.
+ * @return First time after the given one with a different state, 0 if the state never changes.
+ */
+time_t LightSchedule::nextTransition(time_t time) {
+    if (empty()) {
+        return 0;
+    }
+
+    bool state = isOn(time);
+
+    // Walk the boundaries, a week and a day covers every weekday pattern
+    time_t current = time;
+    while (current < time + 8 * DAY) {
+        long long local = static_cast<long long>(current) + utcOffset(current);
+        long long day = floorDiv(local, DAY);
+        long boundary = nextBoundary(segmentsOn(day), static_cast<long>(local - day * DAY));
+        time_t candidate = toTime(day * DAY + boundary, current);
+        if (candidate <= current) {
+            candidate = current + 1;
+        }
+
+        // Midnight between two joined segments changes nothing
+        if (isOn(candidate) != state) {
+            return candidate;
+        }
+
+        current = candidate;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Insert a segment into a day, merging it with the segments it touches.
+ * @param day Segments of the day.
+ * @param start Start in seconds after midnight.
+ * @param end End in seconds after midnight, after the start.
+ */
+void LightSchedule::insert(Day& day, long start, long end) {
+    Day merged;
+    merged.reserve(day.size() + 1);
+
+    bool placed = false;
+    for (const Segment& segment : day) {
+        if (segment.end < start) {
+            merged.push_back(segment);
+        } else if (segment.start > end) {
+            if (!placed) {
+                merged.push_back({start, end});
+                placed = true;
+            }
+            merged.push_back(segment);
+        } else {
+            // Overlapping or touching, absorb it
+            start = std::min(start, segment.start);
+            end = std::max(end, segment.end);
+        }
+    }
+
+    if (!placed) {
+        merged.push_back({start, end});
+    }
+
+    day.swap(merged);
+}
+
+/**
+ * @brief Get the segments of a day of the week.
+ * @param weekday Day of the week, 0 for Sunday.
+ * @return Segments of the day.
+ */
+const LightSchedule::Day& LightSchedule::segmentsOf(int weekday) const {
+    return overridden[weekday] ? weekdays[weekday] : daily;
+}
+
+/**
+ * @brief Get the segments of a local day, with the solar segments resolved for that day.
+ * @param day Local days since the epoch.
+ * @return Segments of the day.
+ */
+const LightSchedule::Day& LightSchedule::segmentsOn(long long day) {
+    int weekday = weekdayOf(day);
+    if (solar.empty() || overridden[weekday]) {
+        return segmentsOf(weekday);
+    }
+
+    if (day == resolvedDay) {
+        return resolved;
+    }
+
+    // Resolve the sun-relative segments once per day
+    resolved = daily;
+    time_t noon = toTime(day * DAY + DAY / 2, static_cast<time_t>(day * DAY));
+    SolarCalculator::SunTimes times = sun.getSunTimes(noon);
+
+    if (times.sunrise != 0) {
+        for (const SolarSegment& segment : solar) {
+            time_t anchor = segment.anchor == Anchor::SUNRISE ? times.sunrise : times.sunset;
+            long long anchorLocal = static_cast<long long>(anchor) + utcOffset(anchor);
+            long start = static_cast<long>(anchorLocal - day * DAY + segment.offset);
+            long end = start + segment.duration;
+
+            // Wrap into the day like a daily segment past midnight
+            start = static_cast<long>(start - floorDiv(start, DAY) * DAY);
+            end = static_cast<long>(end - floorDiv(end, DAY) * DAY);
+            if (start < end) {
+                insert(resolved, start, end);
+            } else {
+                insert(resolved, start, DAY);
+                insert(resolved, 0, end);
+            }
+        }
+    }
+
+    resolvedDay = day;
+    return resolved;
+}
+
+/**
+ * @brief Check whether a time of day lies inside a segment.
+ * @param day Segments of the day.
+ * @param second Seconds after midnight.
+ * @return True if a segment covers the time, false otherwise.
+ */
+bool LightSchedule::covers(const Day& day, long second) {
+    // Last segment starting at or before the time
+    Day::const_iterator after = std::upper_bound(day.begin(), day.end(), second,
+                                                 [](long value, const Segment& segment) {
+        return value < segment.start;
+    });
+
+    return after != day.begin() && second < (after - 1)->end;
+}
+
+/**
+ * @brief Find the first segment boundary after a time of day.
+ * @param day Segments of the day.
+ * @param second Seconds after midnight.
+ * @return Seconds after midnight of the boundary, DAY if there is none before midnight.
+ */
+long LightSchedule::nextBoundary(const Day& day, long second) {
+    Day::const_iterator after = std::upper_bound(day.begin(), day.end(), second,
+                                                 [](long value, const Segment& segment) {
+        return value < segment.start;
+    });
+
+    // Inside the previous segment its end comes first
+    if (after != day.begin() && second < (after - 1)->end) {
+        return (after - 1)->end;
+    }
+
+    return after != day.end() ? after->start : DAY;
+}
+
+/**
+ * @brief Get the local UTC offset at a time from the cached table.
+ * @param time Time to look up.
+ * @return Local time minus UTC in seconds.
+ */
+long LightSchedule::utcOffset(time_t time) {
+    if (offsets.empty() || time < offsetsBegin || time >= offsetsEnd) {
+        buildOffsets(time);
+    }
+
+    std::vector<Offset>::const_iterator after = std::upper_bound(offsets.begin(), offsets.end(), time,
+                                                                 [](time_t value, const Offset& entry) {
+        return value < entry.from;
+    });
+
+    return (after - 1)->offset;
+}
+
+/**
+ * @brief Rebuild the offset table for about a year around a time.
+ * @param time Time the table has to cover.
+ */
+void LightSchedule::buildOffsets(time_t time) {
+    offsets.clear();
+
+    offsetsBegin = time - 30 * DAY;
+    offsetsEnd = time + 400 * DAY;
+
+    long previous = localOffset(offsetsBegin);
+    offsets.push_back({offsetsBegin, previous});
+
+    // Offsets change at most once a day, find the exact second of each change
+    for (time_t step = offsetsBegin + DAY; step < offsetsEnd + DAY; step += DAY) {
+        long offset = localOffset(step);
+        if (offset == previous) {
+            continue;
+        }
+
+        time_t low = step - DAY;
+        time_t high = step;
+        while (high - low > 1) {
+            time_t middle = low + (high - low) / 2;
+            if (localOffset(middle) == previous) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+
+        offsets.push_back({high, offset});
+        previous = offset;
+    }
+}
+
+/**
+ * @brief Convert a local wall-clock time to a time.
+ * @param local Local time in seconds since the epoch.
+ * @param after Time near the result.
+ * @return The time.
+ */
+time_t LightSchedule::toTime(long long local, time_t after) {
+    long offset = utcOffset(after);
+    time_t first = static_cast<time_t>(local - offset);
+    if (utcOffset(first) == offset) {
+        return first;
+    }
+
+    // An offset change lies in between
+    long changed = utcOffset(first);
+    time_t second = static_cast<time_t>(local - changed);
+    if (utcOffset(second) == changed) {
+        return second;
+    }
+
+    // The wall-clock time was skipped, the change itself is the closest time
+    time_t latest = std::max(first, second);
+    std::vector<Offset>::const_iterator change = std::upper_bound(offsets.begin(), offsets.end(), latest,
+                                                                  [](time_t value, const Offset& entry) {
+        return value < entry.from;
+    });
+
+    return (change - 1)->from;
+}
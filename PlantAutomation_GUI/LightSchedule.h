@@ -0,0 +1,210 @@
+#ifndef LIGHTSCHEDULE_H
+#define LIGHTSCHEDULE_H
+
+#include "SolarCalculator.h"
+
+#include <array>
+#include <ctime>
+#include <vector>
+
+/**
+ * @brief The LightSchedule class describes when a light is on as recurring wall-clock segments.
+ * @details Every day uses the daily segments unless its weekday has an override. Segments are kept sorted and
+ *          merged per day, so finding the state at a time or the next boundary is a binary search, O(log segments).
+ *          Wall-clock times are resolved through a cached table of the local UTC offsets, one entry per daylight
+ *          saving change, so a segment starts at the same wall-clock time on both sides of a change. The table is
+ *          rebuilt around a timestamp outside of it. Segments can also be anchored to the local sunrise or
+ *          sunset of each day; the segments of the day a lookup falls on are resolved once and reused until the
+ *          day changes. Not thread-safe, the owner serializes access.
+ */
+class LightSchedule {
+public:
+    static constexpr long DAY = 24 * 60 * 60;  // Seconds in a wall-clock day
+
+    /**
+     * @brief Event a solar segment is anchored to.
+     */
+    enum class Anchor {
+        SUNRISE,                // Local sunrise of the day
+        SUNSET                  // Local sunset of the day
+    };
+
+    /**
+     * @brief Constructor for LightSchedule, without segments.
+     */
+    LightSchedule();
+
+    /**
+     * @brief Get a time of day in seconds after midnight.
+     * @param hour Hour, 0 to 24.
+     * @param minute Minute.
+     * @param second Second.
+     * @return Seconds after midnight.
+     */
+    static long timeOfDay(int hour, int minute, int second = 0);
+
+    /**
+     * @brief Add a segment to every day without a weekday override.
+     * @details A segment ending before its start wraps past midnight.
+     * @param start Time of day the light turns on, in seconds after midnight.
+     * @param end Time of day the light turns off, in seconds after midnight.
+     */
+    void addSegment(long start, long end);
+
+    /**
+     * @brief Add a segment to a weekday, overriding the daily segments on that weekday.
+     * @details A segment ending before its start wraps past midnight within the weekday's pattern.
+     * @param weekday Day of the week, 0 for Sunday.
+     * @param start Time of day the light turns on, in seconds after midnight.
+     * @param end Time of day the light turns off, in seconds after midnight.
+     */
+    void addSegment(int weekday, long start, long end);
+
+    /**
+     * @brief Set the location used for the solar segments.
+     * @param latitude Latitude in degrees, north positive.
+     * @param longitude Longitude in degrees, east positive.
+     */
+    void setLocation(double latitude, double longitude);
+
+    /**
+     * @brief Add a segment relative to the sunrise or sunset to every day without a weekday override.
+     * @details E.g. SUNSET, -1 h, 4 h switches on an hour before sunset for four hours. The segment is skipped on
+     *          days the sun does not rise or set. Needs the location.
+     * @param anchor Sunrise or sunset.
+     * @param offset Start relative to the anchor in seconds, negative for before it.
+     * @param duration Length of the segment in seconds.
+     */
+    void addSolarSegment(Anchor anchor, long offset, long duration);
+
+    /**
+     * @brief Keep a weekday dark, overriding the daily segments on that weekday.
+     * @param weekday Day of the week, 0 for Sunday.
+     */
+    void setDayOff(int weekday);
+
+    /**
+     * @brief Remove the override of a weekday, it follows the daily segments again.
+     * @param weekday Day of the week, 0 for Sunday.
+     */
+    void clearWeekday(int weekday);
+
+    /**
+     * @brief Remove all segments and overrides.
+     */
+    void clear();
+
+    /**
+     * @brief Check whether the schedule has no segment on any day.
+     * @return True if the light is never on, false otherwise.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Check whether the light is scheduled on at a time.
+     * @param time Time to check.
+     * @return True if the light is on, false otherwise.
+     */
+    bool isOn(time_t time);
+
+    /**
+     * @brief Find the next time the scheduled state changes.
+     * @param time Time to search from.
+     * @return First time after the given one with a different state, 0 if the state never changes.
+     */
+    time_t nextTransition(time_t time);
+
+private:
+    struct Segment {
+        long start;                         // Seconds after midnight the light turns on
+        long end;                           // Seconds after midnight the light turns off
+    };
+
+    struct Offset {
+        time_t from;                        // First time the offset applies
+        long offset;                        // Local time minus UTC in seconds
+    };
+
+    struct SolarSegment {
+        Anchor anchor;                      // Sunrise or sunset
+        long offset;                        // Start relative to the anchor in seconds
+        long duration;                      // Length in seconds
+    };
+
+    using Day = std::vector<Segment>;
+
+    Day daily;                              // Segments of days without an override
+    std::vector<SolarSegment> solar;        // Sun-relative segments of days without an override
+    SolarCalculator sun;                    // Sunrise and sunset of the location
+    long long resolvedDay;                  // Local day the resolved segments belong to
+    Day resolved;                           // Daily and solar segments of the resolved day
+    std::array<Day, 7> weekdays;            // Segments of the overridden weekdays
+    std::array<bool, 7> overridden;         // The weekday uses its own segments
+
+    std::vector<Offset> offsets;            // Cached UTC offsets, sorted by time
+    time_t offsetsBegin;                    // First time covered by the cache
+    time_t offsetsEnd;                      // First time after the cache
+
+    /**
+     * @brief Insert a segment into a day, merging it with the segments it touches.
+     * @param day Segments of the day.
+     * @param start Start in seconds after midnight.
+     * @param end End in seconds after midnight, after the start.
+     */
+    static void insert(Day& day, long start, long end);
+
+    /**
+     * @brief Get the segments of a day of the week.
+     * @param weekday Day of the week, 0 for Sunday.
+     * @return Segments of the day.
+     */
+    const Day& segmentsOf(int weekday) const;
+
+    /**
+     * @brief Get the segments of a local day, with the solar segments resolved for that day.
+     * @param day Local days since the epoch.
+     * @return Segments of the day.
+     */
+    const Day& segmentsOn(long long day);
+
+    /**
+     * @brief Check whether a time of day lies inside a segment.
+     * @param day Segments of the day.
+     * @param second Seconds after midnight.
+     * @return True if a segment covers the time, false otherwise.
+     */
+    static bool covers(const Day& day, long second);
+
+    /**
+     * @brief Find the first segment boundary after a time of day.
+     * @param day Segments of the day.
+     * @param second Seconds after midnight.
+     * @return Seconds after midnight of the boundary, DAY if there is none before midnight.
+     */
+    static long nextBoundary(const Day& day, long second);
+
+    /**
+     * @brief Get the local UTC offset at a time from the cached table.
+     * @param time Time to look up.
+     * @return Local time minus UTC in seconds.
+     */
+    long utcOffset(time_t time);
+
+    /**
+     * @brief Rebuild the offset table for about a year around a time.
+     * @param time Time the table has to cover.
+     */
+    void buildOffsets(time_t time);
+
+    /**
+     * @brief Convert a local wall-clock time to a time.
+     * @details A wall-clock time repeated by a daylight saving change resolves to its first occurrence after the
+     *          given time, one skipped by a change resolves to the moment of the change.
+     * @param local Local time in seconds since the epoch.
+     * @param after Time near the result.
+     * @return The time.
+     */
+    time_t toTime(long long local, time_t after);
+};
+
+#endif // LIGHTSCHEDULE_H
@@ -16,11 +16,14 @@ Logger::Logger(const std::string& fileName) : file(fileName, std::ios::app) {}
  * @return The constructed log entry as a string.
  */
 std::string Logger::logEvent(const std::string& logLevel, const std::string& eventName, const std::string& details) {
+    std::lock_guard<std::mutex> lock(fileMutex);
+
     if (file.is_open()) {
 
         // Get the current time
         std::time_t currentTime = std::time(nullptr);
-        struct std::tm* timeInfo = std::localtime(&currentTime);
+        struct std::tm timeBuffer;
+        struct std::tm* timeInfo = localtime_r(&currentTime, &timeBuffer);
 
         // Format the log entry as a comma-separated value
         char buffer[80];
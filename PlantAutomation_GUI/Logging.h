@@ -4,6 +4,7 @@
 #include <fstream>
 #include <ctime>
 #include <iostream>
+#include <mutex>
 #include <string>
 
 #pragma once
@@ -35,6 +36,11 @@ private:
      * @brief The file stream used for logging.
      */
     std::ofstream file;
+
+    /**
+     * @brief Serializes log entries written from more than one thread.
+     */
+    std::mutex fileMutex;
 };
 
 extern Logger logger;
@@ -0,0 +1,173 @@
+#include "MoistureTrend.h"
+
+/**
+ * @file MoistureTrend.cpp
+ *
+ * @brief Implementation of the MoistureTrend class.
+ */
+
+/**
+ * @brief Constructor for MoistureTrend.
+ * @param capacity Number of samples kept for the fit.
+ * @param minSpacing Minimum time between stored samples, closer samples are ignored.
+ */
+MoistureTrend::MoistureTrend(size_t capacity, std::chrono::seconds minSpacing) :
+        samples(capacity > 2 ? capacity : 3),
+        minSpacing(minSpacing) {
+    reset();
+}
+
+/**
+ * @brief Add a moisture sample.
+ * @param moisture Moisture level in percent.
+ * @param time Time of the sample.
+ */
+void MoistureTrend::addSample(double moisture, Clock::time_point time) {
+    // Ignore samples that are closer together than the minimum spacing
+    if (count > 0) {
+        const Sample& newest = samples[(head + samples.size() - 1) % samples.size()];
+        if (time - newest.time < minSpacing) {
+            return;
+        }
+    } else {
+        origin = time;
+    }
+
+    // Remove the oldest sample from the sums once the ring is full
+    if (count == samples.size()) {
+        double t = toHours(samples[head].time);
+        double y = samples[head].moisture;
+        sumT -= t;
+        sumY -= y;
+        sumTT -= t * t;
+        sumTY -= t * y;
+    } else {
+        count++;
+    }
+
+    // Add the new sample to the ring and the sums
+    samples[head] = {time, moisture};
+    head = (head + 1) % samples.size();
+
+    double t = toHours(time);
+    sumT += t;
+    sumY += moisture;
+    sumTT += t * t;
+    sumTY += t * moisture;
+
+    // Move the origin forward once per revolution so the sums stay small
+    if (head == 0 && count == samples.size()) {
+        rebase();
+    }
+}
+
+/**
+ * @brief Drop all samples, e.g. after irrigation changed the soil state.
+ */
+void MoistureTrend::reset() {
+    head = 0;
+    count = 0;
+    sumT = 0.0;
+    sumY = 0.0;
+    sumTT = 0.0;
+    sumTY = 0.0;
+}
+
+/**
+ * @brief Check whether enough samples exist for an estimate.
+ * @return True if the slope is valid, false otherwise.
+ */
+bool MoistureTrend::isValid() const {
+    if (count < 3) {
+        return false;
+    }
+
+    double n = static_cast<double>(count);
+    return (n * sumTT - sumT * sumT) > 0.0;
+}
+
+/**
+ * @brief Get the fitted rate of change.
+ * @return Rate of change in percent per hour, 0 if no estimate exists.
+ */
+double MoistureTrend::getSlopePerHour() const {
+    if (!isValid()) {
+        return 0.0;
+    }
+
+    // Least-squares slope
+    double n = static_cast<double>(count);
+    return (n * sumTY - sumT * sumY) / (n * sumTT - sumT * sumT);
+}
+
+/**
+ * @brief Get the fitted moisture level at the newest sample.
+ * @return Smoothed moisture level in percent.
+ */
+double MoistureTrend::getCurrentEstimate() const {
+    if (count == 0) {
+        return 0.0;
+    }
+
+    const Sample& newest = samples[(head + samples.size() - 1) % samples.size()];
+    if (!isValid()) {
+        return newest.moisture;
+    }
+
+    // Evaluate the fitted line at the newest sample
+    double n = static_cast<double>(count);
+    double slope = getSlopePerHour();
+    double intercept = (sumY - slope * sumT) / n;
+
+    return intercept + slope * toHours(newest.time);
+}
+
+/**
+ * @brief Predict how long until the moisture drops to a threshold.
+ * @param threshold Moisture threshold in percent.
+ * @return Time until the threshold is reached, 0 if already below it, -1 if it is not falling.
+ */
+std::chrono::seconds MoistureTrend::getTimeToThreshold(double threshold) const {
+    double current = getCurrentEstimate();
+    if (count > 0 && current <= threshold) {
+        return std::chrono::seconds(0);
+    }
+
+    double slope = getSlopePerHour();
+    if (slope >= 0.0) {
+        return std::chrono::seconds(-1);
+    }
+
+    // Extrapolate the fitted line down to the threshold
+    double hours = (threshold - current) / slope;
+    return std::chrono::seconds(static_cast<long long>(hours * 3600.0));
+}
+
+/**
+ * @brief Convert a time point to hours since the origin.
+ * @param time Time point.
+ * @return Hours since the origin.
+ */
+double MoistureTrend::toHours(Clock::time_point time) const {
+    return std::chrono::duration<double, std::ratio<3600>>(time - origin).count();
+}
+
+/**
+ * @brief Rebuild the regression sums around the oldest sample.
+ */
+void MoistureTrend::rebase() {
+    origin = samples[head].time;
+
+    sumT = 0.0;
+    sumY = 0.0;
+    sumTT = 0.0;
+    sumTY = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double t = toHours(samples[i].time);
+        double y = samples[i].moisture;
+        sumT += t;
+        sumY += y;
+        sumTT += t * t;
+        sumTY += t * y;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef MOISTURETREND_H
+#define MOISTURETREND_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief The MoistureTrend class estimates the rate of change of soil moisture.
+ * @details Samples are kept in a ring buffer of timestamped values and a least-squares line is fitted
+ *          through them. The regression sums are updated as samples enter and leave the ring, so every
+ *          sample costs O(1); the sums are rebuilt around a new time origin each time the ring wraps to
+ *          keep the arithmetic well conditioned.
+ */
+class MoistureTrend {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructor for MoistureTrend.
+     * @param capacity Number of samples kept for the fit.
+     * @param minSpacing Minimum time between stored samples, closer samples are ignored.
+     */
+    MoistureTrend(size_t capacity = 60, std::chrono::seconds minSpacing = std::chrono::seconds(60));
+
+    /**
+     * @brief Add a moisture sample.
+     * @param moisture Moisture level in percent.
+     * @param time Time of the sample.
+     */
+    void addSample(double moisture, Clock::time_point time);
+
+    /**
+     * @brief Drop all samples, e.g. after irrigation changed the soil state.
+     */
+    void reset();
+
+    /**
+     * @brief Check whether enough samples exist for an estimate.
+     * @return True if the slope is valid, false otherwise.
+     */
+    bool isValid() const;
+
+    /**
+     * @brief Get the fitted rate of change.
+     * @return Rate of change in percent per hour, 0 if no estimate exists.
+     */
+    double getSlopePerHour() const;
+
+    /**
+     * @brief Get the fitted moisture level at the newest sample.
+     * @return Smoothed moisture level in percent.
+     */
+    double getCurrentEstimate() const;
+
+    /**
+     * @brief Predict how long until the moisture drops to a threshold.
+     * @param threshold Moisture threshold in percent.
+     * @return Time until the threshold is reached, 0 if already below it, -1 if it is not falling.
+     */
+    std::chrono::seconds getTimeToThreshold(double threshold) const;
+
+private:
+    struct Sample {
+        Clock::time_point time;     // Time of the sample
+        double moisture;            // Moisture level
+    };
+
+    std::vector<Sample> samples;    // Ring buffer of samples
+    size_t head;                    // Next write position
+    size_t count;                   // Number of valid samples
+    std::chrono::seconds minSpacing;// Minimum time between stored samples
+
+    Clock::time_point origin;       // Time origin of the regression sums
+    double sumT;                    // Sum of sample times (hours since origin)
+    double sumY;                    // Sum of moisture values
+    double sumTT;                   // Sum of squared times
+    double sumTY;                   // Sum of time * moisture
+
+    /**
+     * @brief Convert a time point to hours since the origin.
+     * @param time Time point.
+     * @return Hours since the origin.
+     */
+    double toHours(Clock::time_point time) const;
+
+    /**
+     * @brief Rebuild the regression sums around the oldest sample.
+     */
+    void rebase();
+};
+
+#endif // MOISTURETREND_H
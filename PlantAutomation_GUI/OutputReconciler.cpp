@@ -0,0 +1,51 @@
+#include "OutputReconciler.h"
+
+/**
+ * @file OutputReconciler.cpp
+ *
+ * @brief Implementation of the OutputReconciler class.
+ */
+
+/**
+ * @brief Constructor for OutputReconciler.
+ * @param readActual Returns the actual state of the output.
+ * @param write Drives the output to the given state and returns whether it changed.
+ */
+OutputReconciler::OutputReconciler(ReadAction readActual, WriteAction write)
+    : readActual(std::move(readActual)), write(std::move(write)), transitions(0), suppressed(0) {
+}
+
+/**
+ * @brief Bring the output to the desired state.
+ * @param desired True for on, false for off.
+ * @return True if the output changed, false if it already was in the desired state or the write was rejected.
+ */
+bool OutputReconciler::reconcile(bool desired) {
+    if (readActual() == desired) {
+        suppressed++;
+        return false;
+    }
+
+    if (!write(desired)) {
+        return false;
+    }
+
+    transitions++;
+    return true;
+}
+
+/**
+ * @brief Get the number of writes that changed the output.
+ * @return Transitions.
+ */
+uint64_t OutputReconciler::getTransitions() const {
+    return transitions;
+}
+
+/**
+ * @brief Get the number of requests that found the output already in the desired state.
+ * @return Suppressed no-op writes.
+ */
+uint64_t OutputReconciler::getSuppressed() const {
+    return suppressed;
+}
@@ -0,0 +1,53 @@
+#ifndef OUTPUTRECONCILER_H
+#define OUTPUTRECONCILER_H
+
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief The OutputReconciler class turns a level-triggered on/off request into edge-triggered writes.
+ * @details The control loop states the desired state of an output on every tick. The reconciler compares it with
+ *          the actual state read back from the actuator and only calls the write action when the two differ, so a
+ *          steady output costs no GPIO write and no log line. Reading the actual state instead of remembering the
+ *          last request picks up changes made elsewhere, e.g. a pump that stopped itself or a watchdog trip.
+ *          Requests that needed no write are counted as suppressed.
+ */
+class OutputReconciler {
+public:
+    using ReadAction = std::function<bool()>;
+    using WriteAction = std::function<bool(bool)>;
+
+    /**
+     * @brief Constructor for OutputReconciler.
+     * @param readActual Returns the actual state of the output.
+     * @param write Drives the output to the given state and returns whether it changed.
+     */
+    OutputReconciler(ReadAction readActual, WriteAction write);
+
+    /**
+     * @brief Bring the output to the desired state.
+     * @param desired True for on, false for off.
+     * @return True if the output changed, false if it already was in the desired state or the write was rejected.
+     */
+    bool reconcile(bool desired);
+
+    /**
+     * @brief Get the number of writes that changed the output.
+     * @return Transitions.
+     */
+    uint64_t getTransitions() const;
+
+    /**
+     * @brief Get the number of requests that found the output already in the desired state.
+     * @return Suppressed no-op writes.
+     */
+    uint64_t getSuppressed() const;
+
+private:
+    ReadAction readActual;      // Reads the actual state of the output
+    WriteAction write;          // Drives the output
+    uint64_t transitions;       // Writes that changed the output
+    uint64_t suppressed;        // Requests that needed no write
+};
+
+#endif // OUTPUTRECONCILER_H
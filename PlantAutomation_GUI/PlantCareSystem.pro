@@ -11,22 +11,58 @@ CONFIG += c++17
 LIBS += -lgpiod -lrt -lpthread
 
 SOURCES += \
+    ActuatorWatchdog.cpp \
     ADS1115.cpp \
+    AdaptiveSampler.cpp \
+    CalibrationLearner.cpp \
+    DailyLightIntegral.cpp \
+    DigitalPin.cpp \
+    DryRunDetector.cpp \
+    GpioChipPool.cpp \
     LightController.cpp \
+    LightSchedule.cpp \
     Logging.cpp \
+    MoistureTrend.cpp \
+    OutputGroup.cpp \
+    OutputReconciler.cpp \
+    PumpCounters.cpp \
+    PumpScheduler.cpp \
+    PwmEngine.cpp \
+    SensorGroup.cpp \
+    SoilHealthMonitor.cpp \
     SoilSensor.cpp \
+    SolarCalculator.cpp \
     SystemController.cpp \
     SystemDriver.cpp \
+    TimerService.cpp \
     WaterPump.cpp \
     main.cpp \
     plantcaresystemgui.cpp
 
 HEADERS += \
+    ActuatorWatchdog.h \
     ADS1115.h \
+    AdaptiveSampler.h \
+    CalibrationLearner.h \
+    DailyLightIntegral.h \
+    DigitalPin.h \
+    DryRunDetector.h \
+    GpioChipPool.h \
     LightController.h \
+    LightSchedule.h \
     Logging.h \
+    MoistureTrend.h \
+    OutputGroup.h \
+    OutputReconciler.h \
+    PumpCounters.h \
+    PumpScheduler.h \
+    PwmEngine.h \
+    SensorGroup.h \
+    SoilHealthMonitor.h \
     SoilSensor.h \
+    SolarCalculator.h \
     SystemController.h \
+    TimerService.h \
     WaterPump.h \
     plantcaresystemgui.h
 
@@ -0,0 +1,98 @@
+#include "PumpCounters.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @file PumpCounters.cpp
+ *
+ * @brief Implementation of the PumpCounters class.
+ */
+
+/**
+ * @brief Create a record with every counter at zero.
+ * @return Empty record.
+ */
+PumpCounters::Record PumpCounters::emptyRecord() {
+    Record record = {};
+    record.magic = MAGIC;
+    record.version = VERSION;
+    record.checksum = checksumOf(record);
+    return record;
+}
+
+/**
+ * @brief Read a counter file.
+ * @param path Path of the file.
+ * @param record Receives the counters.
+ * @return True if a valid record was read, false if the file is missing or damaged.
+ */
+bool PumpCounters::read(const std::string& path, Record& record) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    Record candidate;
+    ssize_t bytes = pread(fd, &candidate, sizeof(candidate), 0);
+    close(fd);
+
+    if (bytes != static_cast<ssize_t>(sizeof(candidate)) || candidate.magic != MAGIC ||
+        candidate.version != VERSION || candidate.checksum != checksumOf(candidate)) {
+        return false;
+    }
+
+    record = candidate;
+    return true;
+}
+
+/**
+ * @brief Write a counter file, replacing the previous one atomically.
+ * @param path Path of the file.
+ * @param record Counters to write.
+ * @return True if the file was written, false otherwise.
+ */
+bool PumpCounters::write(const std::string& path, const Record& record) {
+    Record stamped = record;
+    stamped.magic = MAGIC;
+    stamped.version = VERSION;
+    stamped.reserved = 0;
+    stamped.checksum = checksumOf(stamped);
+
+    // Write a temporary file and rename it over the old one, so readers never see a partial record
+    std::string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool written = ::write(fd, &stamped, sizeof(stamped)) == static_cast<ssize_t>(sizeof(stamped)) &&
+                   fsync(fd) == 0;
+    close(fd);
+
+    if (!written || rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Compute the checksum of a record.
+ * @param record Record to hash.
+ * @return FNV-1a hash of the fields before the checksum.
+ */
+uint32_t PumpCounters::checksumOf(const Record& record) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&record);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Record, checksum); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
@@ -0,0 +1,66 @@
+#ifndef PUMPCOUNTERS_H
+#define PUMPCOUNTERS_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief The PumpCounters class stores a pump's lifetime counters in a small fixed-layout binary file.
+ * @details The file holds exactly one Record, so a tool reads a pump's statistics with a single read of
+ *          sizeof(Record) bytes instead of scanning the event log. Files are replaced atomically and carry a
+ *          checksum, so a power cut during a checkpoint leaves the previous record intact.
+ */
+class PumpCounters {
+public:
+    static const uint32_t MAGIC = 0x544E4350;   // "PCNT" in little-endian byte order
+    static const uint32_t VERSION = 1;          // Layout version of Record
+
+    /**
+     * @struct Record
+     * @brief On-disk layout of the counters, native byte order.
+     */
+    struct Record {
+        uint32_t magic;             // MAGIC
+        uint32_t version;           // VERSION
+        uint64_t activations;       // Number of activations
+        uint64_t onTimeMs;          // Total on-time in milliseconds
+        int64_t lastActivation;     // Unix time of the last activation, 0 if never activated
+        double volumeMl;            // Estimated volume delivered in millilitres
+        uint32_t checksum;          // FNV-1a hash of the bytes before this field
+        uint32_t reserved;          // Zero
+    };
+
+    /**
+     * @brief Create a record with every counter at zero.
+     * @return Empty record.
+     */
+    static Record emptyRecord();
+
+    /**
+     * @brief Read a counter file.
+     * @param path Path of the file.
+     * @param record Receives the counters.
+     * @return True if a valid record was read, false if the file is missing or damaged.
+     */
+    static bool read(const std::string& path, Record& record);
+
+    /**
+     * @brief Write a counter file, replacing the previous one atomically.
+     * @param path Path of the file.
+     * @param record Counters to write.
+     * @return True if the file was written, false otherwise.
+     */
+    static bool write(const std::string& path, const Record& record);
+
+private:
+    /**
+     * @brief Compute the checksum of a record.
+     * @param record Record to hash.
+     * @return FNV-1a hash of the fields before the checksum.
+     */
+    static uint32_t checksumOf(const Record& record);
+};
+
+static_assert(sizeof(PumpCounters::Record) == 48, "PumpCounters::Record layout changed");
+
+#endif // PUMPCOUNTERS_H
@@ -0,0 +1,223 @@
+#include "PumpScheduler.h"
+
+/**
+ * @file PumpScheduler.cpp
+ *
+ * @brief Implementation of the PumpScheduler class.
+ */
+
+/**
+ * @brief Get the process-wide pump scheduler.
+ * @return The pump scheduler.
+ */
+PumpScheduler& PumpScheduler::instance() {
+    static PumpScheduler scheduler;
+    return scheduler;
+}
+
+/**
+ * @brief Constructor for PumpScheduler, without a budget limit.
+ */
+PumpScheduler::PumpScheduler() : nextId(1), maxCurrent(0.0), maxFlow(0.0), usedCurrent(0.0), usedFlow(0.0) {
+}
+
+/**
+ * @brief Set the budget shared by all running pumps.
+ * @param maxCurrentAmps Supply current available to the pumps, 0 for no limit.
+ * @param maxFlowMlPerSecond Water flow the supply line can deliver, 0 for no limit.
+ */
+void PumpScheduler::setBudget(double maxCurrentAmps, double maxFlowMlPerSecond) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+
+    maxCurrent = maxCurrentAmps > 0.0 ? maxCurrentAmps : 0.0;
+    maxFlow = maxFlowMlPerSecond > 0.0 ? maxFlowMlPerSecond : 0.0;
+
+    // A larger budget may let waiting requests in
+    admit();
+}
+
+/**
+ * @brief Queue a run of a pump.
+ * @param pump Pump to run, charged with its rated current and flow rate while running.
+ * @param priority Higher priorities are admitted first.
+ * @param deadline Requests of equal priority are admitted earliest deadline first.
+ * @param start Starts the pump and returns whether it runs.
+ * @return Id of the request, 0 if the pump already has a queued or running request.
+ */
+PumpScheduler::RequestId PumpScheduler::request(WaterPump& pump, int priority, Clock::time_point deadline,
+                                                std::function<bool()> start) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+
+    if (pending.count(&pump) != 0 || running.count(&pump) != 0) {
+        return 0;
+    }
+
+    // Learn when the pump stops, whoever stopped it
+    if (listening.insert(&pump).second) {
+        WaterPump* stopped = &pump;
+        pump.setStopListener([this, stopped]() {
+            onPumpStopped(stopped);
+        });
+    }
+
+    Request request;
+    request.id = nextId++;
+    request.pump = &pump;
+    request.priority = priority;
+    request.deadline = deadline;
+    request.start = std::move(start);
+
+    RequestId id = request.id;
+    queued[id] = queue.insert(std::move(request)).first;
+    pending[&pump] = id;
+
+    admit();
+
+    return id;
+}
+
+/**
+ * @brief Remove a request that has not been admitted yet.
+ * @param id Id of the request.
+ * @return True if the request was removed, false if it was already admitted or does not exist.
+ */
+bool PumpScheduler::cancel(RequestId id) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+
+    std::unordered_map<RequestId, RequestQueue::iterator>::iterator found = queued.find(id);
+    if (found == queued.end()) {
+        return false;
+    }
+
+    bool wasHead = found->second == queue.begin();
+    pending.erase(found->second->pump);
+    queue.erase(found->second);
+    queued.erase(found);
+
+    // The requests behind a removed head may fit now
+    if (wasHead) {
+        admit();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Drop everything the scheduler knows about a pump, e.g. when it is destroyed.
+ * @param pump Pump to forget.
+ */
+void PumpScheduler::forget(WaterPump& pump) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+
+    std::unordered_map<WaterPump*, RequestId>::iterator found = pending.find(&pump);
+    if (found != pending.end()) {
+        std::unordered_map<RequestId, RequestQueue::iterator>::iterator request = queued.find(found->second);
+        if (request != queued.end()) {
+            queue.erase(request->second);
+            queued.erase(request);
+        }
+        pending.erase(found);
+    }
+
+    // A pump built at the same address later must get its own stop listener
+    listening.erase(&pump);
+    releaseLoad(&pump);
+
+    // The freed share or the removed head may let waiting requests in
+    admit();
+}
+
+/**
+ * @brief Get the number of queued requests.
+ * @return Queued requests.
+ */
+size_t PumpScheduler::getQueueLength() {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    return queue.size();
+}
+
+/**
+ * @brief Get the number of pumps running through the scheduler.
+ * @return Running pumps.
+ */
+size_t PumpScheduler::getRunningCount() {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    return running.size();
+}
+
+/**
+ * @brief Get the supply current taken by the running pumps.
+ * @return Current in amps.
+ */
+double PumpScheduler::getCurrentInUse() {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    return usedCurrent;
+}
+
+/**
+ * @brief Start queued requests while they fit the budget.
+ */
+void PumpScheduler::admit() {
+    while (!queue.empty()) {
+        RequestQueue::iterator head = queue.begin();
+        WaterPump* pump = head->pump;
+
+        Load load;
+        load.current = pump->getRatedCurrent();
+        load.flow = pump->getFlowRate();
+
+        // Wait for running pumps to free enough budget, a lone pump always fits
+        bool fits = running.empty() ||
+                    ((maxCurrent <= 0.0 || usedCurrent + load.current <= maxCurrent) &&
+                     (maxFlow <= 0.0 || usedFlow + load.flow <= maxFlow));
+        if (!fits) {
+            return;
+        }
+
+        std::function<bool()> start = head->start;
+        queued.erase(head->id);
+        pending.erase(pump);
+        queue.erase(head);
+
+        // Charge the pump before it starts, its stop may be reported right away
+        running[pump] = load;
+        usedCurrent += load.current;
+        usedFlow += load.flow;
+
+        if (!start()) {
+            releaseLoad(pump);
+        }
+    }
+}
+
+/**
+ * @brief Give back a pump's share of the budget.
+ * @param pump Pump that stopped.
+ */
+void PumpScheduler::releaseLoad(WaterPump* pump) {
+    std::unordered_map<WaterPump*, Load>::iterator found = running.find(pump);
+    if (found == running.end()) {
+        return;
+    }
+
+    usedCurrent -= found->second.current;
+    usedFlow -= found->second.flow;
+    running.erase(found);
+
+    // Keep rounding errors from building up
+    if (running.empty()) {
+        usedCurrent = 0.0;
+        usedFlow = 0.0;
+    }
+}
+
+/**
+ * @brief Called when a pump stops: free its share and admit the queue.
+ * @param pump Pump that stopped.
+ */
+void PumpScheduler::onPumpStopped(WaterPump* pump) {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+
+    releaseLoad(pump);
+    admit();
+}
@@ -0,0 +1,153 @@
+#ifndef PUMPSCHEDULER_H
+#define PUMPSCHEDULER_H
+
+#include "WaterPump.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @brief The PumpScheduler class admits pump runs against a shared supply current and water flow budget.
+ * @details Zones request a run instead of starting their pump directly. Requests wait in a queue ordered by
+ *          priority, then deadline, then arrival, and the head is started as soon as its rated current and flow
+ *          fit next to the pumps already running. A pump that stops frees its share at once and the queue is
+ *          admitted again. Requesting, cancelling and admitting are O(log n) in the number of queued requests.
+ *          The head of the queue is never overtaken, so a large pump can't be starved by small ones.
+ */
+class PumpScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    using RequestId = uint64_t;
+
+    /**
+     * @brief Get the process-wide pump scheduler.
+     * @return The pump scheduler.
+     */
+    static PumpScheduler& instance();
+
+    /**
+     * @brief Constructor for PumpScheduler, without a budget limit.
+     */
+    PumpScheduler();
+
+    PumpScheduler(const PumpScheduler&) = delete;
+    PumpScheduler& operator=(const PumpScheduler&) = delete;
+
+    /**
+     * @brief Set the budget shared by all running pumps.
+     * @param maxCurrentAmps Supply current available to the pumps, 0 for no limit.
+     * @param maxFlowMlPerSecond Water flow the supply line can deliver, 0 for no limit.
+     */
+    void setBudget(double maxCurrentAmps, double maxFlowMlPerSecond);
+
+    /**
+     * @brief Queue a run of a pump.
+     * @details A single pump always fits when nothing else runs, even if it exceeds the budget on its own.
+     * @param pump Pump to run, charged with its rated current and flow rate while running.
+     * @param priority Higher priorities are admitted first.
+     * @param deadline Requests of equal priority are admitted earliest deadline first.
+     * @param start Starts the pump and returns whether it runs. Called with the scheduler locked, possibly on the
+     *              timer thread, so it must not block or call into the scheduler.
+     * @return Id of the request, 0 if the pump already has a queued or running request.
+     */
+    RequestId request(WaterPump& pump, int priority, Clock::time_point deadline, std::function<bool()> start);
+
+    /**
+     * @brief Remove a request that has not been admitted yet.
+     * @param id Id of the request.
+     * @return True if the request was removed, false if it was already admitted or does not exist.
+     */
+    bool cancel(RequestId id);
+
+    /**
+     * @brief Drop everything the scheduler knows about a pump, e.g. when it is destroyed.
+     * @details A queued request is removed and the share of a running pump is given back, so the queue can
+     *          move on without waiting for a stop that will never be reported.
+     * @param pump Pump to forget.
+     */
+    void forget(WaterPump& pump);
+
+    /**
+     * @brief Get the number of queued requests.
+     * @return Queued requests.
+     */
+    size_t getQueueLength();
+
+    /**
+     * @brief Get the number of pumps running through the scheduler.
+     * @return Running pumps.
+     */
+    size_t getRunningCount();
+
+    /**
+     * @brief Get the supply current taken by the running pumps.
+     * @return Current in amps.
+     */
+    double getCurrentInUse();
+
+private:
+    struct Request {
+        RequestId id;                           // Id of the request
+        WaterPump* pump;                        // Pump to run
+        int priority;                           // Higher is admitted first
+        Clock::time_point deadline;             // Earlier is admitted first at equal priority
+        std::function<bool()> start;            // Starts the pump
+    };
+
+    struct RequestOrder {
+        bool operator()(const Request& a, const Request& b) const {
+            if (a.priority != b.priority) {
+                return a.priority > b.priority;
+            }
+            if (a.deadline != b.deadline) {
+                return a.deadline < b.deadline;
+            }
+            return a.id < b.id;
+        }
+    };
+
+    struct Load {
+        double current;                         // Rated current in amps
+        double flow;                            // Flow in ml/s
+    };
+
+    using RequestQueue = std::set<Request, RequestOrder>;
+
+    std::mutex schedulerMutex;                                      // Guards the queue and the budget
+    RequestQueue queue;                                             // Waiting requests in admission order
+    std::unordered_map<RequestId, RequestQueue::iterator> queued;   // Waiting requests by id
+    std::unordered_map<WaterPump*, RequestId> pending;              // Pumps with a waiting request
+    std::unordered_map<WaterPump*, Load> running;                   // Admitted pumps and their share
+    std::unordered_set<WaterPump*> listening;                       // Pumps reporting their stops to us
+    RequestId nextId;                                               // Id of the next request
+    double maxCurrent;                                              // Current budget, 0 for no limit
+    double maxFlow;                                                 // Flow budget, 0 for no limit
+    double usedCurrent;                                             // Current of the running pumps
+    double usedFlow;                                                // Flow of the running pumps
+
+    /**
+     * @brief Start queued requests while they fit the budget.
+     * @details Must be called with schedulerMutex held.
+     */
+    void admit();
+
+    /**
+     * @brief Give back a pump's share of the budget.
+     * @details Must be called with schedulerMutex held.
+     * @param pump Pump that stopped.
+     */
+    void releaseLoad(WaterPump* pump);
+
+    /**
+     * @brief Called when a pump stops: free its share and admit the queue.
+     * @param pump Pump that stopped.
+     */
+    void onPumpStopped(WaterPump* pump);
+};
+
+#endif // PUMPSCHEDULER_H
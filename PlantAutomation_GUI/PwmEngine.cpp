@@ -0,0 +1,509 @@
+#include "PwmEngine.h"
+#include "GpioChipPool.h"
+#include "Logging.h"
+
+#include <cmath>
+#include <ctime>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/**
+ * @file PwmEngine.cpp
+ *
+ * @brief Implementation of the PwmEngine class.
+ */
+
+/**
+ * @brief Convert a frequency to a PWM period.
+ * @param frequencyHz PWM frequency.
+ * @return PWM period.
+ */
+static PwmEngine::Clock::duration periodFor(double frequencyHz) {
+    if (!(frequencyHz > 0.0)) {
+        throw std::runtime_error("PwmEngine: invalid PWM frequency " + std::to_string(frequencyHz) + " Hz");
+    }
+
+    return std::chrono::duration_cast<PwmEngine::Clock::duration>(std::chrono::duration<double>(1.0 / frequencyHz));
+}
+
+/**
+ * @brief Get the process-wide PWM engine.
+ * @return The PWM engine.
+ */
+PwmEngine& PwmEngine::instance() {
+    static PwmEngine engine;
+    return engine;
+}
+
+/**
+ * @brief Constructor for PwmEngine, the timing thread is started by the first channel.
+ */
+PwmEngine::PwmEngine() : nextId(1), chip(nullptr), nextEdge(Clock::time_point::max()), jitterSamples(0),
+                         jitterSum(0.0), jitterSumSquares(0.0), jitterMax(0.0), cpuStart(0), timerFd(-1),
+                         running(true) {
+    // Keep the pool alive longer than the engine
+    GpioChipPool::instance();
+    gpiod_line_bulk_init(&bulk);
+    statsStart = Clock::now();
+}
+
+/**
+ * @brief Destructor for PwmEngine, stops the timing thread and drives every line low.
+ */
+PwmEngine::~PwmEngine() {
+    // Nothing was set up if no channel was ever added
+    if (!thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pwmMutex);
+        running = false;
+
+        // Fire the timerfd immediately to wake the thread
+        itimerspec spec = {};
+        spec.it_value.tv_nsec = 1;
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(timerFd);
+
+    if (gpiod_line_bulk_num_lines(&bulk) > 0) {
+        for (size_t i = 0; i < channels.size(); i++) {
+            values[i] = 0;
+        }
+        gpiod_line_set_value_bulk(&bulk, values);
+        gpiod_line_release_bulk(&bulk);
+    }
+    GpioChipPool::instance().release(chip);
+}
+
+/**
+ * @brief Add a GPIO line to the engine, starting low.
+ * @param pin GPIO pin number.
+ * @param frequencyHz PWM frequency.
+ * @return Id of the channel.
+ */
+PwmEngine::ChannelId PwmEngine::addChannel(int pin, double frequencyHz) {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    if (channels.size() >= GPIOD_LINE_BULK_MAX_LINES) {
+        throw std::runtime_error("PwmEngine: too many PWM channels");
+    }
+
+    start();
+
+    Clock::time_point now = Clock::now();
+
+    Channel channel;
+    channel.id = nextId++;
+    channel.pin = pin;
+    channel.period = periodFor(frequencyHz);
+    channel.duty = 0.0;
+    channel.rampFrom = 0.0;
+    channel.rampStart = now;
+    channel.rampEnd = now;
+    channel.cycleStart = now;
+    channel.onTime = Clock::duration::zero();
+    channel.level = 0;
+    channels.push_back(channel);
+
+    try {
+        requestLines();
+    } catch (...) {
+        // Keep the other channels switching
+        channels.pop_back();
+        requestLines();
+        update(Clock::now());
+        throw;
+    }
+
+    return channel.id;
+}
+
+/**
+ * @brief Drive a channel low and release its line.
+ * @param id Id of the channel.
+ */
+void PwmEngine::removeChannel(ChannelId id) {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (channels[i].id == id) {
+            // Drive the line low before it is released
+            channels[i].level = 0;
+            values[i] = 0;
+            if (gpiod_line_bulk_num_lines(&bulk) > 0) {
+                gpiod_line_set_value_bulk(&bulk, values);
+            }
+
+            channels.erase(channels.begin() + i);
+            requestLines();
+            update(Clock::now());
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Set the PWM frequency of a channel.
+ * @param id Id of the channel.
+ * @param frequencyHz PWM frequency.
+ */
+void PwmEngine::setFrequency(ChannelId id, double frequencyHz) {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    Channel* channel = findChannel(id);
+    if (channel == nullptr) {
+        return;
+    }
+
+    // Start a fresh period at the new frequency
+    Clock::time_point now = Clock::now();
+    channel->period = periodFor(frequencyHz);
+    channel->cycleStart = now;
+    channel->onTime = std::chrono::duration_cast<Clock::duration>(channel->period * dutyAt(*channel, now));
+
+    update(now);
+}
+
+/**
+ * @brief Set the duty cycle of a channel.
+ * @param id Id of the channel.
+ * @param duty Duty cycle between 0 and 1.
+ * @param ramp Time to reach the new duty, 0 to switch at once.
+ * @param curve Shape of the ramp.
+ */
+void PwmEngine::setDuty(ChannelId id, double duty, std::chrono::milliseconds ramp, RampCurve curve) {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    Channel* channel = findChannel(id);
+    if (channel == nullptr) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    double current = dutyAt(*channel, now);
+
+    // A line that is not switching starts its first period now, a running one keeps its phase
+    if (now >= channel->rampEnd && (current <= 0.0 || current >= 1.0)) {
+        channel->cycleStart = now;
+    }
+
+    channel->duty = duty < 0.0 ? 0.0 : (duty > 1.0 ? 1.0 : duty);
+    channel->rampFrom = current;
+    channel->rampStart = now;
+    channel->rampEnd = now + ramp;
+    if (ramp > std::chrono::milliseconds(0)) {
+        channel->rampTable = rampTableFor(current, channel->duty, curve);
+    } else {
+        channel->rampTable.clear();
+    }
+    channel->onTime = std::chrono::duration_cast<Clock::duration>(channel->period * dutyAt(*channel, channel->cycleStart));
+
+    update(now);
+}
+
+/**
+ * @brief Get the duty cycle a channel is currently running at, including a ramp in progress.
+ * @param id Id of the channel.
+ * @return Duty cycle between 0 and 1.
+ */
+double PwmEngine::getDuty(ChannelId id) {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    Channel* channel = findChannel(id);
+    return channel != nullptr ? dutyAt(*channel, Clock::now()) : 0.0;
+}
+
+/**
+ * @brief Get the timing thread's jitter and CPU statistics.
+ * @return Statistics since the last reset.
+ */
+PwmEngine::JitterStats PwmEngine::getJitterStats() {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    JitterStats stats = {};
+    stats.samples = jitterSamples;
+    if (jitterSamples > 0) {
+        stats.meanUs = jitterSum / jitterSamples;
+        double variance = jitterSumSquares / jitterSamples - stats.meanUs * stats.meanUs;
+        stats.stdDevUs = variance > 0.0 ? std::sqrt(variance) : 0.0;
+        stats.maxUs = jitterMax;
+    }
+
+    // Share of the elapsed time the timing thread spent on the CPU
+    stats.lines = channels.size();
+    double elapsed = std::chrono::duration<double>(Clock::now() - statsStart).count();
+    if (elapsed > 0.0) {
+        stats.cpuPercent = 100.0 * std::chrono::duration<double>(threadCpuTime() - cpuStart).count() / elapsed;
+        if (stats.lines > 0) {
+            stats.cpuPercentPerLine = stats.cpuPercent / stats.lines;
+        }
+    }
+
+    return stats;
+}
+
+/**
+ * @brief Reset the jitter and CPU statistics.
+ */
+void PwmEngine::resetJitterStats() {
+    std::lock_guard<std::mutex> lock(pwmMutex);
+
+    jitterSamples = 0;
+    jitterSum = 0.0;
+    jitterSumSquares = 0.0;
+    jitterMax = 0.0;
+    cpuStart = threadCpuTime();
+    statsStart = Clock::now();
+}
+
+/**
+ * @brief Find a channel by id.
+ * @param id Id of the channel.
+ * @return The channel, or nullptr if it does not exist.
+ */
+PwmEngine::Channel* PwmEngine::findChannel(ChannelId id) {
+    for (Channel& channel : channels) {
+        if (channel.id == id) {
+            return &channel;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Get the duty cycle of a channel at a point in time.
+ * @param channel Channel.
+ * @param time Point in time.
+ * @return Duty cycle between 0 and 1.
+ */
+double PwmEngine::dutyAt(const Channel& channel, Clock::time_point time) {
+    if (time >= channel.rampEnd) {
+        return channel.duty;
+    }
+    if (time <= channel.rampStart) {
+        return channel.rampFrom;
+    }
+
+    double progress = std::chrono::duration<double>(time - channel.rampStart) /
+                      std::chrono::duration<double>(channel.rampEnd - channel.rampStart);
+    if (channel.rampTable.empty()) {
+        return channel.rampFrom + (channel.duty - channel.rampFrom) * progress;
+    }
+
+    size_t step = static_cast<size_t>(progress * RAMP_STEPS);
+    return channel.rampTable[step < RAMP_STEPS ? step : RAMP_STEPS];
+}
+
+/**
+ * @brief Compute the duty of every step of a ramp.
+ * @param from Duty cycle at the start.
+ * @param to Duty cycle at the end.
+ * @param curve Shape of the ramp.
+ * @return RAMP_STEPS + 1 duty cycles from start to end.
+ */
+std::vector<double> PwmEngine::rampTableFor(double from, double to, RampCurve curve) {
+    const double gamma = 2.2;
+
+    std::vector<double> table(RAMP_STEPS + 1);
+    for (size_t step = 0; step <= RAMP_STEPS; step++) {
+        double progress = static_cast<double>(step) / RAMP_STEPS;
+
+        switch (curve) {
+        case RampCurve::SMOOTH:
+            progress = progress * progress * (3.0 - 2.0 * progress);
+            table[step] = from + (to - from) * progress;
+            break;
+        case RampCurve::PERCEPTUAL: {
+            // Interpolate the perceived brightness and map it back to a duty cycle
+            double fromBrightness = std::pow(from, 1.0 / gamma);
+            double toBrightness = std::pow(to, 1.0 / gamma);
+            table[step] = std::pow(fromBrightness + (toBrightness - fromBrightness) * progress, gamma);
+            break;
+        }
+        default:
+            table[step] = from + (to - from) * progress;
+            break;
+        }
+    }
+
+    return table;
+}
+
+/**
+ * @brief Get the CPU time used by the timing thread.
+ * @return CPU time, 0 if it can't be read.
+ */
+std::chrono::nanoseconds PwmEngine::threadCpuTime() {
+    if (!thread.joinable()) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    clockid_t clock;
+    timespec time;
+    if (pthread_getcpuclockid(thread.native_handle(), &clock) != 0 || clock_gettime(clock, &time) != 0) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+/**
+ * @brief Open the GPIO chip and the timerfd and start the timing thread, unless already done.
+ */
+void PwmEngine::start() {
+    if (thread.joinable()) {
+        return;
+    }
+
+    // Share the GPIO chip with the other users
+    chip = GpioChipPool::instance().acquire();
+
+    // steady_clock is CLOCK_MONOTONIC on Linux, so edges map directly onto the timerfd
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd < 0) {
+        GpioChipPool::instance().release(chip);
+        chip = nullptr;
+        throw std::runtime_error("PwmEngine: couldn't create timerfd");
+    }
+
+    thread = std::thread(&PwmEngine::run, this);
+    cpuStart = threadCpuTime();
+    statsStart = Clock::now();
+
+    // Wake-up latency is the jitter of every edge, so run ahead of normal threads when permitted
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+}
+
+/**
+ * @brief Release and re-request the bulk with the lines of every channel.
+ */
+void PwmEngine::requestLines() {
+    if (gpiod_line_bulk_num_lines(&bulk) > 0) {
+        gpiod_line_release_bulk(&bulk);
+    }
+    gpiod_line_bulk_init(&bulk);
+
+    if (channels.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        gpiod_line_bulk_add(&bulk, gpiod_chip_get_line(chip, channels[i].pin));
+        values[i] = channels[i].level;
+    }
+
+    // set_value_bulk only works on lines that were requested together
+    if (gpiod_line_request_bulk_output(&bulk, "PwmEngine", values) < 0) {
+        gpiod_line_bulk_init(&bulk);
+        throw std::runtime_error("PwmEngine: couldn't request the PWM lines");
+    }
+}
+
+/**
+ * @brief Bring every channel up to date, write the changed levels and arm the timerfd for the next edge.
+ * @param now Current time.
+ */
+void PwmEngine::update(Clock::time_point now) {
+    bool changed = false;
+    nextEdge = Clock::time_point::max();
+
+    for (size_t i = 0; i < channels.size(); i++) {
+        Channel& channel = channels[i];
+
+        // Skip to the period containing now, the duty of a ramp is sampled once per period
+        if (now - channel.cycleStart >= channel.period) {
+            channel.cycleStart += ((now - channel.cycleStart) / channel.period) * channel.period;
+            channel.onTime = std::chrono::duration_cast<Clock::duration>(channel.period *
+                                                                         dutyAt(channel, channel.cycleStart));
+        }
+
+        int level;
+        Clock::time_point edge = Clock::time_point::max();
+        if (channel.onTime <= Clock::duration::zero()) {
+            level = 0;
+        } else if (channel.onTime >= channel.period) {
+            level = 1;
+        } else {
+            level = now - channel.cycleStart < channel.onTime ? 1 : 0;
+            edge = channel.cycleStart + (level ? channel.onTime : channel.period);
+        }
+
+        // A ramp changes the duty at the next period even while the line is constant
+        if (edge == Clock::time_point::max() && now < channel.rampEnd) {
+            edge = channel.cycleStart + channel.period;
+        }
+
+        if (level != channel.level) {
+            channel.level = level;
+            changed = true;
+        }
+        values[i] = level;
+
+        if (edge < nextEdge) {
+            nextEdge = edge;
+        }
+    }
+
+    // One write switches every line for this edge, nothing is requested after a failed request
+    if (changed && gpiod_line_bulk_num_lines(&bulk) > 0) {
+        gpiod_line_set_value_bulk(&bulk, values);
+    }
+
+    itimerspec spec = {};
+    if (nextEdge != Clock::time_point::max()) {
+        std::chrono::nanoseconds deadline = nextEdge.time_since_epoch();
+        spec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(deadline).count();
+        spec.it_value.tv_nsec = (deadline % std::chrono::seconds(1)).count();
+    }
+
+    // A zero it_value disarms the timer while no line is switching
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+/**
+ * @brief Timing thread: wait for the timerfd and switch the lines at every edge.
+ */
+void PwmEngine::run() {
+    while (true) {
+        // Sleep until the next edge
+        uint64_t expirations;
+        if (::read(timerFd, &expirations, sizeof(expirations)) < 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(pwmMutex);
+        if (!running) {
+            return;
+        }
+
+        Clock::time_point now = Clock::now();
+
+        // Measure how late the thread woke up for the edge
+        if (nextEdge != Clock::time_point::max() && now >= nextEdge) {
+            double lateUs = std::chrono::duration<double, std::micro>(now - nextEdge).count();
+            jitterSamples++;
+            jitterSum += lateUs;
+            jitterSumSquares += lateUs * lateUs;
+            if (lateUs > jitterMax) {
+                jitterMax = lateUs;
+            }
+        }
+
+        try {
+            update(now);
+        } catch (const std::exception& e) {
+            logger.logEvent("ERROR", "PwmEngine", std::string("PWM update failed: ") + e.what());
+        }
+    }
+}
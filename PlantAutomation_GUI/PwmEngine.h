@@ -0,0 +1,216 @@
+#ifndef PWMENGINE_H
+#define PWMENGINE_H
+
+#include <gpiod.h>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The PwmEngine class generates software PWM on GPIO lines from one shared timing thread.
+ * @details All PWM lines are requested together as one libgpiod bulk. The thread sleeps on a timerfd until the
+ *          next edge of any channel and then writes the level of every line with a single bulk update, so the
+ *          cost per edge does not grow with a thread per line. Every channel has its own frequency and duty and
+ *          duty changes can be ramped over a number of periods for a soft start or a sunrise. The duty of every
+ *          ramp step is computed once when the ramp is set, so an edge costs a table lookup whatever the curve.
+ *          The thread, the timerfd and the GPIO chip are only set up when the first channel is added, so
+ *          holding on to the engine costs nothing while no PWM is used.
+ */
+class PwmEngine {
+public:
+    using Clock = std::chrono::steady_clock;
+    using ChannelId = uint64_t;
+
+    static constexpr size_t RAMP_STEPS = 256;   // Duty steps of a ramp
+
+    /**
+     * @brief Shape of a duty ramp.
+     */
+    enum class RampCurve {
+        LINEAR,                 // Duty changes at a constant rate
+        SMOOTH,                 // Duty starts and ends slowly (smoothstep)
+        PERCEPTUAL              // Perceived brightness changes at a constant rate (gamma 2.2), for lights
+    };
+
+    /**
+     * @struct JitterStats
+     * @brief Lateness of the timing thread's wake-ups relative to the scheduled edges and its CPU cost.
+     */
+    struct JitterStats {
+        uint64_t samples;       // Number of measured edges
+        double meanUs;          // Mean lateness in microseconds
+        double stdDevUs;        // Standard deviation of the lateness in microseconds
+        double maxUs;           // Largest lateness in microseconds
+        size_t lines;           // Number of PWM lines
+        double cpuPercent;      // CPU time of the timing thread in percent of the elapsed time
+        double cpuPercentPerLine;   // CPU time per PWM line in percent of the elapsed time
+    };
+
+    /**
+     * @brief Get the process-wide PWM engine.
+     * @return The PWM engine.
+     */
+    static PwmEngine& instance();
+
+    /**
+     * @brief Constructor for PwmEngine, the timing thread is started by the first channel.
+     */
+    PwmEngine();
+
+    /**
+     * @brief Destructor for PwmEngine, stops the timing thread and drives every line low.
+     */
+    ~PwmEngine();
+
+    PwmEngine(const PwmEngine&) = delete;
+    PwmEngine& operator=(const PwmEngine&) = delete;
+
+    /**
+     * @brief Add a GPIO line to the engine, starting low.
+     * @details The line must not be requested by anyone else. Adding or removing a channel re-requests the bulk,
+     *          so do it at setup rather than while lines are switching. Throws std::runtime_error if the line or
+     *          the timing thread can't be set up.
+     * @param pin GPIO pin number.
+     * @param frequencyHz PWM frequency.
+     * @return Id of the channel.
+     */
+    ChannelId addChannel(int pin, double frequencyHz);
+
+    /**
+     * @brief Drive a channel low and release its line.
+     * @param id Id of the channel.
+     */
+    void removeChannel(ChannelId id);
+
+    /**
+     * @brief Set the PWM frequency of a channel.
+     * @param id Id of the channel.
+     * @param frequencyHz PWM frequency.
+     */
+    void setFrequency(ChannelId id, double frequencyHz);
+
+    /**
+     * @brief Set the duty cycle of a channel.
+     * @details The duty moves from its current value to the new one over the ramp time along the curve, in
+     *          RAMP_STEPS steps sampled once per period. A duty of 0 or 1 with no ramp is written to the line
+     *          immediately.
+     * @param id Id of the channel.
+     * @param duty Duty cycle between 0 and 1.
+     * @param ramp Time to reach the new duty, 0 to switch at once.
+     * @param curve Shape of the ramp.
+     */
+    void setDuty(ChannelId id, double duty, std::chrono::milliseconds ramp = std::chrono::milliseconds(0),
+                 RampCurve curve = RampCurve::LINEAR);
+
+    /**
+     * @brief Get the duty cycle a channel is currently running at, including a ramp in progress.
+     * @param id Id of the channel.
+     * @return Duty cycle between 0 and 1.
+     */
+    double getDuty(ChannelId id);
+
+    /**
+     * @brief Get the timing thread's jitter and CPU statistics.
+     * @return Statistics since the last reset.
+     */
+    JitterStats getJitterStats();
+
+    /**
+     * @brief Reset the jitter and CPU statistics.
+     */
+    void resetJitterStats();
+
+private:
+    struct Channel {
+        ChannelId id;                           // Id of the channel
+        int pin;                                // GPIO pin number
+        Clock::duration period;                 // PWM period
+        double duty;                            // Target duty cycle
+        double rampFrom;                        // Duty cycle at the start of the ramp
+        std::vector<double> rampTable;          // Duty of every ramp step, empty without a ramp
+        Clock::time_point rampStart;            // Start of the ramp
+        Clock::time_point rampEnd;              // End of the ramp
+        Clock::time_point cycleStart;           // Start of the current period
+        Clock::duration onTime;                 // High time of the current period
+        int level;                              // Level written to the line
+    };
+
+    std::mutex pwmMutex;                        // Guards the channels and the lines
+    std::vector<Channel> channels;              // Channels in bulk order
+    ChannelId nextId;                           // Id of the next channel
+    gpiod_chip* chip;                           // GPIO chip, nullptr until started
+    gpiod_line_bulk bulk;                       // Lines of every channel, requested together
+    int values[GPIOD_LINE_BULK_MAX_LINES];      // Levels for the bulk update
+    Clock::time_point nextEdge;                 // Edge the timerfd is armed for, max() if none
+
+    uint64_t jitterSamples;                     // Measured edges
+    double jitterSum;                           // Sum of the lateness in microseconds
+    double jitterSumSquares;                    // Sum of the squared lateness
+    double jitterMax;                           // Largest lateness in microseconds
+    std::chrono::nanoseconds cpuStart;          // CPU time of the timing thread at the last reset
+    Clock::time_point statsStart;               // Time of the last reset
+
+    int timerFd;                                // timerfd armed for the next edge, -1 until started
+    bool running;                               // The timing thread should keep running
+    std::thread thread;                         // Timing thread
+
+    /**
+     * @brief Find a channel by id.
+     * @details Must be called with pwmMutex held.
+     * @param id Id of the channel.
+     * @return The channel, or nullptr if it does not exist.
+     */
+    Channel* findChannel(ChannelId id);
+
+    /**
+     * @brief Get the duty cycle of a channel at a point in time.
+     * @param channel Channel.
+     * @param time Point in time.
+     * @return Duty cycle between 0 and 1.
+     */
+    static double dutyAt(const Channel& channel, Clock::time_point time);
+
+    /**
+     * @brief Compute the duty of every step of a ramp.
+     * @param from Duty cycle at the start.
+     * @param to Duty cycle at the end.
+     * @param curve Shape of the ramp.
+     * @return RAMP_STEPS + 1 duty cycles from start to end.
+     */
+    static std::vector<double> rampTableFor(double from, double to, RampCurve curve);
+
+    /**
+     * @brief Get the CPU time used by the timing thread.
+     * @return CPU time, 0 if it can't be read.
+     */
+    std::chrono::nanoseconds threadCpuTime();
+
+    /**
+     * @brief Open the GPIO chip and the timerfd and start the timing thread, unless already done.
+     * @details Must be called with pwmMutex held.
+     */
+    void start();
+
+    /**
+     * @brief Release and re-request the bulk with the lines of every channel.
+     * @details Must be called with pwmMutex held.
+     */
+    void requestLines();
+
+    /**
+     * @brief Bring every channel up to date, write the changed levels and arm the timerfd for the next edge.
+     * @details Must be called with pwmMutex held.
+     * @param now Current time.
+     */
+    void update(Clock::time_point now);
+
+    /**
+     * @brief Timing thread: wait for the timerfd and switch the lines at every edge.
+     * @details An exception from an update is logged so the thread keeps running.
+     */
+    void run();
+};
+
+#endif // PWMENGINE_H
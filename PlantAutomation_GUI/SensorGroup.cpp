@@ -0,0 +1,311 @@
+#include "SensorGroup.h"
+#include "Logging.h"
+
+#include <algorithm>
+
+/**
+ * @file SensorGroup.cpp
+ *
+ * @brief Implementation of the SensorGroup class.
+ */
+
+/**
+ * @brief Constructor for SensorGroup.
+ * @param reducer Function used to combine the probe readings.
+ * @param minHealthyProbes Number of healthy probes needed for the group to be healthy.
+ */
+SensorGroup::SensorGroup(Reducer reducer, size_t minHealthyProbes) :
+        reducer(reducer),
+        minHealthyProbes(minHealthyProbes),
+        hasScan(false),
+        lastMoisture(0.0),
+        healthyProbes(0),
+        scanPending(false) {
+}
+
+/**
+ * @brief Destructor for SensorGroup.
+ */
+SensorGroup::~SensorGroup() {
+    // Probes are released with the vector
+}
+
+/**
+ * @brief Add a probe to the group.
+ * @param address I2C address of the ADC the probe is connected to.
+ * @param muxSelect Mux configuration of the probe.
+ * @param weight Weight of the probe for the WEIGHTED reducer.
+ * @return The new probe, e.g. to set its calibration values.
+ */
+SoilSensor& SensorGroup::addSensor(uint8_t address, ADS1115::Mux muxSelect, double weight) {
+    std::lock_guard<std::mutex> lock(scanMutex);
+
+    probes.push_back({std::unique_ptr<SoilSensor>(new SoilSensor(address, muxSelect)), weight, 0.0, false});
+    size_t index = probes.size() - 1;
+
+    // Queue the probe behind the other probes on the same ADC
+    bool queued = false;
+    for (std::vector<size_t>& queue : adcQueues) {
+        if (probes[queue.front()].sensor->getAddress() == address) {
+            queue.push_back(index);
+            queued = true;
+            break;
+        }
+    }
+    if (!queued) {
+        adcQueues.push_back({index});
+    }
+
+    scratch.reserve(probes.size());
+
+    return *probes[index].sensor;
+}
+
+/**
+ * @brief Set the function used to combine the probe readings.
+ * @param reducer Reducer to use.
+ */
+void SensorGroup::setReducer(Reducer reducer) {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    this->reducer = reducer;
+}
+
+/**
+ * @brief Convert every probe and combine the readings.
+ * @return Combined soil moisture level.
+ */
+double SensorGroup::scan() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+
+    if (!scanPending) {
+        startScan();
+    }
+
+    return finishScan();
+}
+
+/**
+ * @brief Read the combined soil moisture, scanning only if the last scan is older than maxAge.
+ * @param maxAge Maximum age of a cached result that may be returned.
+ * @return Combined soil moisture level.
+ */
+double SensorGroup::readMoisture(std::chrono::milliseconds maxAge) {
+    std::lock_guard<std::mutex> lock(scanMutex);
+
+    if (!scanPending) {
+        if (hasScan && lastScanTime + maxAge >= Clock::now()) {
+            return lastMoisture;
+        }
+        startScan();
+    }
+
+    // Keep the last result while the probes settle
+    if (hasScan && !samplesDone()) {
+        return lastMoisture;
+    }
+
+    return finishScan();
+}
+
+/**
+ * @brief Start the background samples of the probes with excitation.
+ */
+void SensorGroup::startScan() {
+    scanStart = Clock::now();
+    scanPending = true;
+
+    for (Probe& probe : probes) {
+        probe.sampled = probe.sensor->hasExcitation();
+        if (probe.sampled) {
+            probe.sensor->requestSample();
+        }
+    }
+}
+
+/**
+ * @brief Check whether the background samples of the current scan are done.
+ * @return True if every sampled probe has a reading newer than the start of the scan.
+ */
+bool SensorGroup::samplesDone() {
+    bool done = true;
+    for (const Probe& probe : probes) {
+        if (probe.sampled && probe.sensor->getLastReadingTime() < scanStart) {
+            // The sample may not have started if the probe was busy calibrating
+            probe.sensor->requestSample();
+            done = false;
+        }
+    }
+
+    return done;
+}
+
+/**
+ * @brief Convert the remaining probes and combine the readings of the current scan.
+ * @return Combined soil moisture level.
+ */
+double SensorGroup::finishScan() {
+    // Take turns on every ADC: start one conversion per ADC, then collect them all
+    size_t longestQueue = 0;
+    for (const std::vector<size_t>& queue : adcQueues) {
+        longestQueue = std::max(longestQueue, queue.size());
+    }
+
+    for (size_t round = 0; round < longestQueue; round++) {
+        for (const std::vector<size_t>& queue : adcQueues) {
+            if (round < queue.size() && !probes[queue[round]].sampled) {
+                probes[queue[round]].sensor->beginConversion();
+            }
+        }
+        for (const std::vector<size_t>& queue : adcQueues) {
+            if (round < queue.size() && !probes[queue[round]].sampled) {
+                Probe& probe = probes[queue[round]];
+                probe.moisture = probe.sensor->finishConversion();
+            }
+        }
+    }
+
+    // Pick up the background samples, waiting only for ones that are still running
+    for (Probe& probe : probes) {
+        if (probe.sampled) {
+            probe.moisture = probe.sensor->waitForSample();
+        }
+    }
+    scanPending = false;
+
+    // Combine the healthy probes, keep the last result if there are not enough
+    size_t previousHealthy = healthyProbes;
+    healthyProbes = 0;
+    for (const Probe& probe : probes) {
+        if (probe.sensor->isHealthy()) {
+            healthyProbes++;
+        }
+    }
+
+    // Log every change in the number of usable probes
+    if (hasScan && healthyProbes != previousHealthy) {
+        logger.logEvent(healthyProbes < previousHealthy ? "WARN" : "INFO", "SensorGroup",
+                        std::to_string(healthyProbes) + " of " + std::to_string(probes.size()) + " probes healthy");
+    }
+
+    lastScanTime = Clock::now();
+    if (healthyProbes > 0 && healthyProbes >= minHealthyProbes) {
+        lastMoisture = reduce();
+        trend.addSample(lastMoisture, lastScanTime);
+    }
+    hasScan = true;
+
+    return lastMoisture;
+}
+
+/**
+ * @brief Get the time of the last scan.
+ * @return Time of the last scan.
+ */
+SensorGroup::Clock::time_point SensorGroup::getLastScanTime() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    return lastScanTime;
+}
+
+/**
+ * @brief Check whether enough probes are healthy.
+ * @return True if at least the minimum number of probes is healthy, false otherwise.
+ */
+bool SensorGroup::isHealthy() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    return healthyProbes > 0 && healthyProbes >= minHealthyProbes;
+}
+
+/**
+ * @brief Get the number of healthy probes at the last scan.
+ * @return Number of healthy probes.
+ */
+size_t SensorGroup::getHealthyProbeCount() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    return healthyProbes;
+}
+
+/**
+ * @brief Get the number of probes in the group.
+ * @return Number of probes.
+ */
+size_t SensorGroup::getProbeCount() const {
+    return probes.size();
+}
+
+/**
+ * @brief Tell every probe its zone is being irrigated.
+ */
+void SensorGroup::notifyIrrigation() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+
+    trend.reset();
+    for (Probe& probe : probes) {
+        probe.sensor->notifyIrrigation();
+    }
+}
+
+/**
+ * @brief Get the rate of change of the combined moisture.
+ * @return Rate of change in percent per hour.
+ */
+double SensorGroup::getMoistureSlope() {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    return trend.getSlopePerHour();
+}
+
+/**
+ * @brief Predict how long until the combined moisture drops to a threshold.
+ * @param threshold Moisture threshold in percent.
+ * @return Time until the threshold is reached, 0 if already below it, -1 if it is not falling.
+ */
+std::chrono::seconds SensorGroup::getTimeToThreshold(double threshold) {
+    std::lock_guard<std::mutex> lock(scanMutex);
+    return trend.getTimeToThreshold(threshold);
+}
+
+/**
+ * @brief Combine the healthy readings with the selected reducer.
+ * @return Combined soil moisture level.
+ */
+double SensorGroup::reduce() {
+    scratch.clear();
+    double weightedSum = 0.0;
+    double weightSum = 0.0;
+
+    for (const Probe& probe : probes) {
+        if (probe.sensor->isHealthy()) {
+            scratch.push_back(probe.moisture);
+            weightedSum += probe.weight * probe.moisture;
+            weightSum += probe.weight;
+        }
+    }
+
+    switch (reducer) {
+        case Reducer::MEDIAN: {
+            // Partial sort is enough to find the middle element(s)
+            size_t middle = scratch.size() / 2;
+            std::nth_element(scratch.begin(), scratch.begin() + middle, scratch.end());
+            double median = scratch[middle];
+            if (scratch.size() % 2 == 0) {
+                median = (median + *std::max_element(scratch.begin(), scratch.begin() + middle)) / 2.0;
+            }
+            return median;
+        }
+        case Reducer::MIN:
+            return *std::min_element(scratch.begin(), scratch.end());
+        case Reducer::WEIGHTED:
+            if (weightSum > 0.0) {
+                return weightedSum / weightSum;
+            }
+            break;
+        case Reducer::MEAN:
+            break;
+    }
+
+    // Plain average
+    double sum = 0.0;
+    for (double value : scratch) {
+        sum += value;
+    }
+    return sum / scratch.size();
+}
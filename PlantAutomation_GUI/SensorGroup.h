@@ -0,0 +1,168 @@
+#ifndef SENSORGROUP_H
+#define SENSORGROUP_H
+
+#include "SoilSensor.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The SensorGroup class combines the soil probes of one irrigation zone into a single reading.
+ * @details The probes are converted in a pipelined scan: one conversion is started on every ADC before
+ *          any result is collected, so probes on different ADCs convert in parallel and probes sharing
+ *          an ADC are taken in turns. Probes with excitation are sampled in the background instead, and
+ *          a result is only combined once all of them have finished. Probes flagged by their health
+ *          checks are left out of the result.
+ */
+class SensorGroup {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @enum Reducer
+     * @brief Function used to combine the probe readings.
+     */
+    enum class Reducer {
+        MEAN,           /**< Average of the healthy probes */
+        MEDIAN,         /**< Median of the healthy probes */
+        MIN,            /**< Driest healthy probe */
+        WEIGHTED        /**< Weighted average of the healthy probes */
+    };
+
+    /**
+     * @brief Constructor for SensorGroup.
+     * @param reducer Function used to combine the probe readings.
+     * @param minHealthyProbes Number of healthy probes needed for the group to be healthy.
+     */
+    SensorGroup(Reducer reducer = Reducer::MEAN, size_t minHealthyProbes = 1);
+
+    /**
+     * @brief Destructor for SensorGroup.
+     */
+    ~SensorGroup();
+
+    /**
+     * @brief Add a probe to the group.
+     * @param address I2C address of the ADC the probe is connected to.
+     * @param muxSelect Mux configuration of the probe.
+     * @param weight Weight of the probe for the WEIGHTED reducer.
+     * @return The new probe, e.g. to set its calibration values.
+     */
+    SoilSensor& addSensor(uint8_t address, ADS1115::Mux muxSelect, double weight = 1.0);
+
+    /**
+     * @brief Set the function used to combine the probe readings.
+     * @param reducer Reducer to use.
+     */
+    void setReducer(Reducer reducer);
+
+    /**
+     * @brief Convert every probe and combine the readings.
+     * @details Waits for the background samples of the probes with excitation.
+     * @return Combined soil moisture level.
+     */
+    double scan();
+
+    /**
+     * @brief Read the combined soil moisture, scanning only if the last scan is older than maxAge.
+     * @details A scan first starts the background samples of the probes with excitation and returns the
+     *          last result, a later call combines the readings once the samples are done. Only the very
+     *          first scan waits for them.
+     * @param maxAge Maximum age of a cached result that may be returned.
+     * @return Combined soil moisture level.
+     */
+    double readMoisture(std::chrono::milliseconds maxAge);
+
+    /**
+     * @brief Get the time of the last scan.
+     * @return Time of the last scan.
+     */
+    Clock::time_point getLastScanTime();
+
+    /**
+     * @brief Check whether enough probes are healthy.
+     * @return True if at least the minimum number of probes is healthy, false otherwise.
+     */
+    bool isHealthy();
+
+    /**
+     * @brief Get the number of healthy probes at the last scan.
+     * @return Number of healthy probes.
+     */
+    size_t getHealthyProbeCount();
+
+    /**
+     * @brief Get the number of probes in the group.
+     * @return Number of probes.
+     */
+    size_t getProbeCount() const;
+
+    /**
+     * @brief Tell every probe its zone is being irrigated.
+     */
+    void notifyIrrigation();
+
+    /**
+     * @brief Get the rate of change of the combined moisture.
+     * @return Rate of change in percent per hour.
+     */
+    double getMoistureSlope();
+
+    /**
+     * @brief Predict how long until the combined moisture drops to a threshold.
+     * @param threshold Moisture threshold in percent.
+     * @return Time until the threshold is reached, 0 if already below it, -1 if it is not falling.
+     */
+    std::chrono::seconds getTimeToThreshold(double threshold);
+
+private:
+    struct Probe {
+        std::unique_ptr<SoilSensor> sensor;     // Probe
+        double weight;                          // Weight for the WEIGHTED reducer
+        double moisture;                        // Reading of the last scan
+        bool sampled;                           // Sampled in the background during the current scan
+    };
+
+    std::vector<Probe> probes;                  // Probes of the zone
+    std::vector<std::vector<size_t>> adcQueues; // Probe indices per ADC, in scan order
+    std::vector<double> scratch;                // Healthy readings of the current scan
+    Reducer reducer;                            // Combining function
+    size_t minHealthyProbes;                    // Healthy probes needed for a valid reading
+
+    std::mutex scanMutex;                       // Serializes scans and guards the result
+    bool hasScan;                               // A scan result exists
+    double lastMoisture;                        // Combined reading of the last scan
+    size_t healthyProbes;                       // Healthy probes at the last scan
+    Clock::time_point lastScanTime;             // Time of the last scan
+    bool scanPending;                           // Background samples of the current scan are running
+    Clock::time_point scanStart;                // Time the current scan started
+    MoistureTrend trend;                        // Rate of change of the combined reading
+
+    /**
+     * @brief Start the background samples of the probes with excitation.
+     * @details Must be called with scanMutex held.
+     */
+    void startScan();
+
+    /**
+     * @brief Check whether the background samples of the current scan are done.
+     * @details Must be called with scanMutex held. Probes without a running sample are asked for one again.
+     * @return True if every sampled probe has a reading newer than the start of the scan.
+     */
+    bool samplesDone();
+
+    /**
+     * @brief Convert the remaining probes and combine the readings of the current scan.
+     * @details Must be called with scanMutex held. Waits for background samples that are still running.
+     * @return Combined soil moisture level.
+     */
+    double finishScan();
+
+    /**
+     * @brief Combine the healthy readings with the selected reducer.
+     * @return Combined soil moisture level.
+     */
+    double reduce();
+};
+
+#endif // SENSORGROUP_H
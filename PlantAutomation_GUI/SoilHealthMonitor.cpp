@@ -0,0 +1,159 @@
+#include "SoilHealthMonitor.h"
+
+/**
+ * @file SoilHealthMonitor.cpp
+ *
+ * @brief Implementation of the SoilHealthMonitor class.
+ */
+
+/**
+ * @brief Constructor for SoilHealthMonitor.
+ * @param windowSize Number of samples used for the variance window.
+ * @param stuckLimit Number of consecutive identical samples before the probe is considered stuck.
+ * @param railLimit Number of consecutive rail samples before the probe is considered open or shorted.
+ * @param railLow Raw values at or below this are treated as the low rail.
+ * @param railHigh Raw values at or above this are treated as the high rail.
+ * @param minVariance Variance below which a full window is considered stuck.
+ * @param stuckTime Time a run of identical samples may last before the probe is considered stuck.
+ */
+SoilHealthMonitor::SoilHealthMonitor(size_t windowSize, int stuckLimit, int railLimit,
+                                     int16_t railLow, int16_t railHigh, double minVariance,
+                                     std::chrono::milliseconds stuckTime) :
+        window(windowSize > 1 ? windowSize : 2, 0),
+        stuckLimit(stuckLimit),
+        stuckTime(stuckTime),
+        railLimit(railLimit),
+        railLow(railLow),
+        railHigh(railHigh),
+        minVariance(minVariance) {
+    reset();
+}
+
+/**
+ * @brief Add a raw sample and recompute the health state.
+ * @param rawValue Raw ADC value from the probe.
+ * @param now Time of the sample.
+ * @return Health state after the sample.
+ */
+SoilHealthMonitor::Status SoilHealthMonitor::update(int16_t rawValue, Clock::time_point now) {
+    // Remove the oldest sample from the running sums once the window is full
+    if (count == window.size()) {
+        int64_t oldest = window[head];
+        sum -= oldest;
+        sumSquares -= oldest * oldest;
+    } else {
+        count++;
+    }
+
+    // Add the new sample to the window
+    window[head] = rawValue;
+    head = (head + 1) % window.size();
+    sum += rawValue;
+    sumSquares += static_cast<int64_t>(rawValue) * rawValue;
+
+    // Count consecutive identical samples and remember when the run started
+    if (count > 1 && rawValue == lastValue) {
+        stuckCount++;
+    } else {
+        stuckCount = 0;
+        stuckSince = now;
+    }
+    lastValue = rawValue;
+
+    // A flat reading slows the sampling down, so a long enough run of three or more identical samples is stuck too
+    bool stuckTooLong = stuckCount >= 2 && now - stuckSince >= stuckTime;
+
+    // Count consecutive rail samples
+    lowRailCount = (rawValue <= railLow) ? lowRailCount + 1 : 0;
+    highRailCount = (rawValue >= railHigh) ? highRailCount + 1 : 0;
+
+    // Rail faults take priority over a stuck reading since a railed input is also constant
+    if (highRailCount >= railLimit) {
+        status = Status::OPEN;
+    } else if (lowRailCount >= railLimit) {
+        status = Status::SHORTED;
+    } else if (stuckCount >= stuckLimit || stuckTooLong ||
+               (count == window.size() && getVariance() < minVariance)) {
+        status = Status::STUCK;
+    } else {
+        status = Status::OK;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Clear all history and return to the OK state.
+ */
+void SoilHealthMonitor::reset() {
+    head = 0;
+    count = 0;
+    sum = 0;
+    sumSquares = 0;
+    lastValue = 0;
+    stuckCount = 0;
+    stuckSince = Clock::time_point();
+    lowRailCount = 0;
+    highRailCount = 0;
+    status = Status::OK;
+}
+
+/**
+ * @brief Get the current health state.
+ * @return Health state.
+ */
+SoilHealthMonitor::Status SoilHealthMonitor::getStatus() const {
+    return status;
+}
+
+/**
+ * @brief Check whether the probe is healthy.
+ * @return True if the state is OK, false otherwise.
+ */
+bool SoilHealthMonitor::isHealthy() const {
+    return status == Status::OK;
+}
+
+/**
+ * @brief Get the variance of the samples in the window.
+ * @return Variance in ADC codes squared.
+ */
+double SoilHealthMonitor::getVariance() const {
+    if (count < 2) {
+        return 0.0;
+    }
+
+    // Population variance from the running sums
+    double n = static_cast<double>(count);
+    double mean = sum / n;
+    double variance = sumSquares / n - mean * mean;
+
+    return variance > 0.0 ? variance : 0.0;
+}
+
+/**
+ * @brief Get the number of consecutive identical samples.
+ * @return Stuck counter.
+ */
+int SoilHealthMonitor::getStuckCount() const {
+    return stuckCount;
+}
+
+/**
+ * @brief Convert a health state to a printable string.
+ * @param status Health state.
+ * @return Name of the state.
+ */
+const char* SoilHealthMonitor::statusToString(Status status) {
+    switch (status) {
+        case Status::OK:
+            return "OK";
+        case Status::STUCK:
+            return "STUCK";
+        case Status::OPEN:
+            return "OPEN";
+        case Status::SHORTED:
+            return "SHORTED";
+    }
+    return "UNKNOWN";
+}
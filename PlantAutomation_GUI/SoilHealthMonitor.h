@@ -0,0 +1,111 @@
+#ifndef SOILHEALTHMONITOR_H
+#define SOILHEALTHMONITOR_H
+
+#include <stdint.h>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief The SoilHealthMonitor class tracks the health of a soil probe from its raw ADC samples.
+ * @details Every update is O(1): a ring buffer of the last samples keeps running sums for the variance,
+ *          consecutive rail hits are counted for open/shorted detection and consecutive identical codes
+ *          are counted for stuck detection. A run of identical codes also counts as stuck once it has lasted
+ *          the stuck time, so a probe that is sampled slowly because its reading is flat is still caught.
+ */
+class SoilHealthMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @enum Status
+     * @brief Health state of the probe.
+     */
+    enum class Status {
+        OK,             /**< Probe readings look plausible */
+        STUCK,          /**< Probe returns the same code (no variance) */
+        OPEN,           /**< Probe reads near full scale (disconnected / floating input) */
+        SHORTED         /**< Probe reads near zero (shorted input) */
+    };
+
+    /**
+     * @brief Constructor for SoilHealthMonitor.
+     * @param windowSize Number of samples used for the variance window.
+     * @param stuckLimit Number of consecutive identical samples before the probe is considered stuck.
+     * @param railLimit Number of consecutive rail samples before the probe is considered open or shorted.
+     * @param railLow Raw values at or below this are treated as the low rail.
+     * @param railHigh Raw values at or above this are treated as the high rail.
+     * @param minVariance Variance (in ADC codes squared) below which a full window is considered stuck.
+     * @param stuckTime Time a run of identical samples may last before the probe is considered stuck.
+     */
+    SoilHealthMonitor(size_t windowSize = 32, int stuckLimit = 30, int railLimit = 3,
+                      int16_t railLow = 0x0040, int16_t railHigh = 0x7FBF, double minVariance = 0.25,
+                      std::chrono::milliseconds stuckTime = std::chrono::minutes(10));
+
+    /**
+     * @brief Add a raw sample and recompute the health state.
+     * @param rawValue Raw ADC value from the probe.
+     * @param now Time of the sample.
+     * @return Health state after the sample.
+     */
+    Status update(int16_t rawValue, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Clear all history and return to the OK state.
+     */
+    void reset();
+
+    /**
+     * @brief Get the current health state.
+     * @return Health state.
+     */
+    Status getStatus() const;
+
+    /**
+     * @brief Check whether the probe is healthy.
+     * @return True if the state is OK, false otherwise.
+     */
+    bool isHealthy() const;
+
+    /**
+     * @brief Get the variance of the samples in the window.
+     * @return Variance in ADC codes squared.
+     */
+    double getVariance() const;
+
+    /**
+     * @brief Get the number of consecutive identical samples.
+     * @return Stuck counter.
+     */
+    int getStuckCount() const;
+
+    /**
+     * @brief Convert a health state to a printable string.
+     * @param status Health state.
+     * @return Name of the state.
+     */
+    static const char* statusToString(Status status);
+
+private:
+    std::vector<int16_t> window;    // Ring buffer of the last samples
+    size_t head;                    // Next write position in the ring buffer
+    size_t count;                   // Number of valid samples in the ring buffer
+    int64_t sum;                    // Running sum of the window
+    int64_t sumSquares;             // Running sum of squares of the window
+
+    int stuckLimit;                 // Consecutive identical samples before STUCK
+    std::chrono::milliseconds stuckTime;    // Duration of identical samples before STUCK
+    int railLimit;                  // Consecutive rail samples before OPEN/SHORTED
+    int16_t railLow;                // Low rail threshold
+    int16_t railHigh;               // High rail threshold
+    double minVariance;             // Minimum variance of a healthy full window
+
+    int16_t lastValue;              // Previous sample
+    int stuckCount;                 // Consecutive identical samples
+    Clock::time_point stuckSince;   // Time of the first sample of the identical run
+    int lowRailCount;               // Consecutive samples on the low rail
+    int highRailCount;              // Consecutive samples on the high rail
+    Status status;                  // Current health state
+};
+
+#endif // SOILHEALTHMONITOR_H
@@ -1,13 +1,15 @@
 // SoilSensor.cpp:
 #include "SoilSensor.h"
+#include "Logging.h"
 
 #include <iostream>
 #include <unistd.h>
 #include <iomanip>
 #include <chrono>
-#include <thread>
 #include <QMessageBox>
 
+// Time a conversion takes at 128 SPS, with some margin
+static const std::chrono::milliseconds CONVERSION_TIME(9);
 
 SoilSensor::SoilSensor(uint8_t address, ADS1115::Mux muxSelect) : ads1115(address, muxSelect) {
     // Set default values
@@ -15,25 +17,301 @@ SoilSensor::SoilSensor(uint8_t address, ADS1115::Mux muxSelect) : ads1115(addres
     moisture = 0.0;
     calWetValue = CAL_WET_DEFAULT;
     calDryValue = CAL_DRY_DEFAULT;
+    hasReading = false;
+    lastRawValue = 0;
+
+    // The probe is powered permanently until excitation is enabled, the chip pool and the timer service
+    // have to outlive the sensor
+    GpioChipPool::instance();
+    TimerService::instance();
+    excitationLine = nullptr;
+    settleTime = std::chrono::milliseconds(0);
+    oversampleCount = 1;
+    excitationOn = false;
+
+    sampling = false;
+    sampleToCache = false;
+    sampleConverting = false;
+    samplesLeft = 0;
+    sampleSum = 0;
+    sampleRaw = 0;
 }
 
 SoilSensor::~SoilSensor() {
-    // Nothing to destruct
+    // Waits for a running sample
+    disableExcitation();
+    TimerService::instance().cancelAll(this);
 }
 
 double SoilSensor::readMoisture() {
+    return readMoisture(std::chrono::milliseconds(0));
+}
+
+double SoilSensor::readMoisture(std::chrono::milliseconds maxAge) {
+    // Take the request time before waiting so a conversion that finishes while we wait satisfies us
+    Clock::time_point requestTime = Clock::now();
+
+    std::unique_lock<std::mutex> lock(readMutex);
+
+    // Only start a conversion if the cached reading is too old
+    bool stale = !hasReading || lastReadingTime + maxAge < requestTime;
+    if (excitationLine == nullptr) {
+        if (stale) {
+            convert();
+        }
+    } else {
+        if (stale && !sampling) {
+            startSample(true);
+        }
+
+        // Without any reading there is nothing to return yet
+        while (!hasReading) {
+            if (!sampling) {
+                startSample(true);
+            }
+            sampleDone.wait(lock);
+        }
+    }
+
+    moisture = rawToMoisture(lastRawValue);
+
+    return moisture;
+}
+
+void SoilSensor::requestSample() {
+    std::lock_guard<std::mutex> lock(readMutex);
+
+    if (excitationLine != nullptr && !sampling) {
+        startSample(true);
+    }
+}
+
+double SoilSensor::waitForSample() {
+    std::unique_lock<std::mutex> lock(readMutex);
+    sampleDone.wait(lock, [this]() { return !sampling; });
+
+    moisture = rawToMoisture(lastRawValue);
+
+    return moisture;
+}
+
+bool SoilSensor::hasExcitation() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return excitationLine != nullptr;
+}
+
+SoilSensor::Clock::time_point SoilSensor::getLastReadingTime() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return lastReadingTime;
+}
+
+void SoilSensor::beginConversion() {
+    readMutex.lock();
+    ads1115.startConversion(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128);
+}
+
+double SoilSensor::finishConversion() {
+    int16_t rawValue = oversample(ads1115.readConversion());
+
+    processReading(rawValue);
+    moisture = rawToMoisture(lastRawValue);
+    readMutex.unlock();
+
+    return moisture;
+}
+
+void SoilSensor::enableExcitation(int powerPin, std::chrono::milliseconds settleTime, int oversample) {
+    std::unique_lock<std::mutex> lock(readMutex);
+
+    // Let a running sample finish on the old line
+    sampleDone.wait(lock, [this]() { return !sampling; });
+
+    // Release a previously configured line, excitation stays off until the new one is requested
+    if (excitationLine != nullptr) {
+        GpioChipPool::instance().releaseLine(excitationLine);
+        excitationLine = nullptr;
+    }
+
+    excitationOn = false;
+    this->settleTime = std::chrono::milliseconds(0);
+    oversampleCount = 1;
+
+    // Get the GPIO line from the shared chip
+    gpiod_line* line = GpioChipPool::instance().acquireLine(powerPin);
+
+    // Configure the GPIO line as an output, probe unpowered
+    if (gpiod_line_request_output(line, "SoilSensor", 0) < 0) {
+        GpioChipPool::instance().releaseLine(line);
+
+        logger.logEvent("ERROR", "SoilSensor", "Couldn't request probe excitation pin " + std::to_string(powerPin) +
+                                               ", excitation disabled");
+        return;
+    }
+
+    excitationLine = line;
+    this->settleTime = settleTime;
+    oversampleCount = oversample > 0 ? oversample : 1;
+
+    logger.logEvent("INFO", "SoilSensor", "Probe excitation on pin " + std::to_string(powerPin) + ", settle " +
+                                          std::to_string(settleTime.count()) + " ms, " +
+                                          std::to_string(oversampleCount) + "x oversampling");
+}
+
+void SoilSensor::disableExcitation() {
+    std::unique_lock<std::mutex> lock(readMutex);
+    sampleDone.wait(lock, [this]() { return !sampling; });
+
+    if (excitationLine == nullptr) {
+        return;
+    }
+
+    gpiod_line_set_value(excitationLine, 0);
+    GpioChipPool::instance().releaseLine(excitationLine);
+
+    excitationLine = nullptr;
+    excitationOn = false;
+    settleTime = std::chrono::milliseconds(0);
+    oversampleCount = 1;
+}
+
+void SoilSensor::powerOn() {
+    if (excitationLine == nullptr || excitationOn) {
+        return;
+    }
+
+    gpiod_line_set_value(excitationLine, 1);
+    excitationOn = true;
+}
+
+void SoilSensor::powerOff() {
+    if (excitationLine == nullptr || !excitationOn) {
+        return;
+    }
+
+    gpiod_line_set_value(excitationLine, 0);
+    excitationOn = false;
+}
+
+uint8_t SoilSensor::getAddress() const {
+    return ads1115.getAddress();
+}
+
+void SoilSensor::convert() {
+    processReading(readRaw());
+}
+
+int16_t SoilSensor::readRaw() {
     // Read the analog input
-    int16_t rawValue = ads1115.read(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128);
+    return oversample(ads1115.read(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128));
+}
+
+int16_t SoilSensor::readCalibration(std::unique_lock<std::mutex>& lock) {
+    if (excitationLine == nullptr) {
+        return readRaw();
+    }
+
+    // Take a sample of our own once a running one is done
+    sampleDone.wait(lock, [this]() { return !sampling; });
+    startSample(false);
+    sampleDone.wait(lock, [this]() { return !sampling; });
+
+    return sampleRaw;
+}
+
+void SoilSensor::startSample(bool toCache) {
+    sampling = true;
+    sampleToCache = toCache;
+    sampleConverting = false;
+    samplesLeft = oversampleCount;
+    sampleSum = 0;
+
+    // Convert once the probe has settled
+    powerOn();
+    TimerService::instance().scheduleAfter(settleTime, [this]() {
+        sampleStep();
+    }, this);
+}
+
+void SoilSensor::sampleStep() {
+    std::lock_guard<std::mutex> lock(readMutex);
 
-    std::cout << "Soil Sensor Raw Value: " << rawValue << std::endl;
+    // Collect the conversion started by the previous step
+    if (sampleConverting) {
+        sampleSum += ads1115.readConversion();
+        sampleConverting = false;
+        samplesLeft--;
+    }
+
+    if (samplesLeft > 0) {
+        // A probe sharing the ADC may be converting, then just try again a conversion later
+        sampleConverting = ads1115.tryStartConversion(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT,
+                                                      ADS1115::DataRate::SPS_128);
+        TimerService::instance().scheduleAfter(CONVERSION_TIME, [this]() {
+            sampleStep();
+        }, this);
+        return;
+    }
+
+    // Remove the probe power again
+    powerOff();
+    sampleRaw = static_cast<int16_t>(sampleSum / oversampleCount);
+    if (sampleToCache) {
+        processReading(sampleRaw);
+    }
+
+    sampling = false;
+    sampleDone.notify_all();
+}
 
+int16_t SoilSensor::oversample(int16_t firstValue) {
+    int32_t sum = firstValue;
+    for (int i = 1; i < oversampleCount; i++) {
+        sum += ads1115.read(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128);
+    }
+
+    return static_cast<int16_t>(sum / oversampleCount);
+}
+
+void SoilSensor::processReading(int16_t rawValue) {
+    // Track the probe health and log every state change
+    Clock::time_point now = Clock::now();
+    SoilHealthMonitor::Status previousStatus = health.getStatus();
+    SoilHealthMonitor::Status status = health.update(rawValue, now);
+    if (status != previousStatus) {
+        logger.logEvent(status == SoilHealthMonitor::Status::OK ? "INFO" : "WARN", "SoilSensor",
+                        std::string("Probe health changed from ") + SoilHealthMonitor::statusToString(previousStatus) +
+                        " to " + SoilHealthMonitor::statusToString(status) + " (raw " + std::to_string(rawValue) + ")");
+    }
+
+    // Update the cache
+    lastRawValue = rawValue;
+    lastReadingTime = now;
+    hasReading = true;
+
+    // A faulty probe would only corrupt the fit and the calibration
+    if (!health.isHealthy()) {
+        return;
+    }
+
+    // Let the learner correct calibration drift and log every adjustment
+    int16_t previousWet = calWetValue;
+    int16_t previousDry = calDryValue;
+    if (learner.addSample(rawValue, lastReadingTime, calWetValue, calDryValue)) {
+        logger.logEvent("INFO", "SoilSensor", "Calibration drift corrected, wet " + std::to_string(previousWet) +
+                                              " -> " + std::to_string(calWetValue) + ", dry " +
+                                              std::to_string(previousDry) + " -> " + std::to_string(calDryValue));
+    }
+
+    // Feed the trend estimator
+    trend.addSample(rawToMoisture(rawValue), lastReadingTime);
+}
+
+double SoilSensor::rawToMoisture(int16_t rawValue) {
     // Map the voltage to a moisture value
-    moisture = map(rawValue, calDryValue, calWetValue, 0.0, 100.0);
+    double value = map(rawValue, calDryValue, calWetValue, 0.0, 100.0);
 
     // Constrain the moisture value to 0-100%
-    moisture = constrain(moisture, 0.0, 100.0);
-
-    return moisture;
+    return constrain(value, 0.0, 100.0);
 }
 
 bool SoilSensor::calibrate() {
@@ -45,12 +323,14 @@ bool SoilSensor::calibrate() {
     QMessageBox msgBox;
     msgBox.setText("Place sensor in air and press OK to continue...");
     msgBox.exec();
-    
-    // Read the analog input
-    int16_t rawValue = ads1115.read(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128);
 
-    // Set the dry calibration value
-    calDryValue = rawValue;
+    // Read the analog input (the lock is not held across the dialogs since the GUI keeps reading while they are open)
+    {
+        std::unique_lock<std::mutex> lock(readMutex);
+
+        // Set the dry calibration value
+        calDryValue = readCalibration(lock);
+    }
 
     // Tell user to place sensor in water
     // std::cout << "Place sensor in water and press ENTER to continue..." << std::endl;
@@ -61,30 +341,86 @@ bool SoilSensor::calibrate() {
     msgBox.exec();
 
     // Read the analog input
-    rawValue = ads1115.read(this->mux, ADS1115::Pga::FS_4_096V, ADS1115::Mode::SINGLE_SHOT, ADS1115::DataRate::SPS_128);
+    std::unique_lock<std::mutex> lock(readMutex);
 
     // Set the wet calibration value
-    calWetValue = rawValue;
+    calWetValue = readCalibration(lock);
+
+    // The probe has been handled, so start the health tracking over and drop the cached reading
+    health.reset();
+    trend.reset();
+    hasReading = false;
 
     return true;
 }
 
 void SoilSensor::setWetCalValue(int16_t wetValue) {
+    std::lock_guard<std::mutex> lock(readMutex);
     calWetValue = wetValue;
 }
 
 void SoilSensor::setDryCalValue(int16_t dryValue) {
+    std::lock_guard<std::mutex> lock(readMutex);
     calDryValue = dryValue;
 }
 
 int16_t SoilSensor::getWetCalValue() {
+    std::lock_guard<std::mutex> lock(readMutex);
     return calWetValue;
 }
 
 int16_t SoilSensor::getDryCalValue() {
+    std::lock_guard<std::mutex> lock(readMutex);
     return calDryValue;
 }
 
+double SoilSensor::getMoistureSlope() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return trend.getSlopePerHour();
+}
+
+std::chrono::seconds SoilSensor::getTimeToThreshold(double threshold) {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return trend.getTimeToThreshold(threshold);
+}
+
+void SoilSensor::resetTrend() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    trend.reset();
+}
+
+void SoilSensor::notifyIrrigation() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    trend.reset();
+    learner.notifyIrrigation(Clock::now());
+}
+
+void SoilSensor::enableCalibrationLearning(const CalibrationLearner::Bounds& bounds) {
+    std::lock_guard<std::mutex> lock(readMutex);
+    learner.enable(bounds);
+
+    logger.logEvent("INFO", "SoilSensor", "Calibration learning enabled, wet " + std::to_string(bounds.wetMin) + ".." +
+                                          std::to_string(bounds.wetMax) + ", dry " + std::to_string(bounds.dryMin) +
+                                          ".." + std::to_string(bounds.dryMax));
+}
+
+void SoilSensor::disableCalibrationLearning() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    learner.disable();
+
+    logger.logEvent("INFO", "SoilSensor", "Calibration learning disabled");
+}
+
+SoilHealthMonitor::Status SoilSensor::getHealthStatus() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return health.getStatus();
+}
+
+bool SoilSensor::isHealthy() {
+    std::lock_guard<std::mutex> lock(readMutex);
+    return health.isHealthy();
+}
+
 void SoilSensor::setWetCalValue(int16_t wetValue, SoilSensor* sensor) {
     sensor->setWetCalValue(wetValue);
 }
@@ -2,6 +2,16 @@
 #define SOILSENSOR_H
 
 #include "ADS1115.h"
+#include "SoilHealthMonitor.h"
+#include "MoistureTrend.h"
+#include "CalibrationLearner.h"
+#include "GpioChipPool.h"
+#include "TimerService.h"
+
+#include <gpiod.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 /**
  * @brief The SoilSensor class
@@ -21,12 +31,121 @@ public:
      */
     ~SoilSensor();
 
+    using Clock = std::chrono::steady_clock;
+
     /**
-     * @brief Read the soil moisture.
+     * @brief Read the soil moisture, always starting a new conversion.
+     * @details With excitation the conversion runs in the background, see readMoisture(maxAge).
      * @return Soil moisture level.
      */
     double readMoisture();
 
+    /**
+     * @brief Read the soil moisture, reusing the cached reading if it is recent enough.
+     * @details A conversion is only started when the cached reading is older than maxAge. Callers that
+     *          arrive while a conversion is in progress wait for it and share its result. With excitation
+     *          the sample runs on the timer thread and the cached reading is returned at once, only the
+     *          very first reading is waited for.
+     * @param maxAge Maximum age of a cached reading that may be returned.
+     * @return Soil moisture level.
+     */
+    double readMoisture(std::chrono::milliseconds maxAge);
+
+    /**
+     * @brief Start a powered sample in the background unless one is running.
+     * @details Does nothing without excitation.
+     */
+    void requestSample();
+
+    /**
+     * @brief Wait for the background sample to finish.
+     * @return Soil moisture level of the cached reading.
+     */
+    double waitForSample();
+
+    /**
+     * @brief Check whether the probe is powered only while it is sampled.
+     * @return True if excitation is enabled, false otherwise.
+     */
+    bool hasExcitation();
+
+    /**
+     * @brief Start a conversion as part of a pipelined scan.
+     * @details Only for probes without excitation. The sensor stays locked until finishConversion() is called,
+     *          which must follow on the same thread.
+     */
+    void beginConversion();
+
+    /**
+     * @brief Collect the conversion started by beginConversion() and update the cache.
+     * @return Soil moisture level.
+     */
+    double finishConversion();
+
+    /**
+     * @brief Power the probe from a GPIO line only while it is sampled.
+     * @details Every sample switches the line on, waits the settling time, takes the oversampled
+     *          conversion and switches the line off again. The steps are scheduled on the timer
+     *          service, so nothing sleeps while the probe settles. If the line can't be requested the
+     *          error is logged and excitation stays disabled.
+     * @param powerPin GPIO pin number of the probe power line.
+     * @param settleTime Time the probe needs after power-up before it reads correctly.
+     * @param oversample Number of conversions averaged per sample.
+     */
+    void enableExcitation(int powerPin, std::chrono::milliseconds settleTime, int oversample);
+
+    /**
+     * @brief Stop switching the probe power and release the GPIO line.
+     */
+    void disableExcitation();
+
+    /**
+     * @brief Get the address of the ADC the sensor is connected to.
+     * @return I2C address of the ADC the sensor is connected to.
+     */
+    uint8_t getAddress() const;
+
+    /**
+     * @brief Get the time of the last conversion.
+     * @return Time the cached reading was taken.
+     */
+    Clock::time_point getLastReadingTime();
+
+    /**
+     * @brief Get the rate of change of the soil moisture.
+     * @return Fitted rate of change in percent per hour, 0 if no estimate exists yet.
+     */
+    double getMoistureSlope();
+
+    /**
+     * @brief Predict how long until the soil moisture drops to a threshold.
+     * @param threshold Moisture threshold in percent.
+     * @return Time until the threshold is reached, 0 if already below it, -1 if it is not falling.
+     */
+    std::chrono::seconds getTimeToThreshold(double threshold);
+
+    /**
+     * @brief Restart the moisture trend, e.g. when irrigation starts.
+     */
+    void resetTrend();
+
+    /**
+     * @brief Tell the sensor its zone is being irrigated.
+     * @details Restarts the moisture trend and opens the saturation peak window of the calibration learner.
+     */
+    void notifyIrrigation();
+
+    /**
+     * @brief Enable automatic drift correction of the calibration values.
+     * @param bounds Allowed range of the learned wet and dry calibration values.
+     */
+    void enableCalibrationLearning(const CalibrationLearner::Bounds& bounds);
+
+    /**
+     * @brief Disable automatic drift correction of the calibration values.
+     */
+    void disableCalibrationLearning();
+
     /**
      * @brief Calibrate the soil sensor.
      * @return True if calibration was successful, false otherwise.
@@ -71,6 +190,18 @@ public:
      */
     int16_t getDryCalValue();
 
+    /**
+     * @brief Get the health state of the probe.
+     * @return Health state computed from the most recent samples.
+     */
+    SoilHealthMonitor::Status getHealthStatus();
+
+    /**
+     * @brief Check whether the probe is healthy.
+     * @return True if the probe is not stuck, open or shorted, false otherwise.
+     */
+    bool isHealthy();
+
     /**
      * @brief Create the analog to digital object.
      * @return Analog to digital object.
@@ -85,6 +216,91 @@ private:
     double moisture;                                // Moisture level
     int16_t calWetValue;                            // Calibration value for wet soil
     int16_t calDryValue;                            // Calibration value for dry soil
+    SoilHealthMonitor health;                       // Probe health tracking
+
+    std::mutex readMutex;                           // Serializes conversions and guards the cache
+    bool hasReading;                                // A cached reading exists
+    int16_t lastRawValue;                           // Cached raw reading
+    Clock::time_point lastReadingTime;              // Time the cached reading was taken
+    MoistureTrend trend;                            // Rate of change estimator
+    CalibrationLearner learner;                     // Calibration drift correction
+
+    gpiod_line* excitationLine;                     // Probe power line, nullptr without excitation
+    std::chrono::milliseconds settleTime;           // Settling time after power-up
+    int oversampleCount;                            // Conversions averaged per sample
+    bool excitationOn;                              // Probe power is on
+
+    std::condition_variable sampleDone;             // Signalled when a background sample finishes
+    bool sampling;                                  // A background sample is running
+    bool sampleToCache;                             // The running sample updates the cache, false while calibrating
+    bool sampleConverting;                          // The running sample has a conversion in progress
+    int samplesLeft;                                // Conversions the running sample still needs
+    int32_t sampleSum;                              // Sum of the conversions of the running sample
+    int16_t sampleRaw;                              // Raw value of the last finished sample
+
+    /**
+     * @brief Run a conversion and update the cache and the health tracking.
+     * @details Must be called with readMutex held.
+     */
+    void convert();
+
+    /**
+     * @brief Take an oversampled reading of a permanently powered probe.
+     * @details Must be called with readMutex held.
+     * @return Raw ADC value.
+     */
+    int16_t readRaw();
+
+    /**
+     * @brief Take an oversampled reading for calibration, without updating the cache.
+     * @details Waits for a powered sample when excitation is enabled.
+     * @param lock Lock holding readMutex.
+     * @return Raw ADC value.
+     */
+    int16_t readCalibration(std::unique_lock<std::mutex>& lock);
+
+    /**
+     * @brief Power the probe and schedule the first step of a background sample.
+     * @details Must be called with readMutex held.
+     * @param toCache Update the cache with the result.
+     */
+    void startSample(bool toCache);
+
+    /**
+     * @brief Timer callback: collect the pending conversion, start the next one or finish the sample.
+     */
+    void sampleStep();
+
+    /**
+     * @brief Switch the probe power on.
+     */
+    void powerOn();
+
+    /**
+     * @brief Switch the probe power off.
+     */
+    void powerOff();
+
+    /**
+     * @brief Take the remaining conversions of an oversampled sample.
+     * @param firstValue Result of the first conversion.
+     * @return Average of all conversions of the sample.
+     */
+    int16_t oversample(int16_t firstValue);
+
+    /**
+     * @brief Update the cache, the health tracking, the learner and the trend with a new reading.
+     * @details Must be called with readMutex held.
+     * @param rawValue Raw ADC value.
+     */
+    void processReading(int16_t rawValue);
+
+    /**
+     * @brief Convert a raw reading to a moisture level using the calibration values.
+     * @param rawValue Raw ADC value.
+     * @return Soil moisture level.
+     */
+    double rawToMoisture(int16_t rawValue);
 
 
     /**
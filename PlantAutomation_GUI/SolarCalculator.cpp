@@ -0,0 +1,132 @@
+#include "SolarCalculator.h"
+
+#include <cmath>
+
+/**
+ * @file SolarCalculator.cpp
+ *
+ * @brief Implementation of the SolarCalculator class.
+ */
+
+/**
+ * @brief Constructor for SolarCalculator.
+ * @param latitude Latitude in degrees, north positive.
+ * @param longitude Longitude in degrees, east positive.
+ */
+SolarCalculator::SolarCalculator(double latitude, double longitude) {
+    setLocation(latitude, longitude);
+}
+
+/**
+ * @brief Set the location, clearing the cache.
+ * @param latitude Latitude in degrees, north positive.
+ * @param longitude Longitude in degrees, east positive.
+ */
+void SolarCalculator::setLocation(double latitude, double longitude) {
+    this->latitude = latitude;
+    this->longitude = longitude;
+
+    for (CacheEntry& entry : cache) {
+        entry.day = -1;
+    }
+    nextEntry = 0;
+}
+
+/**
+ * @brief Get the latitude.
+ * @return Latitude in degrees, north positive.
+ */
+double SolarCalculator::getLatitude() const {
+    return latitude;
+}
+
+/**
+ * @brief Get the longitude.
+ * @return Longitude in degrees, east positive.
+ */
+double SolarCalculator::getLongitude() const {
+    return longitude;
+}
+
+/**
+ * @brief Get the sunrise and sunset of the local day containing a time.
+ * @param time Time in the day.
+ * @return Sunrise and sunset of the day.
+ */
+SolarCalculator::SunTimes SolarCalculator::getSunTimes(time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    long day = (local.tm_year + 1900) * 1000L + local.tm_yday + 1;
+
+    for (const CacheEntry& entry : cache) {
+        if (entry.day == day) {
+            return entry.times;
+        }
+    }
+
+    SunTimes times = compute(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_yday + 1);
+
+    // Replace the oldest entry
+    cache[nextEntry].day = day;
+    cache[nextEntry].times = times;
+    nextEntry = (nextEntry + 1) % CACHE_DAYS;
+
+    return times;
+}
+
+/**
+ * @brief Compute the sunrise and sunset of a date.
+ * @param year Calendar year.
+ * @param month Month, 1 to 12.
+ * @param dayOfMonth Day of the month.
+ * @param dayOfYear Day of the year, 1 for January 1st.
+ * @return Sunrise and sunset of the date.
+ */
+SolarCalculator::SunTimes SolarCalculator::compute(int year, int month, int dayOfMonth, int dayOfYear) const {
+    const double pi = 3.14159265358979323846;
+    const double degrees = pi / 180.0;
+
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+
+    // Fractional year at noon in radians
+    double gamma = 2.0 * pi / (leap ? 366.0 : 365.0) * (dayOfYear - 1);
+
+    // Equation of time in minutes and solar declination in radians
+    double equationOfTime = 229.18 * (0.000075 + 0.001868 * std::cos(gamma) - 0.032077 * std::sin(gamma) -
+                                      0.014615 * std::cos(2.0 * gamma) - 0.040849 * std::sin(2.0 * gamma));
+    double declination = 0.006918 - 0.399912 * std::cos(gamma) + 0.070257 * std::sin(gamma) -
+                         0.006758 * std::cos(2.0 * gamma) + 0.000907 * std::sin(2.0 * gamma) -
+                         0.002697 * std::cos(3.0 * gamma) + 0.00148 * std::sin(3.0 * gamma);
+
+    // Hour angle of the sun at the horizon, corrected for refraction and the solar disc
+    double latitudeRad = latitude * degrees;
+    double cosHourAngle = std::cos(90.833 * degrees) / (std::cos(latitudeRad) * std::cos(declination)) -
+                          std::tan(latitudeRad) * std::tan(declination);
+
+    SunTimes times = {};
+    if (cosHourAngle < -1.0) {
+        times.polarDay = true;
+        return times;
+    }
+    if (cosHourAngle > 1.0) {
+        times.polarNight = true;
+        return times;
+    }
+
+    double hourAngle = std::acos(cosHourAngle) / degrees;
+
+    // Minutes after 00:00 UTC of the date
+    double sunriseMinutes = 720.0 - 4.0 * (longitude + hourAngle) - equationOfTime;
+    double sunsetMinutes = 720.0 - 4.0 * (longitude - hourAngle) - equationOfTime;
+
+    struct tm utc = {};
+    utc.tm_year = year - 1900;
+    utc.tm_mon = month - 1;
+    utc.tm_mday = dayOfMonth;
+    time_t midnight = timegm(&utc);
+
+    times.sunrise = midnight + static_cast<time_t>(std::lround(sunriseMinutes * 60.0));
+    times.sunset = midnight + static_cast<time_t>(std::lround(sunsetMinutes * 60.0));
+
+    return times;
+}
@@ -0,0 +1,83 @@
+#ifndef SOLARCALCULATOR_H
+#define SOLARCALCULATOR_H
+
+#include <array>
+#include <ctime>
+
+/**
+ * @brief The SolarCalculator class computes sunrise and sunset offline for a fixed location.
+ * @details Uses the NOAA general solar position equations (fractional year, equation of time and declination)
+ *          with the standard refraction-corrected zenith of 90.833°, accurate to about a minute between the polar
+ *          circles. Results are cached per local day, so asking repeatedly for the same day costs a lookup.
+ */
+class SolarCalculator {
+public:
+    /**
+     * @struct SunTimes
+     * @brief Sunrise and sunset of one local day.
+     */
+    struct SunTimes {
+        time_t sunrise;         // Time of sunrise, 0 if the sun does not rise or set
+        time_t sunset;          // Time of sunset, 0 if the sun does not rise or set
+        bool polarDay;          // The sun stays above the horizon all day
+        bool polarNight;        // The sun stays below the horizon all day
+    };
+
+    /**
+     * @brief Constructor for SolarCalculator.
+     * @param latitude Latitude in degrees, north positive.
+     * @param longitude Longitude in degrees, east positive.
+     */
+    SolarCalculator(double latitude = 0.0, double longitude = 0.0);
+
+    /**
+     * @brief Set the location, clearing the cache.
+     * @param latitude Latitude in degrees, north positive.
+     * @param longitude Longitude in degrees, east positive.
+     */
+    void setLocation(double latitude, double longitude);
+
+    /**
+     * @brief Get the latitude.
+     * @return Latitude in degrees, north positive.
+     */
+    double getLatitude() const;
+
+    /**
+     * @brief Get the longitude.
+     * @return Longitude in degrees, east positive.
+     */
+    double getLongitude() const;
+
+    /**
+     * @brief Get the sunrise and sunset of the local day containing a time.
+     * @param time Time in the day.
+     * @return Sunrise and sunset of the day.
+     */
+    SunTimes getSunTimes(time_t time);
+
+private:
+    static const size_t CACHE_DAYS = 8;         // Days kept in the cache
+
+    struct CacheEntry {
+        long day;                               // Local date as year * 1000 + day of year, -1 if unused
+        SunTimes times;                         // Sun times of the day
+    };
+
+    double latitude;                            // Latitude in degrees
+    double longitude;                           // Longitude in degrees
+    std::array<CacheEntry, CACHE_DAYS> cache;   // Recently computed days
+    size_t nextEntry;                           // Cache entry replaced next
+
+    /**
+     * @brief Compute the sunrise and sunset of a date.
+     * @param year Calendar year.
+     * @param month Month, 1 to 12.
+     * @param dayOfMonth Day of the month.
+     * @param dayOfYear Day of the year, 1 for January 1st.
+     * @return Sunrise and sunset of the date.
+     */
+    SunTimes compute(int year, int month, int dayOfMonth, int dayOfYear) const;
+};
+
+#endif // SOLARCALCULATOR_H
@@ -1,6 +1,9 @@
 // SystemController.cpp
 #include "SystemController.h"
 
+#include <functional>
+#include <limits>
+
 
 
 /**
@@ -25,7 +28,27 @@ SystemController::SystemController(uint8_t soilSensorAddress, ADS1115::Mux soilS
                                    int waterPumpPin, int pumpIgnoreTimeSeconds, int pumpDurationSeconds) :
         soilSensor(soilSensorAddress, soilSensorMux),
         lightController(lightControllerPin, lightOnTime, lightOffTime),
-        waterPump(waterPumpPin, pumpIgnoreTimeSeconds, pumpDurationSeconds) {
+        waterPump(waterPumpPin, pumpIgnoreTimeSeconds, pumpDurationSeconds),
+        lightOutput([this]() { return lightController.isOn(); },
+                    [this](bool on) {
+                        if (on) {
+                            lightController.turnOn();
+                        } else {
+                            lightController.turnOff();
+                        }
+                        return true;
+                    }),
+        pumpOutput([this]() { return waterPump.getStatus(); },
+                   [this](bool on) {
+                       if (!on) {
+                           waterPump.deactivate();
+                           return true;
+                       }
+
+                       // A manual override ends the lockout, a fault still blocks the pump
+                       waterPump.clearLockout();
+                       return waterPump.activate();
+                   }) {
     // Set the initial soil moisture threshold
     soilMoistureThreshold = 0.0;
 
@@ -33,15 +56,38 @@ SystemController::SystemController(uint8_t soilSensorAddress, ADS1115::Mux soilS
     this->lightOnTime = lightOnTime;
     this->lightOffTime = lightOffTime;
 
-    // Set the initial water pump on and off times
-    waterPumpOnTime = lightOnTime;
-    waterPumpOffTime = lightOffTime;
+    // No sensor fault until the probe reports one
+    sensorFaultActive = false;
+
+    // Water for the pump duration until a dose volume is set
+    pumpDoseVolume = 0.0;
+
+    // Water in a single pulse until pulse-soak mode is set
+    pulseSoakPulses = 1;
+    pulseSoakTime = std::chrono::seconds(0);
+    pulseSoakTarget = 0.0;
+    latestMoisture = 0.0;
+    latestHealthy = false;
+
+    // Make sure the pump scheduler outlives the controller
+    PumpScheduler::instance();
 
-    // Set the initial water pump ignore time
-    pumpIgnoreTime = pumpIgnoreTimeSeconds;
+    // Queue waterings at the default priority
+    pumpPriority = 0;
+    pumpRequest = 0;
+    wateringQueued = false;
+    manualRequest = 0;
+    manualQueued = false;
+    wateringStarted = false;
+    wateringBaseline = 0.0;
 
-    // Set the initial water pump activation duration
-    pumpDuration = pumpDurationSeconds;
+    // Use the single soil sensor until a probe group is attached
+    sensorGroup = nullptr;
+
+    // Log the scheduled light switches, called on the timer thread
+    lightController.setTransitionListener([this](bool on) {
+        logger.logEvent("INFO", "SystemController" + id, on ? "Light activated" : "Light deactivated");
+    });
 
     // grab the smallest unit of time possible and use it to create an ID for use in the logger
     time_t currentTime;
@@ -57,6 +103,14 @@ SystemController::SystemController(uint8_t soilSensorAddress, ADS1115::Mux soilS
  */
 SystemController::~SystemController() {
 
+    // Keep the scheduled light switches from calling into the destroyed controller
+    lightController.stopSchedule();
+    lightController.setTransitionListener(nullptr);
+
+    // A queued watering would start on the destroyed controller when another pump stops
+    cancelWatering();
+    cancelManualRun();
+
     // log the destruction inlcuding the ID
     logger.logEvent("INFO", "SystemController" + id, "SystemController destroyed");  
     
@@ -79,76 +133,259 @@ void SystemController::deactivateGarden(const time_t currentTime) {
 }
 
 /**
- * @brief Control the light based on the current time.
- * @details The light will be activated if the current time is within the light activation time.
- * @param currentTime Current time.
+ * @brief Let the light follow its daily schedule or hand it to manual control.
+ * @details The light controller wakes up at the next on or off transition by itself, no periodic call is needed.
+ * @param automatic True to follow the schedule, false to keep the light as it is.
  */
-void SystemController::controlLight(const time_t currentTime) {
-    // Check if the current time is within the light activation time
-    if (isTimeInRange(currentTime, lightOnTime, lightOffTime)) {
-        lightController.turnOn();
-
-        // Log the light activation
-        logger.logEvent("INFO", "SystemController" + id, "Light activated");
+void SystemController::setLightAutomatic(bool automatic) {
+    if (automatic == lightController.isScheduleEnabled()) {
+        return;
+    }
 
+    if (automatic) {
+        lightController.startSchedule();
     } else {
-        lightController.turnOff();
-
-        // Log the light deactivation
-        logger.logEvent("INFO", "SystemController" + id, "Light deactivated");
+        lightController.stopSchedule();
     }
 
+    // Log the light mode change
+    logger.logEvent("INFO", "SystemController" + id, automatic ? "Light follows the daily schedule" :
+                                                                 "Light under manual control");
+}
 
-    // if (currentTime > lightOffTime) {
-    //     lightOnTime = addSecondsToTime(currentTime, 86400);
-    //     lightOffTime = addSecondsToTime(lightOnTime, 86400);
-
-    //     // cout update time information
-    //     std::cout << "UPDATED Light On Time: " << ctime(&lightOnTime) << std::endl;
-    //     std::cout << "UPDATED Light Off Time: " << ctime(&lightOffTime) << std::endl;
-    // }
+/**
+ * @brief Get the time of the next scheduled light transition.
+ * @return Time of the next transition, 0 if the light is under manual control or has no schedule.
+ */
+time_t SystemController::getNextLightTransition() {
+    return lightController.getNextTransitionTime();
 }
 
 /**
- * @brief Control the water pump based on the current time.
- * @details The water pump will be activated if the current time is within the water pump activation time and the soil
- *         moisture is below the threshold.
- * @param currentTime Current time.
+ * @brief Control the water pump based on the soil moisture.
+ * @details The water pump will be pulsed if the soil moisture is below the threshold and the pump is idle. The pump
+ *         stops itself when the pulse ends and rejects activation until its lockout has passed.
+ * @param currentTime Current time, unused since the pump and the scheduler keep their own time.
  */
-void SystemController::controlWaterPump(const time_t currentTime) {
+void SystemController::controlWaterPump([[maybe_unused]] const time_t currentTime) {
+    double moisture = readSoilMoisture();
+
+    // A faulty probe reads as dry soil, so take the zone out of automatic watering
+    if (!isSoilReadingHealthy()) {
+        if (!sensorFaultActive) {
+            sensorFaultActive = true;
+            pumpOutput.reconcile(false);
+
+            // The response of the running activation can't be judged without the sensor
+            dryRunDetector.discardWindow();
+
+            // Give up a watering that is still waiting for the pump scheduler
+            cancelWatering();
+
+            // Log the sensor fault
+            logger.logEvent("WARN", "SystemController" + id, sensorGroup != nullptr ?
+                            std::string("Not enough healthy probes, automatic watering suspended") :
+                            std::string("Soil sensor fault (") +
+                            SoilHealthMonitor::statusToString(soilSensor.getHealthStatus()) +
+                            "), automatic watering suspended");
+        }
+    } else {
+        if (sensorFaultActive) {
+            sensorFaultActive = false;
+
+            // Log the sensor recovery
+            logger.logEvent("INFO", "SystemController" + id, "Soil sensor recovered, automatic watering resumed");
+        }
 
-    // Check if the current time is within the water pump activation time
-    if (isTimeInRange(currentTime, waterPumpOnTime, waterPumpOffTime)) {
-        // Check if the soil moisture is below the threshold
-        if (readSoilMoisture() < soilMoistureThreshold) {
-            waterPump.activate();
+        // Check that the last activation reached the soil
+        if (dryRunDetector.addSample(moisture, DryRunDetector::Clock::now())) {
+            waterPump.setFault();
 
-            // Log the water pump activation
-            logger.logEvent("INFO", "SystemController" + id, "Water pump activated");
+            // Log the dry-run fault
+            logger.logEvent("WARN", "SystemController" + id, "Moisture did not rise after " +
+                            std::to_string(dryRunDetector.getMissedActivations()) +
+                            " pump activations, pump faulted (empty reservoir or clogged line?)");
         }
-    } else {
-        waterPump.deactivate();
+    }
 
-        // Log the water pump deactivation
-        logger.logEvent("INFO", "SystemController" + id, "Water pump deactivated");
+    // Pick up a watering the pump scheduler started since the last tick
+    if (wateringStarted.exchange(false)) {
+        // The drying trend ends here and the saturation peak follows
+        notifySoilIrrigation();
+
+        // Expect the moisture to rise within the response window
+        dryRunDetector.notifyActivation(wateringBaseline, DryRunDetector::Clock::now());
+
+        // Log the water pump activation
+        logger.logEvent("INFO", "SystemController" + id, "Water pump started: " +
+                        (pulseSoakPulses > 1 ? std::to_string(pulseSoakPulses) + " pulse-soak pulses of " : std::string()) +
+                        (pumpDoseVolume > 0.0 ? std::to_string(pumpDoseVolume) + " ml" :
+                                                std::to_string(waterPump.getActivationDuration()) + " s"));
     }
 
-    // Check if the current time is past the water pump off time
-    if (currentTime > this->waterPumpOffTime) {
-        this->waterPumpOnTime = addSecondsToTime(currentTime, this->pumpIgnoreTime);
-        this->waterPumpOffTime = addSecondsToTime(this->waterPumpOnTime, this->pumpDuration);
+    // Check if the soil moisture is below the threshold, the pump refuses to run during its lockout
+    if (!sensorFaultActive && moisture < soilMoistureThreshold && !wateringQueued &&
+        waterPump.getState() == WaterPump::State::IDLE) {
+        // The settings are copied here, the scheduler may start the watering on the timer thread
+        WateringPlan plan;
+        plan.doseVolume = pumpDoseVolume;
+        plan.pulses = pulseSoakPulses;
+        plan.soakTime = pulseSoakTime;
+        plan.target = pulseSoakTarget > 0.0 ? pulseSoakTarget : soilMoistureThreshold;
+
+        // The scheduler starts the pump as soon as the supply budget allows
+        wateringQueued = true;
+        wateringBaseline = moisture;
+        pumpRequest = PumpScheduler::instance().request(waterPump, pumpPriority, PumpScheduler::Clock::now(),
+                                                        [this, plan]() {
+            bool started = startWatering(plan);
+            wateringStarted = started;
+            wateringQueued = false;
+            return started;
+        });
+
+        if (pumpRequest == 0) {
+            wateringQueued = false;
+        } else if (wateringQueued) {
+            // Log the queued watering
+            logger.logEvent("INFO", "SystemController" + id, "Water pump waiting for supply budget");
+        }
+    }
+}
+
+/**
+ * @brief Give up a watering that is still waiting for the pump scheduler.
+ */
+void SystemController::cancelWatering() {
+    if (wateringQueued && PumpScheduler::instance().cancel(pumpRequest)) {
+        wateringQueued = false;
 
-        // Log the water pump time update
-        logger.logEvent("INFO", "SystemController" + id, "Water pump time updated");
+        // Log the cancelled watering
+        logger.logEvent("INFO", "SystemController" + id, "Queued watering cancelled");
     }
 }
 
 /**
  * @brief Read soil moisture from the soil sensor.
+ * @details The sensor's cached reading is reused while it is younger than the adaptive sampling interval,
+ *          so the GUI and the control loop share one conversion per interval. A running pump keeps the
+ *          sampler at its fast rate.
  * @return Soil moisture level.
  */
 double SystemController::readSoilMoisture() {
-    return soilSensor.readMoisture();
+    AdaptiveSampler::Clock::time_point now = AdaptiveSampler::Clock::now();
+
+    // Sample fast while irrigating so the moisture rise is captured
+    if (waterPump.getStatus()) {
+        soilSampler.notifyIrrigation(now);
+    }
+
+    // Read the probe group of the zone if one is attached
+    if (sensorGroup != nullptr) {
+        SensorGroup::Clock::time_point previousScan = sensorGroup->getLastScanTime();
+        double moisture = sensorGroup->readMoisture(soilSampler.getInterval());
+
+        // Adapt the interval whenever a new scan was taken
+        if (sensorGroup->getLastScanTime() != previousScan) {
+            soilSampler.recordSample(moisture, sensorGroup->getLastScanTime());
+        }
+
+        latestMoisture = moisture;
+        latestHealthy = sensorGroup->isHealthy();
+
+        return moisture;
+    }
+
+    double moisture = soilSensor.readMoisture(soilSampler.getInterval());
+
+    // Adapt the interval whenever a new reading arrived, a powered probe delivers it on a later call
+    SoilSensor::Clock::time_point readingTime = soilSensor.getLastReadingTime();
+    if (readingTime != sampledReadingTime) {
+        soilSampler.recordSample(moisture, readingTime);
+        sampledReadingTime = readingTime;
+    }
+
+    latestMoisture = moisture;
+    latestHealthy = soilSensor.isHealthy();
+
+    return moisture;
+}
+
+/**
+ * @brief Use a group of probes instead of the single soil sensor for the zone moisture.
+ * @param group Probe group of the zone, or nullptr to go back to the single soil sensor. Not owned.
+ */
+void SystemController::attachSensorGroup(SensorGroup* group) {
+
+    // Log the sensor source change
+    logger.logEvent("INFO", "SystemController" + id, group != nullptr ?
+                    "Soil moisture read from a group of " + std::to_string(group->getProbeCount()) + " probes" :
+                    std::string("Soil moisture read from the soil sensor"));
+
+    sensorGroup = group;
+}
+
+/**
+ * @brief Check whether the zone's moisture reading can be trusted.
+ * @return True if the soil sensor (or enough probes of the group) is healthy, false otherwise.
+ */
+bool SystemController::isSoilReadingHealthy() {
+    return sensorGroup != nullptr ? sensorGroup->isHealthy() : soilSensor.isHealthy();
+}
+
+/**
+ * @brief Tell the zone's sensors that irrigation is starting.
+ */
+void SystemController::notifySoilIrrigation() {
+    if (sensorGroup != nullptr) {
+        sensorGroup->notifyIrrigation();
+    } else {
+        soilSensor.notifyIrrigation();
+    }
+}
+
+/**
+ * @brief Start one watering of the zone with the given duration or volume and pulse-soak mode.
+ * @param plan Settings of the watering.
+ * @return True if the pump started, false if it was rejected or is not calibrated.
+ */
+bool SystemController::startWatering(const WateringPlan& plan) {
+    if (plan.pulses > 1) {
+        // Stop between pulses once the soil is wet enough or the reading can't be trusted
+        double target = plan.target;
+        WaterPump::ContinueCheck check = [this, target]() {
+            return latestHealthy && latestMoisture < target;
+        };
+        std::chrono::milliseconds soak = plan.soakTime;
+
+        if (plan.doseVolume > 0.0) {
+            return waterPump.dose(plan.doseVolume, plan.pulses, soak, check);
+        }
+
+        std::chrono::milliseconds pulseTime = std::chrono::seconds(waterPump.getActivationDuration());
+        return waterPump.pulseSoak(pulseTime / plan.pulses, plan.pulses, soak, check);
+    }
+
+    if (plan.doseVolume > 0.0) {
+        return waterPump.dose(plan.doseVolume);
+    }
+
+    return waterPump.pulse();
+}
+
+/**
+ * @brief Set the adaptive soil sensor sampling intervals.
+ * @param fastInterval Sampling interval while the moisture changes or the pump runs.
+ * @param slowInterval Longest sampling interval while the moisture is flat.
+ */
+void SystemController::setSamplingIntervals(std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval) {
+
+    // Log the sampling interval update
+    logger.logEvent("INFO", "SystemController" + id, "Soil sampling intervals set to " +
+                                                     std::to_string(fastInterval.count()) + " ms / " +
+                                                     std::to_string(slowInterval.count()) + " ms");
+
+    soilSampler.setIntervals(fastInterval, slowInterval);
 }
 
 /**
@@ -163,6 +400,14 @@ bool SystemController::calibrateSoilSensor() {
     return soilSensor.calibrate();
 }
 
+/**
+ * @brief Get the health state of the soil sensor.
+ * @return Health state of the soil sensor probe.
+ */
+SoilHealthMonitor::Status SystemController::getSoilSensorHealth() {
+    return soilSensor.getHealthStatus();
+}
+
 /**
  * @brief Set the soil moisture threshold.
  * @param threshold Threshold value.
@@ -187,6 +432,7 @@ double SystemController::getSoilMoistureThreshold() {
 
 /**
  * @brief Set the time to turn on the light after activation.
+ * @details Only the time of day is used, the light schedule repeats daily.
  * @param lightOnTime Time to turn on the light.
  */
 void SystemController::setLightOnTime(const time_t lightOnTime) {
@@ -197,11 +443,13 @@ void SystemController::setLightOnTime(const time_t lightOnTime) {
                                                      std::to_string(lightOnTime));
 
     this->lightOnTime = lightOnTime;
+    lightController.setDailyOn(lightOnTime);
 
 }
 
 /**
  * @brief Set the time to turn off the light after activation.
+ * @details Only the time of day is used, the light schedule repeats daily.
  * @param lightOffTime Time to turn off the light.
  */
 void SystemController::setLightOffTime(const time_t lightOffTime) {
@@ -212,50 +460,88 @@ void SystemController::setLightOffTime(const time_t lightOffTime) {
                                                      std::to_string(lightOffTime));
 
     this->lightOffTime = lightOffTime;
+    lightController.setDailyOff(lightOffTime);
 }
 
 /**
- * @brief Get the time to turn on the light after activation.
- * @return Time to turn on the light.
+ * @brief Replace the light schedule, e.g. with several segments or weekday overrides.
+ * @param schedule New schedule.
  */
-time_t SystemController::getLightOnTime() {
-    return lightOnTime;
+void SystemController::setLightSchedule(const LightSchedule& schedule) {
+    lightController.setSchedule(schedule);
+
+    // Log the light schedule update
+    logger.logEvent("INFO", "SystemController" + id, schedule.empty() ? "Light schedule back to the light on and off times"
+                                                                      : "Light schedule replaced");
 }
 
 /**
- * @brief Get the time to turn off the light after activation.
- * @return Time to turn off the light.
+ * @brief Dim the light with PWM and ramp it on and off like a sunrise and sunset.
+ * @param frequencyHz PWM frequency.
+ * @param level Brightness when on as a duty cycle between 0 and 1.
+ * @param ramp Duration of the sunrise and sunset ramps.
  */
-time_t SystemController::getLightOffTime() {
-    return lightOffTime;
+void SystemController::setLightDimming(double frequencyHz, double level, std::chrono::milliseconds ramp) {
+    lightController.setRamp(ramp);
+    lightController.setDimLevel(level);
+    lightController.enableDimming(frequencyHz);
+
+    // Log the light dimming settings
+    logger.logEvent("INFO", "SystemController" + id, "Light dimming set to " + std::to_string(frequencyHz) +
+                                                     " Hz at " + std::to_string(level * 100.0) + " %, " +
+                                                     std::to_string(ramp.count()) + " ms ramps");
 }
 
 /**
- * @brief Set the time to turn on the water pump after activation.
- * @param waterPumpOnTime Time to turn on the water pump.
+ * @brief Account the daily light integral of the light and append every finished day to a CSV file.
+ * @param ppfd Photosynthetic photon flux density of the light at full output in µmol/m²/s, 0 for on-time only.
+ * @param historyPath Path of the CSV file, empty to keep the totals in memory only.
  */
-void SystemController::setWaterPumpOnTime(const time_t waterPumpOnTime) {
+void SystemController::setLightDliAccounting(double ppfd, const std::string& historyPath) {
+    lightController.setPpfd(ppfd);
+    lightController.setDliHistoryFile(historyPath);
 
-    // Log the water pump on time update from to
-    logger.logEvent("INFO", "SystemController" + id, "Water pump on time updated from " +
-                                                     std::to_string(this->waterPumpOnTime) + " to " +
-                                                     std::to_string(waterPumpOnTime));
+    // Log the light integral settings
+    logger.logEvent("INFO", "SystemController" + id, "Light integral at " + std::to_string(ppfd) + " umol/m2/s" +
+                    (historyPath.empty() ? std::string() : ", daily totals in " + historyPath));
+}
 
-    this->waterPumpOnTime = waterPumpOnTime;
+/**
+ * @brief Stretch or cut the light's photoperiod to reach a daily light integral.
+ * @param targetDli Daily light integral in mol/m², 0 to follow the schedule as is.
+ * @param maxAdjust Largest change of the scheduled off time.
+ */
+void SystemController::setLightTargetDli(double targetDli, std::chrono::seconds maxAdjust) {
+    lightController.setTargetDli(targetDli, maxAdjust);
+
+    // Log the light integral target
+    logger.logEvent("INFO", "SystemController" + id, "Light integral target set to " + std::to_string(targetDli) +
+                                                     " mol/m2, photoperiod adjusted by up to " +
+                                                     std::to_string(maxAdjust.count() / 60) + " min");
 }
 
 /**
- * @brief Set the time to turn off the water pump after activation.
- * @param waterPumpOffTime Time to turn off the water pump.
+ * @brief Get the light the zone received so far today.
+ * @return Totals of the running day.
  */
-void SystemController::setWaterPumpOffTime(const time_t waterPumpOffTime) {
+DailyLightIntegral::DayTotal SystemController::getLightDliToday() {
+    return lightController.getDliToday();
+}
 
-    // Log the water pump off time update from to
-    logger.logEvent("INFO", "SystemController" + id, "Water pump off time updated from " +
-                                                     std::to_string(this->waterPumpOffTime) + " to " +
-                                                     std::to_string(waterPumpOffTime));
+/**
+ * @brief Get the time to turn on the light after activation.
+ * @return Time to turn on the light.
+ */
+time_t SystemController::getLightOnTime() {
+    return lightOnTime;
+}
 
-    this->waterPumpOffTime = waterPumpOffTime;
+/**
+ * @brief Get the time to turn off the light after activation.
+ * @return Time to turn off the light.
+ */
+time_t SystemController::getLightOffTime() {
+    return lightOffTime;
 }
 
 /**
@@ -266,10 +552,10 @@ void SystemController::setPumpIgnoreTime(const time_t pumpIgnoreTime) {
 
     // Log the water pump ignore time update from to
     logger.logEvent("INFO", "SystemController" + id, "Water pump ignore time updated from " +
-                                                     std::to_string(this->pumpIgnoreTime) + " to " +
+                                                     std::to_string(waterPump.getIgnoreTime()) + " to " +
                                                      std::to_string(pumpIgnoreTime));
 
-    this->pumpIgnoreTime = pumpIgnoreTime;
+    waterPump.setIgnoreTime(static_cast<int>(pumpIgnoreTime));
 }
 
 /**
@@ -280,10 +566,185 @@ void SystemController::setPumpDuration(int pumpDuration) {
 
     // Log the water pump duration update from to
     logger.logEvent("INFO", "SystemController" + id, "Water pump duration updated from " +
-                                                     std::to_string(this->pumpDuration) + " to " +
+                                                     std::to_string(waterPump.getActivationDuration()) + " to " +
                                                      std::to_string(pumpDuration));
 
-    this->pumpDuration = pumpDuration;
+    waterPump.setActivationDuration(pumpDuration);
+}
+
+/**
+ * @brief Set the calibrated flow rate of the water pump.
+ * @param mlPerSecond Flow in millilitres per second.
+ */
+void SystemController::setPumpFlowRate(double mlPerSecond) {
+
+    // Log the water pump flow rate update from to
+    logger.logEvent("INFO", "SystemController" + id, "Water pump flow rate updated from " +
+                                                     std::to_string(waterPump.getFlowRate()) + " to " +
+                                                     std::to_string(mlPerSecond) + " ml/s");
+
+    waterPump.setFlowRate(mlPerSecond);
+}
+
+/**
+ * @brief Water by volume instead of by duration.
+ * @param ml Volume of one watering in millilitres, 0 to water for the pump duration.
+ */
+void SystemController::setPumpDoseVolume(double ml) {
+
+    // Log the water pump dose update from to
+    logger.logEvent("INFO", "SystemController" + id, "Water pump dose updated from " +
+                                                     std::to_string(pumpDoseVolume) + " to " +
+                                                     std::to_string(ml) + " ml");
+
+    pumpDoseVolume = ml > 0.0 ? ml : 0.0;
+}
+
+/**
+ * @brief Get the estimated volume the water pump has delivered.
+ * @return Volume in millilitres.
+ */
+double SystemController::getPumpVolumeDelivered() {
+    return waterPump.getVolumeDelivered();
+}
+
+/**
+ * @brief Set the priority of the zone's waterings in the pump scheduler.
+ * @param priority Higher priorities are admitted first.
+ */
+void SystemController::setPumpPriority(int priority) {
+
+    // Log the water pump priority update from to
+    logger.logEvent("INFO", "SystemController" + id, "Water pump priority updated from " +
+                                                     std::to_string(pumpPriority) + " to " +
+                                                     std::to_string(priority));
+
+    pumpPriority = priority;
+}
+
+/**
+ * @brief Set the rated supply current of the water pump for the pump scheduler's budget.
+ * @param amps Current drawn while running.
+ */
+void SystemController::setPumpRatedCurrent(double amps) {
+
+    // Log the water pump current update from to
+    logger.logEvent("INFO", "SystemController" + id, "Water pump rated current updated from " +
+                                                     std::to_string(waterPump.getRatedCurrent()) + " to " +
+                                                     std::to_string(amps) + " A");
+
+    waterPump.setRatedCurrent(amps);
+}
+
+/**
+ * @brief Hand the zone's outputs to the actuator watchdog, which forces them safe if the control loop stalls.
+ * @param includeLight True to switch the light off on a trip as well as the water pump.
+ */
+void SystemController::addToWatchdog(bool includeLight) {
+
+    ActuatorWatchdog::instance().addPump(waterPump);
+    if (includeLight) {
+        ActuatorWatchdog::instance().addLight(lightController);
+    }
+
+    // Log the watchdog registration
+    logger.logEvent("INFO", "SystemController" + id, std::string("Outputs added to the watchdog") +
+                                                     (includeLight ? " with the light" : ""));
+}
+
+/**
+ * @brief Write the zone's light and pump lines through a shared output group.
+ * @param group Output group, must outlive the controller.
+ */
+void SystemController::addToOutputGroup(OutputGroup& group) {
+
+    bool lightJoined = lightController.joinOutputGroup(group);
+    bool pumpJoined = waterPump.joinOutputGroup(group);
+
+    // Log the outputs that joined the group
+    logger.logEvent("INFO", "SystemController" + id, std::string("Output group: light ") +
+                                                     (lightJoined ? "joined" : "on its own") + ", water pump " +
+                                                     (pumpJoined ? "joined" : "on its own"));
+}
+
+/**
+ * @brief Get the number of light and pump requests that found the output already in the requested state.
+ * @return Suppressed no-op writes.
+ */
+uint64_t SystemController::getSuppressedOutputWrites() {
+    return lightOutput.getSuppressed() + pumpOutput.getSuppressed();
+}
+
+/**
+ * @brief Water in pulse-soak cycles: the watering is split into pulses separated by soak pauses.
+ * @param pulses Number of pulses, 1 to water in one go.
+ * @param soakTime Pause between the pulses.
+ * @param targetMoisture The cycle ends early once the moisture reaches this level, 0 to use the threshold.
+ */
+void SystemController::setPulseSoak(int pulses, std::chrono::seconds soakTime, double targetMoisture) {
+
+    // Log the pulse-soak settings
+    logger.logEvent("INFO", "SystemController" + id, "Pulse-soak set to " + std::to_string(pulses) + " pulses, " +
+                                                     std::to_string(soakTime.count()) + " s soak, target " +
+                                                     std::to_string(targetMoisture) + " %");
+
+    pulseSoakPulses = pulses > 1 ? pulses : 1;
+    pulseSoakTime = soakTime;
+    pulseSoakTarget = targetMoisture;
+}
+
+/**
+ * @brief Set how a water pump running dry is detected.
+ * @param responseWindow Time after an activation in which the soil moisture has to rise.
+ * @param minRise Moisture rise in percent that counts as a response.
+ * @param maxMissed Consecutive activations without a response before the pump is faulted.
+ */
+void SystemController::setDryRunDetection(std::chrono::seconds responseWindow, double minRise, int maxMissed) {
+
+    // Log the dry-run detection settings
+    logger.logEvent("INFO", "SystemController" + id, "Dry-run detection: " + std::to_string(minRise) + " % rise within " +
+                                                     std::to_string(responseWindow.count()) + " s, fault after " +
+                                                     std::to_string(maxMissed) + " misses");
+
+    dryRunDetector.setParameters(responseWindow, minRise, maxMissed);
+}
+
+/**
+ * @brief Clear a water pump fault, e.g. after refilling the reservoir.
+ */
+void SystemController::clearPumpFault() {
+    dryRunDetector.reset();
+    waterPump.clearFault();
+
+    // Log the fault reset
+    logger.logEvent("INFO", "SystemController" + id, "Water pump fault cleared");
+}
+
+/**
+ * @brief Keep the water pump's lifetime counters in a file.
+ * @param path Path of the counter file.
+ * @param interval Time between checkpoints.
+ */
+void SystemController::setPumpCounterFile(const std::string& path, std::chrono::seconds interval) {
+    waterPump.enableCounterPersistence(path, interval);
+}
+
+/**
+ * @brief Run the water pump at reduced speed with software PWM.
+ * @param frequencyHz PWM frequency.
+ * @param duty Duty cycle between 0 and 1.
+ * @param softStart Time to ramp up to the duty cycle when the pump starts.
+ */
+void SystemController::setPumpPwm(double frequencyHz, double duty, std::chrono::milliseconds softStart) {
+    if (waterPump.enablePwm(frequencyHz, duty, softStart)) {
+        // Log the water pump PWM settings
+        logger.logEvent("INFO", "SystemController" + id, "Water pump PWM set to " + std::to_string(frequencyHz) +
+                                                         " Hz at " + std::to_string(duty * 100.0) + " % duty, " +
+                                                         std::to_string(softStart.count()) + " ms soft start");
+    } else {
+        // Log the rejected change
+        logger.logEvent("WARN", "SystemController" + id, "Water pump PWM not changed while the pump runs");
+    }
 }
 
 /**
@@ -308,11 +769,45 @@ time_t SystemController::addSecondsToTime(const time_t& time, const int& seconds
 }
 
 /**
- * @brief Get the next time to activate the water pump.
- * @return Next time to activate the water pump.
+ * @brief Get the next time the water pump accepts an activation.
+ * @return Time of the next allowed activation, 0 if the pump is running open-ended or faulted.
  */
 time_t SystemController::getNextPumpTime() {
-    return addSecondsToTime(waterPumpOffTime, pumpIgnoreTime);
+    WaterPump::Clock::time_point next = waterPump.getNextActivationTime();
+    if (next == WaterPump::Clock::time_point::max()) {
+        return 0;
+    }
+
+    // Map the monotonic deadline onto the wall clock
+    std::chrono::seconds remaining = std::chrono::duration_cast<std::chrono::seconds>(next - WaterPump::Clock::now());
+    if (remaining.count() < 0) {
+        remaining = std::chrono::seconds(0);
+    }
+
+    return addSecondsToTime(time(nullptr), static_cast<int>(remaining.count()));
+}
+
+/**
+ * @brief Get the rate of change of the soil moisture.
+ * @return Rate of change in percent per hour.
+ */
+double SystemController::getSoilMoistureSlope() {
+    return sensorGroup != nullptr ? sensorGroup->getMoistureSlope() : soilSensor.getMoistureSlope();
+}
+
+/**
+ * @brief Predict when the soil moisture will drop below the threshold.
+ * @param currentTime Current time.
+ * @return Predicted time of the threshold crossing, currentTime if already below it, 0 if the soil is not drying.
+ */
+time_t SystemController::getPredictedWateringTime(const time_t currentTime) {
+    std::chrono::seconds remaining = sensorGroup != nullptr ? sensorGroup->getTimeToThreshold(soilMoistureThreshold) :
+                                                              soilSensor.getTimeToThreshold(soilMoistureThreshold);
+    if (remaining.count() < 0) {
+        return 0;
+    }
+
+    return addSecondsToTime(currentTime, static_cast<int>(remaining.count()));
 }
 
 /**
@@ -321,17 +816,18 @@ time_t SystemController::getNextPumpTime() {
  */
 void SystemController::setLightOn(bool on) {
 
-    if (on) {
-        lightController.turnOn();
+    if (!lightOutput.reconcile(on)) {
+        return;
+    }
 
+    if (on) {
         // Log the light activation
         logger.logEvent("INFO", "SystemController" + id, "Light activated");
 
-    } else
-        lightController.turnOff();
-
-    // Log the light deactivation
-    logger.logEvent("INFO", "SystemController" + id, "Light deactivated");
+    } else {
+        // Log the light deactivation
+        logger.logEvent("INFO", "SystemController" + id, "Light deactivated");
+    }
 
 }
 
@@ -340,18 +836,59 @@ void SystemController::setLightOn(bool on) {
  * @param on True to turn the water pump on, false to turn the water pump off.
  */
 void SystemController::setWaterPumpOn(bool on) {
+    // The pump is under manual control now, a newer switch replaces a manual run still waiting
+    cancelWatering();
+    cancelManualRun();
+
     if (on) {
-        waterPump.activate();
+        // Always restart the pump, a running pulse would otherwise still stop it at its deadline
+        std::function<bool()> start = [this]() {
+            waterPump.clearLockout();
+            bool started = waterPump.activate();
+            manualQueued = false;
+
+            if (started) {
+                // Log the water pump activation
+                logger.logEvent("INFO", "SystemController" + id, "Water pump activated");
+            } else {
+                // Log the rejected activation
+                logger.logEvent("WARN", "SystemController" + id, std::string("Water pump activation rejected (") +
+                                WaterPump::stateToString(waterPump.getState()) + ")");
+            }
+            return started;
+        };
+
+        // The manual run goes ahead of every watering but still waits for the supply budget
+        manualQueued = true;
+        manualRequest = PumpScheduler::instance().request(waterPump, std::numeric_limits<int>::max(),
+                                                          PumpScheduler::Clock::now(), start);
+
+        if (manualRequest == 0) {
+            // The pump already runs through the scheduler and keeps its share of the budget
+            manualQueued = false;
+            start();
+        } else if (manualQueued) {
+            // Log the queued activation
+            logger.logEvent("INFO", "SystemController" + id, "Water pump waiting for supply budget");
+        }
 
-        // Log the water pump activation
-        logger.logEvent("INFO", "SystemController" + id, "Water pump activated");
+    } else if (pumpOutput.reconcile(false)) {
+        // Log the water pump deactivation
+        logger.logEvent("INFO", "SystemController" + id, "Water pump deactivated");
+    }
 
-    } else
-        waterPump.deactivate();
+}
 
-    // Log the water pump deactivation
-    logger.logEvent("INFO", "SystemController" + id, "Water pump deactivated");
+/**
+ * @brief Give up a manual pump run that is still waiting for the pump scheduler.
+ */
+void SystemController::cancelManualRun() {
+    if (manualQueued && PumpScheduler::instance().cancel(manualRequest)) {
+        manualQueued = false;
 
+        // Log the cancelled manual run
+        logger.logEvent("INFO", "SystemController" + id, "Queued manual pump run cancelled");
+    }
 }
 
 /**
@@ -374,3 +911,11 @@ void SystemController::setSoilMoistureCalibrationValues(int16_t wetValue, int16_
     soilSensor.setDryCalValue(dryValue);
 }
 
+
+/**
+ * @brief Enable automatic drift correction of the soil sensor calibration.
+ * @param bounds Allowed range of the learned wet and dry calibration values.
+ */
+void SystemController::enableSoilCalibrationLearning(const CalibrationLearner::Bounds& bounds) {
+    soilSensor.enableCalibrationLearning(bounds);
+}
@@ -5,7 +5,15 @@
 #include "WaterPump.h"
 #include "LightController.h"
 #include "SoilSensor.h"
+#include "SensorGroup.h"
 #include "Logging.h"
+#include "AdaptiveSampler.h"
+#include "DryRunDetector.h"
+#include "ActuatorWatchdog.h"
+#include "OutputReconciler.h"
+#include "PumpScheduler.h"
+
+#include <atomic>
 
 class SystemController {
 public:
@@ -42,29 +50,61 @@ public:
     void deactivateGarden(const time_t currentTime);
 
     /**
-     * @brief Control the light based on the current time.
-     * @param currentTime Current time.
+     * @brief Let the light follow its daily schedule or hand it to manual control.
+     * @details The light controller wakes up at the next on or off transition by itself, no periodic call is needed.
+     * @param automatic True to follow the schedule, false to keep the light as it is.
      */
-    void controlLight(const time_t currentTime);
+    void setLightAutomatic(bool automatic);
 
     /**
-     * @brief Control the water pump based on the current time.
-     * @param currentTime Current time.
+     * @brief Get the time of the next scheduled light transition.
+     * @return Time of the next transition, 0 if the light is under manual control or has no schedule.
+     */
+    time_t getNextLightTransition();
+
+    /**
+     * @brief Control the water pump based on the soil moisture.
+     * @param currentTime Current time, unused since the pump and the scheduler keep their own time.
      */
     void controlWaterPump(const time_t currentTime);
 
+    /**
+     * @brief Give up a watering that is still waiting for the pump scheduler.
+     * @details Call it when the pump leaves automatic control, so a queued watering can't start it later.
+     */
+    void cancelWatering();
+
     /**
      * @brief Read soil moisture from the soil sensor.
      * @return Soil moisture level.
      */
     double readSoilMoisture();
 
+    /**
+     * @brief Set the adaptive soil sensor sampling intervals.
+     * @param fastInterval Sampling interval while the moisture changes or the pump runs.
+     * @param slowInterval Longest sampling interval while the moisture is flat.
+     */
+    void setSamplingIntervals(std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval);
+
+    /**
+     * @brief Use a group of probes instead of the single soil sensor for the zone moisture.
+     * @param group Probe group of the zone, or nullptr to go back to the single soil sensor. Not owned.
+     */
+    void attachSensorGroup(SensorGroup* group);
+
     /**
      * @brief Calibrate the soil sensor.
      * @return True if calibration is successful, false otherwise.
      */
     bool calibrateSoilSensor();
 
+    /**
+     * @brief Get the health state of the soil sensor.
+     * @return Health state of the soil sensor probe.
+     */
+    SoilHealthMonitor::Status getSoilSensorHealth();
+
     /**
      * @brief Set the soil moisture threshold.
      * @param threshold Threshold value.
@@ -79,39 +119,66 @@ public:
 
     /**
      * @brief Set the time to turn on the light after activation.
+     * @details Only the time of day is used, the light schedule repeats daily.
      * @param lightOnTime Time to turn on the light.
      */
     void setLightOnTime(const time_t lightOnTime);
 
     /**
      * @brief Set the time to turn off the light after activation.
+     * @details Only the time of day is used, the light schedule repeats daily.
      * @param lightOffTime Time to turn off the light.
      */
     void setLightOffTime(const time_t lightOffTime);
 
     /**
-     * @brief Get the time to turn on the light after activation.
-     * @return Time to turn on the light.
+     * @brief Replace the light schedule, e.g. with several segments or weekday overrides.
+     * @details The light on and off times are ignored while the schedule is set, an empty schedule goes back to
+     *          them.
+     * @param schedule New schedule, empty for the light on and off times.
      */
-    time_t getLightOnTime();
+    void setLightSchedule(const LightSchedule& schedule);
 
     /**
-     * @brief Get the time to turn off the light after activation.
-     * @return Time to turn off the light.
+     * @brief Dim the light with PWM and ramp it on and off like a sunrise and sunset.
+     * @details Only for dimmable drivers, a relay must stay in on/off mode.
+     * @param frequencyHz PWM frequency.
+     * @param level Brightness when on as a duty cycle between 0 and 1.
+     * @param ramp Duration of the sunrise and sunset ramps.
      */
-    time_t getLightOffTime();
+    void setLightDimming(double frequencyHz, double level, std::chrono::milliseconds ramp);
+
+    /**
+     * @brief Account the daily light integral of the light and append every finished day to a CSV file.
+     * @param ppfd Photosynthetic photon flux density of the light at full output in µmol/m²/s, 0 for on-time only.
+     * @param historyPath Path of the CSV file, empty to keep the totals in memory only.
+     */
+    void setLightDliAccounting(double ppfd, const std::string& historyPath);
 
     /**
-     * @brief Set the time to turn on the water pump after activation.
-     * @param waterPumpOnTime Time to turn on the water pump.
+     * @brief Stretch or cut the light's photoperiod to reach a daily light integral.
+     * @param targetDli Daily light integral in mol/m², 0 to follow the schedule as is.
+     * @param maxAdjust Largest change of the scheduled off time.
      */
-    void setWaterPumpOnTime(const time_t waterPumpOnTime);
+    void setLightTargetDli(double targetDli, std::chrono::seconds maxAdjust);
 
     /**
-     * @brief Set the time to turn off the water pump after activation.
-     * @param waterPumpOffTime Time to turn off the water pump.
+     * @brief Get the light the zone received so far today.
+     * @return Totals of the running day.
      */
-    void setWaterPumpOffTime(const time_t waterPumpOffTime);
+    DailyLightIntegral::DayTotal getLightDliToday();
+
+    /**
+     * @brief Get the time to turn on the light after activation.
+     * @return Time to turn on the light.
+     */
+    time_t getLightOnTime();
+
+    /**
+     * @brief Get the time to turn off the light after activation.
+     * @return Time to turn off the light.
+     */
+    time_t getLightOffTime();
 
     /**
      * @brief Set the time to ignore water pump activation after the last activation.
@@ -125,6 +192,91 @@ public:
      */
     void setPumpDuration(int pumpDuration);
 
+    /**
+     * @brief Set the calibrated flow rate of the water pump.
+     * @param mlPerSecond Flow in millilitres per second.
+     */
+    void setPumpFlowRate(double mlPerSecond);
+
+    /**
+     * @brief Water by volume instead of by duration.
+     * @param ml Volume of one watering in millilitres, 0 to water for the pump duration.
+     */
+    void setPumpDoseVolume(double ml);
+
+    /**
+     * @brief Get the estimated volume the water pump has delivered.
+     * @return Volume in millilitres.
+     */
+    double getPumpVolumeDelivered();
+
+    /**
+     * @brief Set the priority of the zone's waterings in the pump scheduler.
+     * @param priority Higher priorities are admitted first.
+     */
+    void setPumpPriority(int priority);
+
+    /**
+     * @brief Set the rated supply current of the water pump for the pump scheduler's budget.
+     * @param amps Current drawn while running.
+     */
+    void setPumpRatedCurrent(double amps);
+
+    /**
+     * @brief Hand the zone's outputs to the actuator watchdog, which forces them safe if the control loop stalls.
+     * @param includeLight True to switch the light off on a trip as well as the water pump.
+     */
+    void addToWatchdog(bool includeLight);
+
+    /**
+     * @brief Write the zone's light and pump lines through a shared output group.
+     * @details Outputs in PWM or dimming mode stay on their own.
+     * @param group Output group, must outlive the controller.
+     */
+    void addToOutputGroup(OutputGroup& group);
+
+    /**
+     * @brief Get the number of light and pump requests that found the output already in the requested state.
+     * @return Suppressed no-op writes.
+     */
+    uint64_t getSuppressedOutputWrites();
+
+    /**
+     * @brief Water in pulse-soak cycles: the watering is split into pulses separated by soak pauses.
+     * @param pulses Number of pulses, 1 to water in one go.
+     * @param soakTime Pause between the pulses.
+     * @param targetMoisture The cycle ends early once the moisture reaches this level, 0 to use the threshold.
+     */
+    void setPulseSoak(int pulses, std::chrono::seconds soakTime, double targetMoisture);
+
+    /**
+     * @brief Set how a water pump running dry is detected.
+     * @param responseWindow Time after an activation in which the soil moisture has to rise.
+     * @param minRise Moisture rise in percent that counts as a response.
+     * @param maxMissed Consecutive activations without a response before the pump is faulted.
+     */
+    void setDryRunDetection(std::chrono::seconds responseWindow, double minRise, int maxMissed);
+
+    /**
+     * @brief Clear a water pump fault, e.g. after refilling the reservoir.
+     */
+    void clearPumpFault();
+
+    /**
+     * @brief Keep the water pump's lifetime counters in a file.
+     * @param path Path of the counter file.
+     * @param interval Time between checkpoints.
+     */
+    void setPumpCounterFile(const std::string& path, std::chrono::seconds interval);
+
+    /**
+     * @brief Run the water pump at reduced speed with software PWM.
+     * @param frequencyHz PWM frequency.
+     * @param duty Duty cycle between 0 and 1.
+     * @param softStart Time to ramp up to the duty cycle when the pump starts.
+     */
+    void setPumpPwm(double frequencyHz, double duty, std::chrono::milliseconds softStart);
+
     /**
      * @brief Helper function to determine if the time is within range.
      * @param time Time to check.
@@ -143,11 +295,24 @@ public:
     time_t addSecondsToTime(const time_t& time, const int& seconds);
 
     /**
-     * @brief Get the next time to activate the water pump.
-     * @return Time to activate the water pump.
+     * @brief Get the next time the water pump accepts an activation.
+     * @return Time of the next allowed activation, 0 if the pump is running open-ended or faulted.
      */
     time_t getNextPumpTime();
 
+    /**
+     * @brief Get the rate of change of the soil moisture.
+     * @return Rate of change in percent per hour.
+     */
+    double getSoilMoistureSlope();
+
+    /**
+     * @brief Predict when the soil moisture will drop below the threshold.
+     * @param currentTime Current time.
+     * @return Predicted time of the threshold crossing, currentTime if already below it, 0 if the soil is not drying.
+     */
+    time_t getPredictedWateringTime(const time_t currentTime);
+
     /**
      * @brief Turn the light on or off.
      * @param on True to turn the light on, false to turn the light off.
@@ -156,10 +321,17 @@ public:
 
     /**
      * @brief Turn the water pump on or off.
+     * @details A manual run is requested from the pump scheduler ahead of every watering, so it still waits for
+     *          the supply budget when the other pumps use it up. cancelWatering() leaves a waiting manual run alone.
      * @param on True to turn the water pump on, false to turn the water pump off.
      */
     void setWaterPumpOn(bool on);
 
+    /**
+     * @brief Give up a manual pump run that is still waiting for the pump scheduler.
+     */
+    void cancelManualRun();
+
     /**
      * @brief Manualy set the soil moisture calibration values.
      * @param wetValue Calibration value for wet soil.
@@ -167,20 +339,73 @@ public:
      */
     void setSoilMoistureCalibrationValues(int16_t wetValue, int16_t dryValue);
 
+    /**
+     * @brief Enable automatic drift correction of the soil sensor calibration.
+     * @param bounds Allowed range of the learned wet and dry calibration values.
+     */
+    void enableSoilCalibrationLearning(const CalibrationLearner::Bounds& bounds);
+
 private:
     SoilSensor soilSensor;              // Soil sensor controlled by the controller
     LightController lightController;    // Light controller controlled by the controller
     WaterPump waterPump;                // Water pump controlled by the controller
+    SensorGroup* sensorGroup;           // Optional probe group replacing the soil sensor
+    AdaptiveSampler soilSampler;        // Decides how old a cached soil sensor reading may be
+    SoilSensor::Clock::time_point sampledReadingTime;   // Time of the last soil sensor reading given to the sampler
+    DryRunDetector dryRunDetector;      // Faults the pump when watering does not raise the moisture
+    OutputReconciler lightOutput;       // Writes the light only when its state changes
+    OutputReconciler pumpOutput;        // Switches the pump only when its state changes
 
     double soilMoistureThreshold;       // Soil moisture threshold
     time_t lightOnTime;                 // Time to turn on the light
     time_t lightOffTime;                // Time to turn off the light
-    time_t waterPumpOnTime;             // Time to turn on the water pump
-    time_t waterPumpOffTime;            // Time to turn off the water pump
-    int pumpIgnoreTime;                 // Time to ignore water pump activation after last activation
-    int pumpDuration;                   // Water pump activation duration
+    bool sensorFaultActive;             // Automatic watering suspended because of a sensor fault
+    double pumpDoseVolume;              // Volume of one watering in ml, 0 to water for the pump duration
+    int pulseSoakPulses;                // Pulses per watering, 1 for a single pulse
+    std::chrono::seconds pulseSoakTime; // Pause between the pulses of a watering
+    double pulseSoakTarget;             // Moisture that ends a pulse-soak cycle early, 0 for the threshold
+    std::atomic<double> latestMoisture; // Last zone moisture, read by the pump between pulses
+    std::atomic<bool> latestHealthy;    // The last zone moisture came from a healthy sensor
+    int pumpPriority;                   // Priority of the zone's waterings in the pump scheduler
+    PumpScheduler::RequestId pumpRequest;   // Last watering request handed to the pump scheduler
+    std::atomic<bool> wateringQueued;   // A watering waits for the pump scheduler
+    PumpScheduler::RequestId manualRequest; // Last manual pump run handed to the pump scheduler
+    std::atomic<bool> manualQueued;     // A manual pump run waits for the pump scheduler
+    std::atomic<bool> wateringStarted;  // The pump scheduler started a watering since the last control tick
+    double wateringBaseline;            // Zone moisture when the watering was requested
 
     std::string id;                           // ID of the system controller for logging
+
+    /**
+     * @brief Check whether the zone's moisture reading can be trusted.
+     * @return True if the soil sensor (or enough probes of the group) is healthy, false otherwise.
+     */
+    bool isSoilReadingHealthy();
+
+    /**
+     * @brief Tell the zone's sensors that irrigation is starting.
+     */
+    void notifySoilIrrigation();
+
+    /**
+     * @struct WateringPlan
+     * @brief Settings of one watering, copied when the watering is requested.
+     */
+    struct WateringPlan {
+        double doseVolume;                  // Volume in ml, 0 to water for the pump duration
+        int pulses;                         // Pulses of the watering, 1 for a single pulse
+        std::chrono::seconds soakTime;      // Pause between the pulses
+        double target;                      // Moisture that ends a pulse-soak cycle early
+    };
+
+    /**
+     * @brief Start one watering of the zone with the given duration or volume and pulse-soak mode.
+     * @details Called by the pump scheduler, possibly on the timer thread, so it only touches the pump and
+     *          the plan it is given.
+     * @param plan Settings of the watering.
+     * @return True if the pump started, false if it was rejected or is not calibrated.
+     */
+    bool startWatering(const WateringPlan& plan);
 };
 
 #endif // GARDENCONTROLLER_H
@@ -0,0 +1,305 @@
+#include "TimerService.h"
+#include "Logging.h"
+
+#include <cerrno>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/**
+ * @file TimerService.cpp
+ *
+ * @brief Implementation of the TimerService class.
+ */
+
+/**
+ * @brief Get the process-wide timer service.
+ * @return The timer service.
+ */
+TimerService& TimerService::instance() {
+    static TimerService service;
+    return service;
+}
+
+/**
+ * @brief Constructor for TimerService, starts the timer thread.
+ */
+TimerService::TimerService() : runningOwner(nullptr), callbackRunning(false), nextId(1), running(true) {
+    // steady_clock is CLOCK_MONOTONIC on Linux, so deadlines map directly onto the timerfd
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd < 0) {
+        std::cerr << "Error: Couldn't create timerfd!" << std::endl;
+        exit(-1);
+    }
+
+    // A realtime timerfd armed with TFD_TIMER_CANCEL_ON_SET reports every time the clock is set
+    clockFd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (clockFd < 0) {
+        std::cerr << "Error: Couldn't create timerfd!" << std::endl;
+        exit(-1);
+    }
+    armClockWatch();
+
+    thread = std::thread(&TimerService::run, this);
+}
+
+/**
+ * @brief Destructor for TimerService, stops the timer thread.
+ */
+TimerService::~TimerService() {
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        running = false;
+
+        // Fire the timerfd immediately to wake the thread
+        itimerspec spec = {};
+        spec.it_value.tv_nsec = 1;
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(timerFd);
+    close(clockFd);
+}
+
+/**
+ * @brief Run a callback at a deadline.
+ * @param deadline Monotonic time to run the callback at.
+ * @param callback Function to run.
+ * @param owner Object the callback uses, cancelled together by cancelAll(). Null for none.
+ * @return Id of the timer, used to cancel it.
+ */
+TimerService::TimerId TimerService::schedule(Clock::time_point deadline, std::function<void()> callback,
+                                             const void* owner) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+
+    TimerId id = nextId++;
+    TimerQueue::iterator it = timers.emplace(deadline, Timer{id, owner, std::move(callback)});
+    timersById[id] = it;
+
+    // Only re-arm if the new timer is now the earliest
+    if (it == timers.begin()) {
+        arm();
+    }
+
+    return id;
+}
+
+/**
+ * @brief Run a callback after a delay.
+ * @param delay Time from now to run the callback.
+ * @param callback Function to run.
+ * @param owner Object the callback uses, cancelled together by cancelAll(). Null for none.
+ * @return Id of the timer, used to cancel it.
+ */
+TimerService::TimerId TimerService::scheduleAfter(std::chrono::nanoseconds delay, std::function<void()> callback,
+                                                  const void* owner) {
+    return schedule(Clock::now() + delay, std::move(callback), owner);
+}
+
+/**
+ * @brief Cancel a timer that has not fired yet.
+ * @param id Id of the timer.
+ * @return True if the timer was cancelled, false if it already fired or does not exist.
+ */
+bool TimerService::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+
+    std::unordered_map<TimerId, TimerQueue::iterator>::iterator found = timersById.find(id);
+    if (found == timersById.end()) {
+        return false;
+    }
+
+    // An early wake-up for a cancelled head timer is harmless, so the timerfd is not re-armed
+    timers.erase(found->second);
+    timersById.erase(found);
+
+    return true;
+}
+
+/**
+ * @brief Run a callback on the timer thread whenever the wall clock is set, e.g. by NTP or by hand.
+ * @param callback Function to run.
+ * @param owner Object the callback uses, removed together by cancelAll(). Null for none.
+ * @return Id of the listener, used to remove it.
+ */
+TimerService::TimerId TimerService::addClockListener(std::function<void()> callback, const void* owner) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+
+    TimerId id = nextId++;
+    clockListeners[id] = Timer{id, owner, std::move(callback)};
+
+    return id;
+}
+
+/**
+ * @brief Remove a clock listener.
+ * @param id Id of the listener.
+ * @return True if the listener was removed, false if it does not exist.
+ */
+bool TimerService::removeClockListener(TimerId id) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    return clockListeners.erase(id) > 0;
+}
+
+/**
+ * @brief Cancel every timer and clock listener of an owner and wait until none of its callbacks is running.
+ * @param owner Owner given when the timers were scheduled.
+ */
+void TimerService::cancelAll(const void* owner) {
+    std::unique_lock<std::mutex> lock(timerMutex);
+    erase(owner);
+
+    // The running callback is the caller, waiting would never end
+    if (std::this_thread::get_id() == thread.get_id()) {
+        return;
+    }
+
+    while (callbackRunning && runningOwner == owner) {
+        callbackDone.wait(lock);
+
+        // Drop whatever the callback scheduled before it returned
+        erase(owner);
+    }
+}
+
+/**
+ * @brief Remove the pending timers and the clock listeners of an owner.
+ * @param owner Owner of the timers.
+ */
+void TimerService::erase(const void* owner) {
+    TimerQueue::iterator it = timers.begin();
+    while (it != timers.end()) {
+        if (it->second.owner == owner) {
+            timersById.erase(it->second.id);
+            it = timers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::map<TimerId, Timer>::iterator listener = clockListeners.begin();
+    while (listener != clockListeners.end()) {
+        if (listener->second.owner == owner) {
+            listener = clockListeners.erase(listener);
+        } else {
+            ++listener;
+        }
+    }
+}
+
+/**
+ * @brief Arm the realtime timerfd far in the future, so setting the clock cancels it.
+ */
+void TimerService::armClockWatch() {
+    itimerspec spec = {};
+    spec.it_value.tv_sec = std::numeric_limits<time_t>::max() / 2;
+    timerfd_settime(clockFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr);
+}
+
+/**
+ * @brief Run a callback on the timer thread, releasing timerMutex while it runs.
+ * @param lock Lock holding timerMutex.
+ * @param timer Timer or clock listener to run.
+ */
+void TimerService::runCallback(std::unique_lock<std::mutex>& lock, const Timer& timer) {
+    runningOwner = timer.owner;
+    callbackRunning = true;
+
+    // Run the callback without the lock so it can schedule new timers
+    lock.unlock();
+    try {
+        timer.callback();
+    } catch (const std::exception& e) {
+        logger.logEvent("ERROR", "TimerService", std::string("Timer callback failed: ") + e.what());
+    } catch (...) {
+        logger.logEvent("ERROR", "TimerService", "Timer callback failed");
+    }
+    lock.lock();
+
+    callbackRunning = false;
+    runningOwner = nullptr;
+    callbackDone.notify_all();
+}
+
+/**
+ * @brief Arm the timerfd for the earliest deadline.
+ */
+void TimerService::arm() {
+    itimerspec spec = {};
+
+    if (!timers.empty()) {
+        std::chrono::nanoseconds deadline = timers.begin()->first.time_since_epoch();
+        if (deadline.count() <= 0) {
+            deadline = std::chrono::nanoseconds(1);
+        }
+        spec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(deadline).count();
+        spec.it_value.tv_nsec = (deadline % std::chrono::seconds(1)).count();
+    }
+
+    // A zero it_value disarms the timer when nothing is pending
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+/**
+ * @brief Timer thread: wait for the timerfds and run the due callbacks and the clock listeners.
+ */
+void TimerService::run() {
+    pollfd fds[2] = {{timerFd, POLLIN, 0}, {clockFd, POLLIN, 0}};
+
+    while (true) {
+        // Sleep until a deadline passes or the clock is set
+        if (poll(fds, 2, -1) < 0) {
+            continue;
+        }
+
+        uint64_t expirations;
+        if (fds[0].revents & POLLIN) {
+            ::read(timerFd, &expirations, sizeof(expirations));
+        }
+
+        // Setting the clock makes the read fail with ECANCELED
+        bool clockChanged = false;
+        if (fds[1].revents & POLLIN) {
+            clockChanged = ::read(clockFd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED;
+        }
+
+        std::unique_lock<std::mutex> lock(timerMutex);
+        if (!running) {
+            return;
+        }
+
+        // Run the due timers one at a time, so cancelAll() always knows whose callback is running
+        while (!timers.empty() && timers.begin()->first <= Clock::now()) {
+            Timer timer = std::move(timers.begin()->second);
+            timersById.erase(timer.id);
+            timers.erase(timers.begin());
+
+            runCallback(lock, timer);
+        }
+
+        if (clockChanged) {
+            armClockWatch();
+
+            // A listener may remove others while it runs, so look each one up again
+            std::vector<TimerId> ids;
+            for (const std::pair<const TimerId, Timer>& listener : clockListeners) {
+                ids.push_back(listener.first);
+            }
+            for (TimerId id : ids) {
+                std::map<TimerId, Timer>::iterator found = clockListeners.find(id);
+                if (found != clockListeners.end()) {
+                    Timer listener = found->second;
+                    runCallback(lock, listener);
+                }
+            }
+        }
+
+        arm();
+    }
+}
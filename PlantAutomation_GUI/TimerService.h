@@ -0,0 +1,154 @@
+#ifndef TIMERSERVICE_H
+#define TIMERSERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @brief The TimerService class runs callbacks at monotonic-clock deadlines on one shared thread.
+ * @details Deadlines are kept ordered and a single timerfd is armed for the earliest one, so the thread
+ *          sleeps in the kernel until the next deadline and wakes with sub-millisecond accuracy.
+ *          Scheduling and cancelling are O(log n). Callbacks run on the timer thread and must not block.
+ *          Timers can be tagged with an owner, so an object can cancel its timers and wait for a running one
+ *          before it is destroyed. Deadlines don't follow the wall clock, so users that schedule against
+ *          wall-clock times register a clock listener to reschedule when the clock is set.
+ */
+class TimerService {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;
+
+    /**
+     * @brief Get the process-wide timer service.
+     * @return The timer service.
+     */
+    static TimerService& instance();
+
+    /**
+     * @brief Constructor for TimerService, starts the timer thread.
+     */
+    TimerService();
+
+    /**
+     * @brief Destructor for TimerService, stops the timer thread.
+     */
+    ~TimerService();
+
+    TimerService(const TimerService&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+
+    /**
+     * @brief Run a callback at a deadline.
+     * @param deadline Monotonic time to run the callback at.
+     * @param callback Function to run.
+     * @param owner Object the callback uses, cancelled together by cancelAll(). Null for none.
+     * @return Id of the timer, used to cancel it.
+     */
+    TimerId schedule(Clock::time_point deadline, std::function<void()> callback, const void* owner = nullptr);
+
+    /**
+     * @brief Run a callback after a delay.
+     * @param delay Time from now to run the callback.
+     * @param callback Function to run.
+     * @param owner Object the callback uses, cancelled together by cancelAll(). Null for none.
+     * @return Id of the timer, used to cancel it.
+     */
+    TimerId scheduleAfter(std::chrono::nanoseconds delay, std::function<void()> callback,
+                          const void* owner = nullptr);
+
+    /**
+     * @brief Cancel a timer that has not fired yet.
+     * @details Does not wait for a callback that is already running, so it may be called with a lock held
+     *          that the callback takes. Use cancelAll() before destroying the object the callback uses.
+     * @param id Id of the timer.
+     * @return True if the timer was cancelled, false if it already fired or does not exist.
+     */
+    bool cancel(TimerId id);
+
+    /**
+     * @brief Run a callback on the timer thread whenever the wall clock is set, e.g. by NTP or by hand.
+     * @param callback Function to run.
+     * @param owner Object the callback uses, removed together by cancelAll(). Null for none.
+     * @return Id of the listener, used to remove it.
+     */
+    TimerId addClockListener(std::function<void()> callback, const void* owner = nullptr);
+
+    /**
+     * @brief Remove a clock listener.
+     * @details Does not wait for a listener that is already running, see cancel().
+     * @param id Id of the listener.
+     * @return True if the listener was removed, false if it does not exist.
+     */
+    bool removeClockListener(TimerId id);
+
+    /**
+     * @brief Cancel every timer and clock listener of an owner and wait until none of its callbacks is running.
+     * @details Call it from the owner's destructor without holding a lock its callbacks take. A callback
+     *          that reschedules while being waited for is cancelled as well. Called from the timer thread,
+     *          it does not wait, since the running callback is the caller.
+     * @param owner Owner given when the timers were scheduled.
+     */
+    void cancelAll(const void* owner);
+
+private:
+    struct Timer {
+        TimerId id;                             // Id of the timer
+        const void* owner;                      // Object the callback uses, null for none
+        std::function<void()> callback;         // Function to run
+    };
+
+    using TimerQueue = std::multimap<Clock::time_point, Timer>;
+
+    std::mutex timerMutex;                                          // Guards the timer queue
+    std::condition_variable callbackDone;                           // Signalled when a callback returns
+    TimerQueue timers;                                              // Pending timers ordered by deadline
+    std::unordered_map<TimerId, TimerQueue::iterator> timersById;   // Pending timers by id
+    std::map<TimerId, Timer> clockListeners;                        // Callbacks run when the wall clock is set
+    const void* runningOwner;                                       // Owner of the running callback, null if none
+    bool callbackRunning;                                           // A callback is running on the timer thread
+    TimerId nextId;                                                 // Id of the next timer
+    int timerFd;                                                    // timerfd armed for the earliest deadline
+    int clockFd;                                                    // Realtime timerfd cancelled by clock changes
+    bool running;                                                   // The timer thread should keep running
+    std::thread thread;                                             // Timer thread
+
+    /**
+     * @brief Arm the timerfd for the earliest deadline.
+     * @details Must be called with timerMutex held.
+     */
+    void arm();
+
+    /**
+     * @brief Arm the realtime timerfd far in the future, so setting the clock cancels it.
+     */
+    void armClockWatch();
+
+    /**
+     * @brief Run a callback on the timer thread, releasing timerMutex while it runs.
+     * @details Must be called with timerMutex held through the lock. An exception from the callback is logged so
+     *          the timer thread keeps running.
+     * @param lock Lock holding timerMutex.
+     * @param timer Timer or clock listener to run.
+     */
+    void runCallback(std::unique_lock<std::mutex>& lock, const Timer& timer);
+
+    /**
+     * @brief Remove the pending timers and the clock listeners of an owner.
+     * @details Must be called with timerMutex held.
+     * @param owner Owner of the timers.
+     */
+    void erase(const void* owner);
+
+    /**
+     * @brief Timer thread: wait for the timerfds and run the due callbacks and the clock listeners.
+     */
+    void run();
+};
+
+#endif // TIMERSERVICE_H
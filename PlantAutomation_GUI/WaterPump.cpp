@@ -1,4 +1,10 @@
 #include "WaterPump.h"
+#include "Logging.h"
+#include "PumpScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
 
 /**
  * @file WaterPump.cpp
@@ -13,6 +19,24 @@
  * @param pumpTimeSeconds Time to run the water pump.
  */
 WaterPump::WaterPump(int pin, int ignoreTimeSeconds, int pumpTimeSeconds) {
+    // Make sure the chip pool, the timer service, the PWM engine and the pump scheduler outlive the pump
+    GpioChipPool::instance();
+    TimerService::instance();
+    PwmEngine::instance();
+    PumpScheduler::instance();
+
+    // No soft start until PWM mode is enabled
+    softStart = std::chrono::milliseconds(0);
+
+    // Doses run in one pulse until chunking is configured
+    soakTime = std::chrono::milliseconds(0);
+    chunkOnTime = Clock::duration::zero();
+    cycleSoakTime = Clock::duration::zero();
+
+    // Count from zero until a counter file is loaded
+    counters = PumpCounters::emptyRecord();
+    counterInterval = std::chrono::seconds(0);
+
     // Store the pin number
     pinNum = pin;
 
@@ -22,48 +46,158 @@ WaterPump::WaterPump(int pin, int ignoreTimeSeconds, int pumpTimeSeconds) {
     // Store the ignore time
     ignoreTime = ignoreTimeSeconds;
 
-    // Open the GPIO chip
-    chip = gpiod_chip_open("/dev/gpiochip0");
-
-    // Get the GPIO line
-    line = gpiod_chip_get_line(chip, pinNum);
-
-    // Configure the GPIO line as an output
-    gpiod_line_request_output(line, "WaterPump", 0);
-
-    // Set the initial state of the GPIO line to low
-    gpiod_line_set_value(line, 0);
+    // Configure the GPIO pin as an output, starting low
+    output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "WaterPump", false);
 }
 
 /**
  * @brief Destructor for WaterPump.
  */
 WaterPump::~WaterPump() {
-    gpiod_line_release(line);
-    gpiod_chip_close(chip);
+    // Give back the supply budget of a run that no stop will be reported for and drop a queued request
+    PumpScheduler::instance().forget(*this);
+
+    {
+        std::lock_guard<std::mutex> lock(pumpMutex);
+        setLine(false);
+
+        if (counterTimer != 0) {
+            TimerService::instance().cancel(counterTimer);
+            counterTimer = 0;
+        }
+    }
+
+    // A timer that already fired may still be waiting for the lock, a posted stop report is no longer needed
+    TimerService::instance().cancelAll(this);
+
+    // Keep the counters of the last run
+    checkpointCounters();
+
+    if (pwmChannel != 0) {
+        PwmEngine::instance().removeChannel(pwmChannel);
+    }
+
+    // Free the GPIO pin
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
 }
 
 /**
- * @brief Turn on the water pump.
+ * @brief Turn on the water pump until it is turned off.
+ * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
  */
-void WaterPump::activate() {
-    gpiod_line_set_value(line, 1);
-    isRunning = true;
+bool WaterPump::activate() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return start(Clock::time_point::max());
 }
 
 /**
  * @brief Turn off the water pump.
  */
 void WaterPump::deactivate() {
-    gpiod_line_set_value(line, 0);
-    isRunning = false;
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    if (state == State::RUNNING) {
+        stop(State::LOCKOUT);
+    }
+}
+
+/**
+ * @brief Run the water pump for an exact duration.
+ * @param duration Time to run the pump.
+ * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
+ */
+bool WaterPump::pulse(std::chrono::milliseconds duration) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    Clock::time_point deadline = Clock::now() + duration;
+    if (!start(deadline)) {
+        return false;
+    }
+
+    // De-energize the line at the deadline, a newer state change makes this timer stale
+    uint64_t generation = pulseGeneration;
+    stopTimer = TimerService::instance().schedule(deadline, [this, generation]() {
+        std::lock_guard<std::mutex> lock(pumpMutex);
+        if (generation == pulseGeneration) {
+            stopTimer = 0;
+            stop(State::LOCKOUT);
+        }
+    }, this);
+
+    return true;
+}
+
+/**
+ * @brief Run the water pump for the activation duration.
+ * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
+ */
+bool WaterPump::pulse() {
+    return pulse(std::chrono::seconds(getActivationDuration()));
+}
+
+/**
+ * @brief Deliver a volume of water using the flow calibration.
+ * @param ml Volume in millilitres.
+ * @param continueCheck Asked at the end of every soak pause, returning false ends the dose early.
+ * @return True if the dose started, false if the pump is not calibrated or activation was rejected.
+ */
+bool WaterPump::dose(double ml, ContinueCheck continueCheck) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    double flow = currentFlowRate();
+    if (flow <= 0.0 || ml <= 0.0) {
+        return false;
+    }
+
+    // Split the dose into equal pulses no larger than the chunk volume, a rounding error must not add a pulse
+    size_t chunks = 1;
+    if (maxChunkVolume > 0.0 && ml > maxChunkVolume) {
+        chunks = static_cast<size_t>(std::ceil(ml / maxChunkVolume - 1e-9));
+    }
+
+    return startCycle(onTimeFor(ml / chunks, flow), chunks, soakTime, std::move(continueCheck));
+}
+
+/**
+ * @brief Deliver a volume of water in a given number of equal pulses separated by soak pauses.
+ * @param ml Volume in millilitres.
+ * @param pulses Number of pulses.
+ * @param soakTime Pause between the pulses.
+ * @param continueCheck Asked at the end of every soak pause, returning false ends the dose early.
+ * @return True if the dose started, false if the pump is not calibrated or activation was rejected.
+ */
+bool WaterPump::dose(double ml, int pulses, std::chrono::milliseconds soakTime, ContinueCheck continueCheck) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    double flow = currentFlowRate();
+    if (flow <= 0.0 || ml <= 0.0) {
+        return false;
+    }
+
+    size_t chunks = pulses > 0 ? pulses : 1;
+    return startCycle(onTimeFor(ml / chunks, flow), chunks, soakTime, std::move(continueCheck));
+}
+
+/**
+ * @brief Run a pulse-soak cycle: a number of pulses separated by soak pauses.
+ * @param pulseTime On-time of one pulse.
+ * @param pulses Number of pulses.
+ * @param soakTime Pause between the pulses.
+ * @param continueCheck Asked at the end of every soak pause, returning false ends the cycle early.
+ * @return True if the cycle started, false if activation was rejected by a lockout or a fault.
+ */
+bool WaterPump::pulseSoak(std::chrono::milliseconds pulseTime, int pulses, std::chrono::milliseconds soakTime,
+                          ContinueCheck continueCheck) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    return startCycle(pulseTime, pulses > 0 ? pulses : 1, soakTime, std::move(continueCheck));
 }
 
 /**
  * @brief Toggle the water pump status.
  */
 void WaterPump::toggle() {
-    if (isRunning) {
+    if (getStatus()) {
         deactivate();
     } else {
         activate();
@@ -75,7 +209,679 @@ void WaterPump::toggle() {
  * @return True if the water pump is running, false otherwise.
  */
 bool WaterPump::getStatus() {
-    return isRunning;
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return state == State::RUNNING;
+}
+
+/**
+ * @brief Get the operating state of the pump.
+ * @return Current state.
+ */
+WaterPump::State WaterPump::getState() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return currentState();
+}
+
+/**
+ * @brief Get the earliest time the pump will accept an activation.
+ * @return Time of the next allowed activation.
+ */
+WaterPump::Clock::time_point WaterPump::getNextActivationTime() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    switch (currentState()) {
+        case State::IDLE:
+            return Clock::now();
+        case State::LOCKOUT:
+            return lockoutDeadline;
+        case State::RUNNING:
+            if (runDeadline != Clock::time_point::max()) {
+                return runDeadline + std::chrono::seconds(ignoreTime);
+            }
+            break;
+        case State::FAULT:
+            break;
+    }
+
+    return Clock::time_point::max();
+}
+
+/**
+ * @brief Drive the pump line low at once, without waiting for the pump lock.
+ */
+void WaterPump::emergencyStop() {
+    // De-energize first, the pump lock may be held by the stalled thread
+    {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        if (pwmChannel != 0) {
+            PwmEngine::instance().setDuty(pwmChannel, 0.0);
+        } else if (output) {
+            output->forceLow();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(pumpMutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        if (state == State::RUNNING) {
+            stop(State::LOCKOUT);
+        }
+        return;
+    }
+
+    // The line is low but the state still says running, end the run once the lock is free
+    if (!forcedStop.exchange(true)) {
+        TimerService::instance().scheduleAfter(std::chrono::nanoseconds(0), [this]() {
+            std::lock_guard<std::mutex> lock(pumpMutex);
+            if (forcedStop.exchange(false) && state == State::RUNNING) {
+                stop(State::LOCKOUT);
+            }
+        }, this);
+    }
+}
+
+/**
+ * @brief Switch the pump off and reject activation until clearFault() is called.
+ */
+void WaterPump::setFault() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    stop(State::FAULT);
+}
+
+/**
+ * @brief Leave the fault state.
+ */
+void WaterPump::clearFault() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    if (state == State::FAULT) {
+        state = State::IDLE;
+    }
+}
+
+/**
+ * @brief End a lockout early, e.g. for a manual override.
+ */
+void WaterPump::clearLockout() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    if (state == State::LOCKOUT) {
+        state = State::IDLE;
+    }
+}
+
+/**
+ * @brief Drive the pump with software PWM instead of switching it fully on.
+ * @param frequencyHz PWM frequency.
+ * @param duty Duty cycle between 0 and 1 while the pump runs.
+ * @param softStart Time to ramp up from 0 to the duty cycle when the pump starts.
+ * @return True if PWM mode was enabled, false if the pump is running.
+ */
+bool WaterPump::enablePwm(double frequencyHz, double duty, std::chrono::milliseconds softStart) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    if (state == State::RUNNING) {
+        return false;
+    }
+
+    this->softStart = softStart;
+    pwmDuty = duty < 0.0 ? 0.0 : (duty > 1.0 ? 1.0 : duty);
+
+    if (pwmChannel != 0) {
+        PwmEngine::instance().setFrequency(pwmChannel, frequencyHz);
+        return true;
+    }
+
+    // The engine requests the line together with the other PWM lines, this also leaves an output group
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
+    try {
+        pwmChannel = PwmEngine::instance().addChannel(pinNum, frequencyHz);
+    } catch (...) {
+        // Stay in on/off mode, the pump is not running
+        output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "WaterPump", false);
+        throw;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Switch the pump back to plain on/off control.
+ * @return True if PWM mode was disabled, false if the pump is running.
+ */
+bool WaterPump::disablePwm() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    if (state == State::RUNNING) {
+        return false;
+    }
+
+    if (pwmChannel != 0) {
+        std::lock_guard<std::mutex> outputLock(outputMutex);
+        PwmEngine::instance().removeChannel(pwmChannel);
+        pwmChannel = 0;
+
+        // Take the line back as a plain output
+        output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "WaterPump", false);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check whether the pump is driven with PWM.
+ * @return True if PWM mode is enabled, false otherwise.
+ */
+bool WaterPump::isPwmEnabled() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return pwmChannel != 0;
+}
+
+/**
+ * @brief Set the PWM duty cycle, applied at once if the pump is running.
+ * @param duty Duty cycle between 0 and 1.
+ */
+void WaterPump::setPwmDuty(double duty) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    pwmDuty = duty < 0.0 ? 0.0 : (duty > 1.0 ? 1.0 : duty);
+    if (pwmChannel != 0 && state == State::RUNNING) {
+        PwmEngine::instance().setDuty(pwmChannel, pwmDuty);
+    }
+}
+
+/**
+ * @brief Get the PWM duty cycle.
+ * @return Duty cycle between 0 and 1.
+ */
+double WaterPump::getPwmDuty() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return pwmDuty;
+}
+
+/**
+ * @brief Write the pump line through an output group instead of on its own.
+ * @param group Output group, must outlive the pump or the membership.
+ * @return True if the pump joined, false if it runs in PWM mode or already is in a group.
+ */
+bool WaterPump::joinOutputGroup(OutputGroup& group) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    if (pwmChannel != 0 || output->getGroup() != nullptr) {
+        return false;
+    }
+
+    // The group requests the line together with its other outputs, at the level it has now
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
+    output = std::make_unique<DigitalPin>(group, pinNum, lineOn);
+
+    return true;
+}
+
+/**
+ * @brief Take the pump line back from its output group as a plain output.
+ */
+void WaterPump::leaveOutputGroup() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    if (pwmChannel != 0 || output->getGroup() == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    output.reset();
+    output = std::make_unique<DigitalPin>(pinNum, DigitalPin::Direction::Output, "WaterPump", lineOn);
+}
+
+/**
+ * @brief Get the output group the pump line is written through.
+ * @return The group, nullptr if the line is written on its own.
+ */
+OutputGroup* WaterPump::getOutputGroup() const {
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    return output ? output->getGroup() : nullptr;
+}
+
+/**
+ * @brief Get the id of the pump's output in its output group.
+ * @return Id of the output, 0 without a group.
+ */
+OutputGroup::OutputId WaterPump::getOutputId() const {
+    std::lock_guard<std::mutex> outputLock(outputMutex);
+    return output ? output->getGroupOutput() : 0;
+}
+
+/**
+ * @brief Set the calibrated flow rate of the pump.
+ * @param mlPerSecond Flow at the pump's setting in millilitres per second, 0 if uncalibrated.
+ */
+void WaterPump::setFlowRate(double mlPerSecond) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    flowRate = mlPerSecond > 0.0 ? mlPerSecond : 0.0;
+}
+
+/**
+ * @brief Set a flow calibration curve against the PWM duty cycle.
+ * @param curve Pairs of duty cycle and flow in millilitres per second.
+ */
+void WaterPump::setFlowCurve(const std::vector<std::pair<double, double>>& curve) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    flowCurve = curve;
+    std::sort(flowCurve.begin(), flowCurve.end());
+}
+
+/**
+ * @brief Get the flow rate at the current setting.
+ * @return Flow in millilitres per second, 0 if uncalibrated.
+ */
+double WaterPump::getFlowRate() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return currentFlowRate();
+}
+
+/**
+ * @brief Split doses into pulses separated by soak pauses.
+ * @param maxChunkMl Largest volume of one pulse, 0 to deliver every dose in one pulse.
+ * @param soakTime Pause between the pulses.
+ */
+void WaterPump::setDoseChunking(double maxChunkMl, std::chrono::milliseconds soakTime) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    maxChunkVolume = maxChunkMl > 0.0 ? maxChunkMl : 0.0;
+    this->soakTime = soakTime;
+}
+
+/**
+ * @brief Get the estimated volume delivered since the pump was created.
+ * @return Volume in millilitres.
+ */
+double WaterPump::getVolumeDelivered() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return snapshotCounters().volumeMl;
+}
+
+/**
+ * @brief Get the lifetime counters, including a run in progress.
+ * @return Counters of the pump.
+ */
+PumpCounters::Record WaterPump::getCounters() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return snapshotCounters();
+}
+
+/**
+ * @brief Persist the lifetime counters to a file.
+ * @param path Path of the counter file.
+ * @param interval Time between checkpoints.
+ */
+void WaterPump::enableCounterPersistence(const std::string& path, std::chrono::seconds interval) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    // Continue from the stored totals
+    PumpCounters::Record stored;
+    if (PumpCounters::read(path, stored)) {
+        counters.activations += stored.activations;
+        counters.onTimeMs += stored.onTimeMs;
+        counters.volumeMl += stored.volumeMl;
+        if (stored.lastActivation > counters.lastActivation) {
+            counters.lastActivation = stored.lastActivation;
+        }
+    }
+
+    counterPath = path;
+    counterInterval = interval > std::chrono::seconds(0) ? interval : std::chrono::seconds(1);
+
+    if (counterTimer != 0) {
+        TimerService::instance().cancel(counterTimer);
+    }
+    scheduleCheckpoint();
+
+    logger.logEvent("INFO", "WaterPump", "Pump " + std::to_string(pinNum) + " counters in " + path + ", " +
+                                         std::to_string(counters.activations) + " activations, " +
+                                         std::to_string(counters.onTimeMs / 1000) + " s on");
+}
+
+/**
+ * @brief Write the counters to the counter file now.
+ * @return True if the file was written, false if persistence is disabled or the write failed.
+ */
+bool WaterPump::checkpointCounters() {
+    std::string path;
+    PumpCounters::Record record;
+    {
+        std::lock_guard<std::mutex> lock(pumpMutex);
+        if (counterPath.empty()) {
+            return false;
+        }
+        path = counterPath;
+        record = snapshotCounters();
+    }
+
+    // Write without the lock, the SD card may be slow
+    if (!PumpCounters::write(path, record)) {
+        logger.logEvent("WARN", "WaterPump", "Couldn't write pump counters to " + path);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Set the rated supply current of the pump, used for power budgeting.
+ * @param amps Current drawn while running.
+ */
+void WaterPump::setRatedCurrent(double amps) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    ratedCurrent = amps > 0.0 ? amps : 0.0;
+}
+
+/**
+ * @brief Get the rated supply current of the pump.
+ * @return Current drawn while running in amps.
+ */
+double WaterPump::getRatedCurrent() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    return ratedCurrent;
+}
+
+/**
+ * @brief Set a function to call whenever a run of the pump ends.
+ * @param listener Function to call, may be empty.
+ */
+void WaterPump::setStopListener(std::function<void()> listener) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+    stopListener = std::move(listener);
+}
+
+/**
+ * @brief Convert a state to a printable string.
+ * @param state Pump state.
+ * @return Name of the state.
+ */
+const char* WaterPump::stateToString(State state) {
+    switch (state) {
+        case State::IDLE:
+            return "IDLE";
+        case State::RUNNING:
+            return "RUNNING";
+        case State::LOCKOUT:
+            return "LOCKOUT";
+        case State::FAULT:
+            return "FAULT";
+    }
+    return "UNKNOWN";
+}
+
+/**
+ * @brief Resolve an expired lockout to IDLE.
+ * @return Current state.
+ */
+WaterPump::State WaterPump::currentState() {
+    if (state == State::LOCKOUT && Clock::now() >= lockoutDeadline) {
+        state = State::IDLE;
+    }
+    return state;
+}
+
+/**
+ * @brief Check whether an activation is allowed and energize the pump.
+ * @param deadline End of the run, max() for an open-ended run.
+ * @return True if the pump runs, false if activation was rejected.
+ */
+bool WaterPump::start(Clock::time_point deadline) {
+    State current = currentState();
+    if (current == State::LOCKOUT || current == State::FAULT) {
+        return false;
+    }
+
+    // A restart of a running pump is not a new activation
+    if (current != State::RUNNING) {
+        counters.activations++;
+        counters.lastActivation = static_cast<int64_t>(time(nullptr));
+    }
+
+    setLine(true);
+    state = State::RUNNING;
+    runDeadline = deadline;
+
+    return true;
+}
+
+/**
+ * @brief De-energize the pump and enter the given state.
+ * @param next State after stopping.
+ */
+void WaterPump::stop(State next) {
+    // Report the end of the run once the lock is released
+    if (state == State::RUNNING && stopListener) {
+        TimerService::instance().scheduleAfter(std::chrono::nanoseconds(0), stopListener, this);
+    }
+
+    setLine(false);
+    chunksLeft = 0;
+    cycleCheck = nullptr;
+
+    if (next == State::LOCKOUT) {
+        // Lock the pump out for the ignore time after the run
+        lockoutDeadline = Clock::now() + std::chrono::seconds(ignoreTime);
+        state = ignoreTime > 0 ? State::LOCKOUT : State::IDLE;
+    } else {
+        state = next;
+    }
+}
+
+/**
+ * @brief Start a cycle of pulses separated by soak pauses.
+ * @param onTime On-time of one pulse.
+ * @param pulses Number of pulses.
+ * @param soak Pause between the pulses.
+ * @param continueCheck Asked at the end of every soak pause, may be empty.
+ * @return True if the cycle started, false if activation was rejected.
+ */
+bool WaterPump::startCycle(Clock::duration onTime, size_t pulses, Clock::duration soak, ContinueCheck continueCheck) {
+    // The run, soak pauses included, ends after the last pulse
+    Clock::time_point now = Clock::now();
+    Clock::time_point deadline = now + onTime * pulses + soak * (pulses - 1);
+    if (!start(deadline)) {
+        return false;
+    }
+
+    chunkOnTime = onTime;
+    cycleSoakTime = soak;
+    cycleCheck = std::move(continueCheck);
+    chunksLeft = pulses - 1;
+
+    uint64_t generation = pulseGeneration;
+    stopTimer = TimerService::instance().schedule(now + onTime, [this, generation]() {
+        endChunk(generation);
+    }, this);
+
+    return true;
+}
+
+/**
+ * @brief End the running pulse of a cycle, then soak or stop.
+ * @param generation Generation the timer was scheduled in.
+ */
+void WaterPump::endChunk(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
+
+    // A newer state change makes this timer stale
+    if (generation != pulseGeneration) {
+        return;
+    }
+    stopTimer = 0;
+
+    if (chunksLeft == 0) {
+        stop(State::LOCKOUT);
+        return;
+    }
+
+    // Let the water soak in before the next pulse, the pump stays RUNNING
+    setLine(false);
+
+    uint64_t soakGeneration = pulseGeneration;
+    stopTimer = TimerService::instance().scheduleAfter(cycleSoakTime, [this, soakGeneration]() {
+        startChunk(soakGeneration);
+    }, this);
+}
+
+/**
+ * @brief Start the next pulse of a cycle after a soak pause, unless the continue check ends the cycle.
+ * @param generation Generation the timer was scheduled in.
+ */
+void WaterPump::startChunk(uint64_t generation) {
+    std::unique_lock<std::mutex> lock(pumpMutex);
+
+    // A newer state change makes this timer stale
+    if (generation != pulseGeneration) {
+        return;
+    }
+    stopTimer = 0;
+
+    // Ask the owner without the lock, the check may take its own locks
+    if (cycleCheck) {
+        ContinueCheck check = cycleCheck;
+        lock.unlock();
+        bool keepGoing = check();
+        lock.lock();
+
+        if (generation != pulseGeneration) {
+            return;
+        }
+        if (!keepGoing) {
+            stop(State::LOCKOUT);
+            return;
+        }
+    }
+
+    chunksLeft--;
+    setLine(true);
+
+    uint64_t chunkGeneration = pulseGeneration;
+    stopTimer = TimerService::instance().scheduleAfter(chunkOnTime, [this, chunkGeneration]() {
+        endChunk(chunkGeneration);
+    }, this);
+}
+
+/**
+ * @brief Copy the counters and add the run in progress.
+ * @return Counters of the pump.
+ */
+PumpCounters::Record WaterPump::snapshotCounters() {
+    PumpCounters::Record record = counters;
+
+    if (lineOn) {
+        Clock::duration onTime = Clock::now() - lineOnSince;
+        record.onTimeMs += std::chrono::duration_cast<std::chrono::milliseconds>(onTime).count();
+        record.volumeMl += volumeFor(onTime, currentFlowRate());
+    }
+
+    return record;
+}
+
+/**
+ * @brief Schedule the next counter checkpoint.
+ */
+void WaterPump::scheduleCheckpoint() {
+    counterTimer = TimerService::instance().scheduleAfter(counterInterval, [this]() {
+        checkpointCounters();
+
+        std::lock_guard<std::mutex> lock(pumpMutex);
+        if (counterTimer != 0) {
+            scheduleCheckpoint();
+        }
+    }, this);
+}
+
+/**
+ * @brief Get the flow rate at the current setting.
+ * @return Flow in millilitres per second, 0 if uncalibrated.
+ */
+double WaterPump::currentFlowRate() {
+    if (flowCurve.empty()) {
+        return flowRate;
+    }
+
+    // Interpolate the curve at the duty the pump runs at
+    double duty = pwmChannel != 0 ? pwmDuty : 1.0;
+    if (duty <= flowCurve.front().first) {
+        return flowCurve.front().second;
+    }
+    if (duty >= flowCurve.back().first) {
+        return flowCurve.back().second;
+    }
+
+    std::vector<std::pair<double, double>>::const_iterator upper =
+            std::lower_bound(flowCurve.begin(), flowCurve.end(), std::make_pair(duty, 0.0));
+    std::vector<std::pair<double, double>>::const_iterator lower = upper - 1;
+
+    double fraction = (duty - lower->first) / (upper->first - lower->first);
+    return lower->second + (upper->second - lower->second) * fraction;
+}
+
+/**
+ * @brief Compute the on-time that delivers a volume.
+ * @param ml Volume in millilitres.
+ * @param flow Flow in millilitres per second.
+ * @return On-time.
+ */
+WaterPump::Clock::duration WaterPump::onTimeFor(double ml, double flow) {
+    double seconds = ml / flow;
+    double ramp = pwmChannel != 0 ? std::chrono::duration<double>(softStart).count() : 0.0;
+
+    // A linear soft start delivers half the flow during the ramp
+    if (ramp > 0.0) {
+        seconds = seconds >= ramp / 2.0 ? seconds + ramp / 2.0 : std::sqrt(2.0 * seconds * ramp);
+    }
+
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+/**
+ * @brief Estimate the volume delivered during an on-time.
+ * @param onTime Time the pump was energized.
+ * @param flow Flow in millilitres per second.
+ * @return Volume in millilitres.
+ */
+double WaterPump::volumeFor(Clock::duration onTime, double flow) {
+    double seconds = std::chrono::duration<double>(onTime).count();
+    double ramp = pwmChannel != 0 ? std::chrono::duration<double>(softStart).count() : 0.0;
+
+    if (ramp <= 0.0) {
+        return flow * seconds;
+    }
+    return seconds >= ramp ? flow * (seconds - ramp / 2.0) : flow * seconds * seconds / (2.0 * ramp);
+}
+
+/**
+ * @brief Switch the GPIO line and cancel any pending pulse stop.
+ * @param on True to energize the pump, false to de-energize it.
+ */
+void WaterPump::setLine(bool on) {
+    if (stopTimer != 0) {
+        TimerService::instance().cancel(stopTimer);
+        stopTimer = 0;
+    }
+    pulseGeneration++;
+
+    // Account the on-time and delivered volume whenever the pump switches off
+    Clock::time_point now = Clock::now();
+    if (lineOn && !on) {
+        counters.onTimeMs += std::chrono::duration_cast<std::chrono::milliseconds>(now - lineOnSince).count();
+        counters.volumeMl += volumeFor(now - lineOnSince, currentFlowRate());
+    } else if (!lineOn && on) {
+        lineOnSince = now;
+    }
+    lineOn = on;
+
+    if (pwmChannel != 0) {
+        // Ramp up on start, stop at once
+        PwmEngine::instance().setDuty(pwmChannel, on ? pwmDuty : 0.0,
+                                      on ? softStart : std::chrono::milliseconds(0));
+    } else {
+        output->write(on);
+    }
 }
 
 /**
@@ -83,6 +889,7 @@ bool WaterPump::getStatus() {
  * @param pumpTimeSeconds Time to run the water pump.
  */
 void WaterPump::setActivationDuration(int pumpTimeSeconds) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
     activationDuration = pumpTimeSeconds;
 }
 
@@ -91,6 +898,7 @@ void WaterPump::setActivationDuration(int pumpTimeSeconds) {
  * @return The duration to run the water pump.
  */
 int WaterPump::getActivationDuration() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
     return activationDuration;
 }
 
@@ -99,6 +907,7 @@ int WaterPump::getActivationDuration() {
  * @param ignoreTimeSeconds Time to ignore water pump activation after the last activation.
  */
 void WaterPump::setIgnoreTime(int ignoreTimeSeconds) {
+    std::lock_guard<std::mutex> lock(pumpMutex);
     ignoreTime = ignoreTimeSeconds;
 }
 
@@ -107,5 +916,6 @@ void WaterPump::setIgnoreTime(int ignoreTimeSeconds) {
  * @return Time to ignore water pump activation after the last activation.
  */
 int WaterPump::getIgnoreTime() {
+    std::lock_guard<std::mutex> lock(pumpMutex);
     return ignoreTime;
 }
@@ -2,12 +2,47 @@
 #define WATERPUMP_H
 
 #include <gpiod.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DigitalPin.h"
+#include "PumpCounters.h"
+#include "PwmEngine.h"
+#include "TimerService.h"
 
 /**
  * @brief The WaterPump class represents a water pump controlled by GPIO.
+ * @details The pump owns its lockout: after every run it stays in LOCKOUT for the ignore time and
+ *          rejects activation until the lockout deadline has passed. All deadlines use the monotonic
+ *          clock and every state check is O(1). In PWM mode the line is driven by the shared PwmEngine at a
+ *          configurable speed instead of full on, with an optional soft-start ramp against pressure hammer.
+ *          With a flow calibration the pump doses volumes: the on-time is computed from the flow rate at the
+ *          current duty and large doses are split into pulses separated by soak pauses. Lifetime counters
+ *          (on-time, activations, last activation, volume) are kept in memory and can be checkpointed to a
+ *          fixed-layout file.
  */
 class WaterPump {
 public:
+    using Clock = std::chrono::steady_clock;
+    using ContinueCheck = std::function<bool()>;
+
+    /**
+     * @enum State
+     * @brief Operating state of the pump.
+     */
+    enum class State {
+        IDLE,           /**< Off and ready to run */
+        RUNNING,        /**< Energized */
+        LOCKOUT,        /**< Off, activation rejected until the lockout deadline */
+        FAULT           /**< Off, activation rejected until the fault is cleared */
+    };
+
     /**
      * @brief Constructor for WaterPump.
      * @param pin GPIO pin number.
@@ -22,15 +57,69 @@ public:
     ~WaterPump();
 
     /**
-     * @brief Activate the water pump.
+     * @brief Activate the water pump until deactivate() is called.
+     * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
      */
-    void activate();
+    bool activate();
 
     /**
-     * @brief Deactivate the water pump.
+     * @brief Deactivate the water pump, starting the lockout if it was running.
      */
     void deactivate();
 
+    /**
+     * @brief Run the water pump for an exact duration.
+     * @details The pump is switched on immediately and a timer de-energizes the line at the deadline,
+     *          independent of the control loop. A new pulse, activate() or deactivate() replaces a running pulse.
+     * @param duration Time to run the pump.
+     * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
+     */
+    bool pulse(std::chrono::milliseconds duration);
+
+    /**
+     * @brief Run the water pump for the activation duration.
+     * @return True if the pump runs, false if activation was rejected by a lockout or a fault.
+     */
+    bool pulse();
+
+    /**
+     * @brief Deliver a volume of water using the flow calibration.
+     * @details The on-time is computed from the flow rate, including the soft start in PWM mode. A dose larger than
+     *          the chunk volume is split into equal pulses with a soak pause in between. The pump stays RUNNING
+     *          for the whole dose and starts its lockout after the last pulse.
+     * @param ml Volume in millilitres.
+     * @param continueCheck Asked at the end of every soak pause, returning false ends the dose early. Runs on
+     *                      the timer thread and must not block or call into the pump.
+     * @return True if the dose started, false if the pump is not calibrated or activation was rejected.
+     */
+    bool dose(double ml, ContinueCheck continueCheck = nullptr);
+
+    /**
+     * @brief Deliver a volume of water in a given number of equal pulses separated by soak pauses.
+     * @details Like dose(ml), but the split is given by the caller and the chunking setting is left alone.
+     * @param ml Volume in millilitres.
+     * @param pulses Number of pulses.
+     * @param soakTime Pause between the pulses.
+     * @param continueCheck Asked at the end of every soak pause, returning false ends the dose early. Runs on
+     *                      the timer thread and must not block or call into the pump.
+     * @return True if the dose started, false if the pump is not calibrated or activation was rejected.
+     */
+    bool dose(double ml, int pulses, std::chrono::milliseconds soakTime, ContinueCheck continueCheck = nullptr);
+
+    /**
+     * @brief Run a pulse-soak cycle: a number of pulses separated by soak pauses.
+     * @details Every pulse and pause is a TimerService event, so the cycles of many pumps interleave on one
+     *          thread. The pump stays RUNNING for the whole cycle and starts its lockout after the last pulse.
+     * @param pulseTime On-time of one pulse.
+     * @param pulses Number of pulses.
+     * @param soakTime Pause between the pulses.
+     * @param continueCheck Asked at the end of every soak pause, returning false ends the cycle early. Runs on
+     *                      the timer thread and must not block or call into the pump.
+     * @return True if the cycle started, false if activation was rejected by a lockout or a fault.
+     */
+    bool pulseSoak(std::chrono::milliseconds pulseTime, int pulses, std::chrono::milliseconds soakTime,
+                   ContinueCheck continueCheck = nullptr);
+
     /**
      * @brief Toggle the water pump status.
      */
@@ -42,6 +131,43 @@ public:
      */
     bool getStatus();
 
+    /**
+     * @brief Get the operating state of the pump.
+     * @return Current state.
+     */
+    State getState();
+
+    /**
+     * @brief Get the earliest time the pump will accept an activation.
+     * @details Now when idle, the lockout deadline when locked out, the end of the run plus the ignore time
+     *          while pulsing and Clock::time_point::max() while running open-ended or faulted.
+     * @return Time of the next allowed activation.
+     */
+    Clock::time_point getNextActivationTime();
+
+    /**
+     * @brief Drive the pump line low at once, without waiting for the pump lock.
+     * @details Used by the watchdog when the control loop stalls. The line is reached through outputMutex, which
+     *          is only held while the line is replaced. The state moves to LOCKOUT if the pump lock is free,
+     *          otherwise the stop is recorded and a timer applies it as soon as the owner releases the lock.
+     */
+    void emergencyStop();
+
+    /**
+     * @brief Switch the pump off and reject activation until clearFault() is called.
+     */
+    void setFault();
+
+    /**
+     * @brief Leave the fault state.
+     */
+    void clearFault();
+
+    /**
+     * @brief End a lockout early, e.g. for a manual override.
+     */
+    void clearLockout();
+
     /**
      * @brief Set the water pump activation duration.
      * @param pumpTimeSeconds The duration to run the water pump when activated.
@@ -66,14 +192,276 @@ public:
      */
     int getIgnoreTime();
 
+    /**
+     * @brief Drive the pump with software PWM instead of switching it fully on.
+     * @details The GPIO line is handed over to the shared PwmEngine. Rejected while the pump is running. If the PWM
+     *          line can't be set up the pump stays in on/off mode and std::runtime_error is thrown.
+     * @param frequencyHz PWM frequency.
+     * @param duty Duty cycle between 0 and 1 while the pump runs.
+     * @param softStart Time to ramp up from 0 to the duty cycle when the pump starts.
+     * @return True if PWM mode was enabled, false if the pump is running.
+     */
+    bool enablePwm(double frequencyHz, double duty, std::chrono::milliseconds softStart = std::chrono::milliseconds(0));
+
+    /**
+     * @brief Switch the pump back to plain on/off control.
+     * @return True if PWM mode was disabled, false if the pump is running.
+     */
+    bool disablePwm();
+
+    /**
+     * @brief Check whether the pump is driven with PWM.
+     * @return True if PWM mode is enabled, false otherwise.
+     */
+    bool isPwmEnabled();
+
+    /**
+     * @brief Set the PWM duty cycle, applied at once if the pump is running.
+     * @param duty Duty cycle between 0 and 1.
+     */
+    void setPwmDuty(double duty);
+
+    /**
+     * @brief Get the PWM duty cycle.
+     * @return Duty cycle between 0 and 1.
+     */
+    double getPwmDuty();
+
+    /**
+     * @brief Write the pump line through an output group instead of on its own.
+     * @details The group requests the line together with its other outputs. Enabling PWM mode leaves the group.
+     * @param group Output group, must outlive the pump or the membership.
+     * @return True if the pump joined, false if it runs in PWM mode or already is in a group.
+     */
+    bool joinOutputGroup(OutputGroup& group);
+
+    /**
+     * @brief Take the pump line back from its output group as a plain output.
+     */
+    void leaveOutputGroup();
+
+    /**
+     * @brief Get the output group the pump line is written through.
+     * @details Read without the pump lock like emergencyStop(), for the watchdog.
+     * @return The group, nullptr if the line is written on its own.
+     */
+    OutputGroup* getOutputGroup() const;
+
+    /**
+     * @brief Get the id of the pump's output in its output group.
+     * @return Id of the output, 0 without a group.
+     */
+    OutputGroup::OutputId getOutputId() const;
+
+    /**
+     * @brief Set the calibrated flow rate of the pump.
+     * @param mlPerSecond Flow at the pump's setting in millilitres per second, 0 if uncalibrated.
+     */
+    void setFlowRate(double mlPerSecond);
+
+    /**
+     * @brief Set a flow calibration curve against the PWM duty cycle.
+     * @details The flow is interpolated linearly between the points. An empty curve falls back to the flow rate.
+     * @param curve Pairs of duty cycle and flow in millilitres per second.
+     */
+    void setFlowCurve(const std::vector<std::pair<double, double>>& curve);
+
+    /**
+     * @brief Get the flow rate at the current setting.
+     * @return Flow in millilitres per second, 0 if uncalibrated.
+     */
+    double getFlowRate();
+
+    /**
+     * @brief Split doses into pulses separated by soak pauses.
+     * @param maxChunkMl Largest volume of one pulse, 0 to deliver every dose in one pulse.
+     * @param soakTime Pause between the pulses.
+     */
+    void setDoseChunking(double maxChunkMl, std::chrono::milliseconds soakTime);
+
+    /**
+     * @brief Get the estimated volume delivered over the pump's lifetime.
+     * @return Volume in millilitres.
+     */
+    double getVolumeDelivered();
+
+    /**
+     * @brief Get the lifetime counters, including a run in progress.
+     * @return Counters of the pump.
+     */
+    PumpCounters::Record getCounters();
+
+    /**
+     * @brief Persist the lifetime counters to a file.
+     * @details Counters stored in the file are added to the ones counted so far, then the file is rewritten at
+     *          every interval and when the pump is destroyed.
+     * @param path Path of the counter file.
+     * @param interval Time between checkpoints.
+     */
+    void enableCounterPersistence(const std::string& path, std::chrono::seconds interval);
+
+    /**
+     * @brief Write the counters to the counter file now.
+     * @return True if the file was written, false if persistence is disabled or the write failed.
+     */
+    bool checkpointCounters();
+
+    /**
+     * @brief Set the rated supply current of the pump, used for power budgeting.
+     * @param amps Current drawn while running.
+     */
+    void setRatedCurrent(double amps);
+
+    /**
+     * @brief Get the rated supply current of the pump.
+     * @return Current drawn while running in amps.
+     */
+    double getRatedCurrent();
+
+    /**
+     * @brief Set a function to call whenever a run of the pump ends.
+     * @details The listener is posted to the TimerService, so it runs without the pump locked and may call
+     *          back into the pump.
+     * @param listener Function to call, may be empty.
+     */
+    void setStopListener(std::function<void()> listener);
+
+    /**
+     * @brief Convert a state to a printable string.
+     * @param state Pump state.
+     * @return Name of the state.
+     */
+    static const char* stateToString(State state);
+
 private:
-    gpiod_chip* chip;           // GPIO chip
-    gpiod_line* line;           // GPIO line
+    std::unique_ptr<DigitalPin> output;     // Pump line, nullptr while the PWM engine drives it
     int pinNum;                 // GPIO pin number
-    bool isRunning = false;     // Water pump status
-    bool activated = false;     // Water pump activation status
     int activationDuration;     // Water pump activation duration
     int ignoreTime;             // Time to ignore water pump activation after last activation
+
+    std::mutex pumpMutex;                   // Guards the pump state against the timer thread
+    mutable std::mutex outputMutex;         // Guards replacing output and pwmChannel against the watchdog
+    State state = State::IDLE;              // Operating state
+    Clock::time_point runDeadline;          // End of the current pulse, max() for an open-ended run
+    Clock::time_point lockoutDeadline;      // End of the current lockout
+    TimerService::TimerId stopTimer = 0;    // Pending pulse stop timer, 0 if none
+    uint64_t pulseGeneration = 0;           // Incremented on every state change to ignore stale timers
+    std::atomic<bool> forcedStop{false};    // emergencyStop() drove the line low without the pump lock
+
+    PwmEngine::ChannelId pwmChannel = 0;    // PWM channel of the line, 0 for on/off control
+    double pwmDuty = 1.0;                   // Duty cycle while running in PWM mode
+    std::chrono::milliseconds softStart;    // Ramp-up time in PWM mode
+
+    double flowRate = 0.0;                              // Calibrated flow in ml/s, 0 if uncalibrated
+    std::vector<std::pair<double, double>> flowCurve;   // Flow in ml/s against duty cycle, sorted by duty
+    double maxChunkVolume = 0.0;                        // Largest volume of one dose pulse, 0 for no split
+    std::chrono::milliseconds soakTime;                 // Pause between the pulses of a dose
+    Clock::duration chunkOnTime;                        // On-time of one pulse of the current cycle
+    Clock::duration cycleSoakTime;                      // Pause between the pulses of the current cycle
+    ContinueCheck cycleCheck;                           // Decides after each pause whether the cycle goes on
+    size_t chunksLeft = 0;                              // Pulses of the current cycle still to start
+    bool lineOn = false;                                // The pump is energized
+    Clock::time_point lineOnSince;                      // Time the pump was energized
+    double ratedCurrent = 0.0;                          // Supply current while running in amps
+    std::function<void()> stopListener;                 // Called after every run
+
+    PumpCounters::Record counters;                      // Lifetime counters, excluding a run in progress
+    std::string counterPath;                            // Counter file, empty if not persisted
+    std::chrono::seconds counterInterval;               // Time between checkpoints
+    TimerService::TimerId counterTimer = 0;             // Pending checkpoint timer, 0 if none
+
+    /**
+     * @brief Resolve an expired lockout to IDLE.
+     * @details Must be called with pumpMutex held.
+     * @return Current state.
+     */
+    State currentState();
+
+    /**
+     * @brief Check whether an activation is allowed and energize the pump.
+     * @details Must be called with pumpMutex held.
+     * @param deadline End of the run, max() for an open-ended run.
+     * @return True if the pump runs, false if activation was rejected.
+     */
+    bool start(Clock::time_point deadline);
+
+    /**
+     * @brief De-energize the pump and enter the given state.
+     * @details Must be called with pumpMutex held. LOCKOUT starts a lockout of the ignore time,
+     *          or goes straight to IDLE if the ignore time is zero.
+     * @param next State after stopping.
+     */
+    void stop(State next);
+
+    /**
+     * @brief Start a cycle of pulses separated by soak pauses.
+     * @details Must be called with pumpMutex held.
+     * @param onTime On-time of one pulse.
+     * @param pulses Number of pulses.
+     * @param soak Pause between the pulses.
+     * @param continueCheck Asked at the end of every soak pause, may be empty.
+     * @return True if the cycle started, false if activation was rejected.
+     */
+    bool startCycle(Clock::duration onTime, size_t pulses, Clock::duration soak, ContinueCheck continueCheck);
+
+    /**
+     * @brief End the running pulse of a cycle, then soak or stop.
+     * @details Runs on the timer thread.
+     * @param generation Generation the timer was scheduled in.
+     */
+    void endChunk(uint64_t generation);
+
+    /**
+     * @brief Start the next pulse of a cycle after a soak pause, unless the continue check ends the cycle.
+     * @details Runs on the timer thread.
+     * @param generation Generation the timer was scheduled in.
+     */
+    void startChunk(uint64_t generation);
+
+    /**
+     * @brief Copy the counters and add the run in progress.
+     * @details Must be called with pumpMutex held.
+     * @return Counters of the pump.
+     */
+    PumpCounters::Record snapshotCounters();
+
+    /**
+     * @brief Schedule the next counter checkpoint.
+     * @details Must be called with pumpMutex held.
+     */
+    void scheduleCheckpoint();
+
+    /**
+     * @brief Get the flow rate at the current setting.
+     * @details Must be called with pumpMutex held.
+     * @return Flow in millilitres per second, 0 if uncalibrated.
+     */
+    double currentFlowRate();
+
+    /**
+     * @brief Compute the on-time that delivers a volume.
+     * @details Must be called with pumpMutex held.
+     * @param ml Volume in millilitres.
+     * @param flow Flow in millilitres per second.
+     * @return On-time.
+     */
+    Clock::duration onTimeFor(double ml, double flow);
+
+    /**
+     * @brief Estimate the volume delivered during an on-time.
+     * @details Must be called with pumpMutex held.
+     * @param onTime Time the pump was energized.
+     * @param flow Flow in millilitres per second.
+     * @return Volume in millilitres.
+     */
+    double volumeFor(Clock::duration onTime, double flow);
+
+    /**
+     * @brief Switch the GPIO line and cancel any pending pulse stop.
+     * @details Must be called with pumpMutex held.
+     * @param on True to energize the pump, false to de-energize it.
+     */
+    void setLine(bool on);
 };
 
 #endif // WATERPUMP_H
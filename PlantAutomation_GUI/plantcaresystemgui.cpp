@@ -17,13 +17,16 @@ struct tm *tm_local = localtime(&currentDateTime_t);    // Get the current time
 time_t dailyOnTime = mktime(tm_local);                  // Convert the tm struct to time_t
 time_t dailyOffTime = mktime(tm_local);                 // Convert the tm struct to time_t
 
-int ONE_DAY = 24 * 60 * 60;                             // Number of seconds in a day
 int SYSTEM_CLOCK = 1000;                                // System clock in milliseconds
+int WATCHDOG_TIMEOUT = 5 * SYSTEM_CLOCK;                // Missed clock time before the outputs are forced safe
 int PUMP_WAIT_TIME = 3 * 3600;                          // Time to ignore the pump after activation
 int PUMP_DURATION = 3;                                  // Duration to run the pump when activated
-int MULTI_PUMP_WAIT_TIME = 5 * 60;                      // Time between seperate pump activations
+double PUMP_RATED_CURRENT = 0.5;                        // Supply current of one water pump in amps
+double PUMP_SUPPLY_CURRENT = 0.5;                       // Supply current available to all water pumps in amps
+int PUMP_COUNTER_INTERVAL = 10 * 60;                    // Time between pump counter checkpoints
 int LIGHT_WAIT_TIME = 45;                               // Time to ignore the light after activation
 int LIGHT_ON_DURATION = 5;                              // Duration to run the light when activated
+double LIGHT_PPFD = 0.0;                                // PPFD of the shelf lights at the canopy in umol/m2/s, 0 until measured
 
 int TOP_LIGHT_PIN = 27;                                 // GPIO pin for top shelf light
 int TOP_PUMP_PIN = 17;                                  // GPIO pin for top shelf water pump
@@ -32,6 +35,9 @@ int BOTTOM_LIGHT_PIN = 24;                              // GPIO pin for bottom s
 int BOTTOM_PUMP_PIN = 23;                               // GPIO pin for bottom shelf water pump
 ADS1115::Mux BS_MUX_SELECT = ADS1115::Mux::AIN1_GND;    // Mux configuration for bottom shelf soil sensor
 
+// Shelf light and pump lines, switched together once per clock tick; declared first so it outlives the controllers
+OutputGroup shelfOutputs("PlantCareSystem");
+
 // Initialize system controllers
 SystemController topShelfControl(ADS1115_ADDRESS, 
                                 TS_MUX_SELECT, 
@@ -45,8 +51,8 @@ SystemController topShelfControl(ADS1115_ADDRESS,
 SystemController bottomShelfControl(ADS1115_ADDRESS, 
                                 BS_MUX_SELECT, 
                                 BOTTOM_LIGHT_PIN, 
-                                dailyOnTime + MULTI_PUMP_WAIT_TIME, 
-                                dailyOffTime + MULTI_PUMP_WAIT_TIME, 
+                                dailyOnTime, 
+                                dailyOffTime, 
                                 BOTTOM_PUMP_PIN, 
                                 PUMP_WAIT_TIME, 
                                 PUMP_DURATION);
@@ -71,9 +77,38 @@ PlantCareSystemGUI::PlantCareSystemGUI(QWidget *parent)
     topShelfControl.setSoilMoistureCalibrationValues(TOP_CAL_WET_DEFAULT, TOP_CAL_DRY_DEFAULT);
     bottomShelfControl.setSoilMoistureCalibrationValues(BOTTOM_CAL_WET_DEFAULT, BOTTOM_CAL_DRY_DEFAULT);
 
+    // Let the pump scheduler keep the pumps from running together on the shared supply
+    PumpScheduler::instance().setBudget(PUMP_SUPPLY_CURRENT, 0.0);
+    topShelfControl.setPumpRatedCurrent(PUMP_RATED_CURRENT);
+    bottomShelfControl.setPumpRatedCurrent(PUMP_RATED_CURRENT);
+
+    // Keep the daily light totals of each shelf
+    topShelfControl.setLightDliAccounting(LIGHT_PPFD, "top_light_dli.csv");
+    bottomShelfControl.setLightDliAccounting(LIGHT_PPFD, "bottom_light_dli.csv");
+
+    // Keep the pump runtime and volume counters across restarts
+    topShelfControl.setPumpCounterFile("top_pump.cnt", std::chrono::seconds(PUMP_COUNTER_INTERVAL));
+    bottomShelfControl.setPumpCounterFile("bottom_pump.cnt", std::chrono::seconds(PUMP_COUNTER_INTERVAL));
+
+    // Request all shelf outputs together so each clock tick writes them with one bulk update
+    topShelfControl.addToOutputGroup(shelfOutputs);
+    bottomShelfControl.addToOutputGroup(shelfOutputs);
+
+    // Switch the pumps off if the update loop stops running, the lights keep their state
+    topShelfControl.addToWatchdog(false);
+    bottomShelfControl.addToWatchdog(false);
+    ActuatorWatchdog::instance().start(std::chrono::milliseconds(WATCHDOG_TIMEOUT));
+
+    // Let the lights switch at their scheduled times until a manual override
+    topShelfControl.setLightAutomatic(true);
+    bottomShelfControl.setLightAutomatic(true);
+
     // Connect the timer to the update function
     connect(timer, &QTimer::timeout, this, [this]() {
 
+        // Tell the watchdog the update loop is alive
+        ActuatorWatchdog::instance().feed();
+
         // Update date and time
         *currentDateTime = QDateTime::currentDateTime();
 
@@ -86,24 +121,19 @@ PlantCareSystemGUI::PlantCareSystemGUI(QWidget *parent)
         // Update the system inputs
         update_system_inputs();
 
-        // Control the system if manual checboxes are not checked
-        
-        // Top shelf automatic light control method call
-        if (!ui->top_light_checkBox->isChecked())
-        {
-            topShelfControl.controlLight(working_time);
-        }
+        // Stage the output changes of the control calls and write them together at the end
+        shelfOutputs.begin();
+
+        // Control the system if manual checboxes are not checked, the lights follow their schedules by themselves
 
         // Top shelf automatic water pump control method call
         if (!ui->top_pump_checkBox->isChecked() && ui->top_pump_enable_checkbox->isChecked())
         {
             topShelfControl.controlWaterPump(working_time);
         }
-
-        // Bottom shelf automatic light control method call
-        if (!ui->bottom_light_checkbox->isChecked())
+        else
         {
-            bottomShelfControl.controlLight(working_time);
+            topShelfControl.cancelWatering();
         }
 
         // Bottom shelf automatic water pump control method call
@@ -111,6 +141,13 @@ PlantCareSystemGUI::PlantCareSystemGUI(QWidget *parent)
         {
             bottomShelfControl.controlWaterPump(working_time);
         }
+        else
+        {
+            bottomShelfControl.cancelWatering();
+        }
+
+        // Write every output change of this tick at once
+        shelfOutputs.commit();
 
     });
 
@@ -171,15 +208,16 @@ void PlantCareSystemGUI::on_top_light_checkBox_stateChanged(int arg1)
     // arg1 is '0' when not checked and '2' when checked
     if (arg1 == 0)
     {
-        // Turn off top shelf light
-        topShelfControl.setLightOn(false);
+        // Hand the top shelf light back to its schedule
+        topShelfControl.setLightAutomatic(true);
 
         // Log the manual light change
-        ui->log_listWidget->addItem(QString::fromStdString(logger.logEvent("INFO", "Manual Light Change", "Top Shelf Light Off")));
+        ui->log_listWidget->addItem(QString::fromStdString(logger.logEvent("INFO", "Manual Light Change", "Top Shelf Light Automatic")));
     }
     else if (arg1 == 2)
     {
         // Turn on top shelf light
+        topShelfControl.setLightAutomatic(false);
         topShelfControl.setLightOn(true);
 
         // Log the manual light change
@@ -195,15 +233,16 @@ void PlantCareSystemGUI::on_bottom_light_checkbox_stateChanged(int arg1)
     // arg1 is '0' when not checked and '2' when checked
     if (arg1 == 0)
     {
-        // Turn off bottom shelf light
-        bottomShelfControl.setLightOn(false);
+        // Hand the bottom shelf light back to its schedule
+        bottomShelfControl.setLightAutomatic(true);
 
         // Log the manual light change
-        ui->log_listWidget->addItem(QString::fromStdString(logger.logEvent("INFO", "Manual Light Change", "Bottom Shelf Light Off")));
+        ui->log_listWidget->addItem(QString::fromStdString(logger.logEvent("INFO", "Manual Light Change", "Bottom Shelf Light Automatic")));
     }
     else if (arg1 == 2)
     {
         // Turn on bottom shelf light
+        bottomShelfControl.setLightAutomatic(false);
         bottomShelfControl.setLightOn(true);
 
         // Log the manual light change
@@ -337,20 +376,6 @@ void PlantCareSystemGUI::update_gui_values() {
         ui->bott_light_off_time->setDateTime(QDateTime::fromTime_t(dailyOffTime));
     }   
 
-    // Update top shelf light time to the following day if it is less than the current time
-    if (ui->top_light_off_time->dateTime().toSecsSinceEpoch() < currentDateTime->toSecsSinceEpoch())
-    {
-        ui->top_light_on_time->setDateTime(ui->top_light_on_time->dateTime().addSecs(ONE_DAY));
-        ui->top_light_off_time->setDateTime(ui->top_light_off_time->dateTime().addSecs(ONE_DAY));
-    }
-
-    // Update bottom shelf light time to the following day if it is less than the current time
-    if (ui->bott_light_off_time->dateTime().toSecsSinceEpoch() < currentDateTime->toSecsSinceEpoch())
-    {
-        ui->bott_light_on_time->setDateTime(ui->bott_light_on_time->dateTime().addSecs(ONE_DAY));
-        ui->bott_light_off_time->setDateTime(ui->bott_light_off_time->dateTime().addSecs(ONE_DAY));
-    }
-
 
     // Scroll to the bottom of the log
     // ui->log_listWidget->scrollToBottom();